@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <time.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "protocolo.h"
+
+// Gerador de carga para a frente de rede do servidor_v2: abre N conexões, cada
+// uma com sua thread, e mantém até --em-voo pedidos pendentes em cada uma
+// (pipelining). A etiqueta de cada pedido é a posição dele na janela da conexão,
+// reaproveitada quando a resposta chega, o que permite respostas fora de ordem.
+// Cada pedido leva uma chave de idempotência sorteada; com --repetir parte deles é
+// reenviada com a mesma chave, como faria um cliente após um tempo esgotado. Com
+// --baixa parte dos pedidos vai com prioridade baixa, a primeira a ser recusada
+// pelo controle de admissão do servidor (--admissao prioridade). Com --folha parte
+// dos pedidos é uma folha de pagamento (OP_LANCAMENTOS): uma conta credita
+// --lancamentos contas sorteadas e é debitada do total, tudo ou nada
+
+typedef struct {
+    const char *host;
+    int porta;
+    const char *socket_unix; // Se definido, usa o socket Unix em vez de TCP
+    int conexoes;
+    int em_voo;
+    int duracao;
+    int num_contas;
+    int percentual_repetir; // Pedidos reenviados com a chave do anterior
+    int percentual_baixa;   // Pedidos enviados com PRIORIDADE_BAIXA
+    int percentual_folha;   // Pedidos que são folhas de pagamento
+    int creditos_por_folha; // Créditos de cada folha
+    uint64_t semente;
+} Configuracao;
+
+Configuracao cfg = {
+    .host = "127.0.0.1",
+    .porta = PORTA_PADRAO,
+    .socket_unix = NULL,
+    .conexoes = 4,
+    .em_voo = 64,
+    .duracao = 5,
+    .num_contas = 10,
+    .percentual_repetir = 0,
+    .percentual_baixa = 0,
+    .percentual_folha = 0,
+    .creditos_por_folha = 10,
+    .semente = 0,
+};
+
+// Resultado de cada conexão, somado ao final
+typedef struct {
+    int indice;
+    uint64_t *latencias; // Em nanossegundos, uma por resposta
+    size_t num_latencias;
+    size_t capacidade;
+    unsigned long resultados[7]; // Contagem por RESULTADO_*
+    unsigned long folhas;        // Folhas de pagamento enviadas
+    unsigned long repeticoes;    // Pedidos reenviados com a mesma chave
+    unsigned long repetidas;     // Respostas que vieram do cache de idempotência
+    unsigned long inesperadas;   // Respostas com etiqueta que não estava pendente
+} EstadoConexao;
+
+atomic_bool encerrar = false;
+
+static inline uint64_t agora_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Gerador xorshift64*, o mesmo dos clientes internos do servidor
+static inline uint64_t proximo_aleatorio(uint64_t *estado) {
+    *estado ^= *estado >> 12;
+    *estado ^= *estado << 25;
+    *estado ^= *estado >> 27;
+    return *estado * 0x2545F4914F6CDD1DULL;
+}
+
+static int conectar(void) {
+    int fd;
+    if (cfg.socket_unix != NULL) {
+        struct sockaddr_un endereco = {.sun_family = AF_UNIX};
+        strncpy(endereco.sun_path, cfg.socket_unix, sizeof(endereco.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&endereco, sizeof(endereco)) < 0) {
+            perror("Falha ao conectar ao socket Unix");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        struct sockaddr_in endereco = {.sin_family = AF_INET, .sin_port = htons(cfg.porta)};
+        if (inet_pton(AF_INET, cfg.host, &endereco.sin_addr) != 1) {
+            fprintf(stderr, "Endereço inválido: %s\n", cfg.host);
+            exit(EXIT_FAILURE);
+        }
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&endereco, sizeof(endereco)) < 0) {
+            perror("Falha ao conectar ao servidor");
+            exit(EXIT_FAILURE);
+        }
+        int um = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um));
+    }
+    return fd;
+}
+
+static bool enviar_tudo(int fd, const void *dados, size_t n) {
+    const char *p = dados;
+    while (n > 0) {
+        ssize_t escritos = send(fd, p, n, MSG_NOSIGNAL);
+        if (escritos < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += escritos;
+        n -= escritos;
+    }
+    return true;
+}
+
+static void registrar_latencia(EstadoConexao *estado, uint64_t latencia) {
+    if (estado->num_latencias == estado->capacidade) {
+        estado->capacidade = estado->capacidade ? estado->capacidade * 2 : 4096;
+        estado->latencias = realloc(estado->latencias, estado->capacidade * sizeof(uint64_t));
+        if (estado->latencias == NULL) {
+            perror("Falha ao alocar latências");
+            exit(EXIT_FAILURE);
+        }
+    }
+    estado->latencias[estado->num_latencias++] = latencia;
+}
+
+// Anexa ao envio uma folha de pagamento: o pedido seguido dos créditos e, por
+// último, do débito do pagador; retorna os bytes escritos
+static size_t montar_folha(char *destino, PedidoRede *pedido, uint64_t *aleatorio) {
+    pedido->operacao = OP_LANCAMENTOS;
+    pedido->origem = cfg.creditos_por_folha + 1;
+    size_t tamanho = sizeof(PedidoRede);
+    int64_t total = 0;
+    for (int i = 0; i <= cfg.creditos_por_folha; i++) {
+        LancamentoRede item = {0};
+        item.conta = (int32_t)(proximo_aleatorio(aleatorio) % cfg.num_contas);
+        if (i < cfg.creditos_por_folha) {
+            item.valor = 1 + (int64_t)(proximo_aleatorio(aleatorio) % 1000);
+            total += item.valor;
+        } else {
+            item.valor = -total;
+        }
+        memcpy(destino + tamanho, &item, sizeof(item));
+        tamanho += sizeof(item);
+    }
+    memcpy(destino, pedido, sizeof(*pedido));
+    return tamanho;
+}
+
+void *conexao(void *arg) {
+    EstadoConexao *estado = arg;
+    int fd = conectar();
+    uint64_t aleatorio = cfg.semente * 0x9E3779B97F4A7C15ULL + estado->indice + 1;
+
+    // Uma folha ocupa o pedido e os lançamentos dela no envio
+    size_t maior_pedido = sizeof(PedidoRede) +
+                          (cfg.percentual_folha > 0 ? (cfg.creditos_por_folha + 1) * sizeof(LancamentoRede) : 0);
+    uint64_t *enviado_ns = malloc(cfg.em_voo * sizeof(uint64_t));
+    int *livres = malloc(cfg.em_voo * sizeof(int)); // Etiquetas sem pedido pendente
+    char *envio = malloc(cfg.em_voo * maior_pedido);
+    char *entrada = malloc(cfg.em_voo * sizeof(RespostaRede));
+    if (enviado_ns == NULL || livres == NULL || envio == NULL || entrada == NULL) {
+        perror("Falha ao alocar estado da conexão");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < cfg.em_voo; i++) {
+        livres[i] = i;
+        enviado_ns[i] = 0;
+    }
+    int num_livres = cfg.em_voo;
+    size_t entrada_usada = 0;
+    PedidoRede anterior = {0};
+
+    for (;;) {
+        // Completa a janela com pedidos novos, num único envio. As repetições
+        // reenviam só depósitos e transferências
+        size_t enviar = 0;
+        uint64_t agora = agora_ns();
+        while (!encerrar && num_livres > 0) {
+            int etiqueta = livres[--num_livres];
+            PedidoRede pedido;
+            if (anterior.chave != 0 && (int)(proximo_aleatorio(&aleatorio) % 100) < cfg.percentual_repetir) {
+                pedido = anterior;
+                estado->repeticoes++;
+            } else {
+                memset(&pedido, 0, sizeof(pedido));
+                pedido.operacao = proximo_aleatorio(&aleatorio) % 2 ? OP_TRANSFERENCIA : OP_DEPOSITO;
+                pedido.origem = (int32_t)(proximo_aleatorio(&aleatorio) % cfg.num_contas);
+                pedido.destino = (int32_t)((pedido.origem + 1 + proximo_aleatorio(&aleatorio) % (cfg.num_contas - 1)) %
+                                           cfg.num_contas);
+                pedido.valor = (int64_t)(proximo_aleatorio(&aleatorio) % 1000) * 10;
+                pedido.chave = proximo_aleatorio(&aleatorio) | 1;
+                if ((int)(proximo_aleatorio(&aleatorio) % 100) < cfg.percentual_baixa) {
+                    pedido.prioridade = PRIORIDADE_BAIXA;
+                }
+                if ((int)(proximo_aleatorio(&aleatorio) % 100) < cfg.percentual_folha) {
+                    pedido.etiqueta = (uint32_t)etiqueta;
+                    enviar += montar_folha(envio + enviar, &pedido, &aleatorio);
+                    enviado_ns[etiqueta] = agora;
+                    estado->folhas++;
+                    continue;
+                }
+                anterior = pedido;
+            }
+            pedido.etiqueta = (uint32_t)etiqueta;
+            memcpy(envio + enviar, &pedido, sizeof(pedido));
+            enviar += sizeof(pedido);
+            enviado_ns[etiqueta] = agora;
+        }
+        if (enviar > 0 && !enviar_tudo(fd, envio, enviar)) {
+            perror("Falha ao enviar pedidos");
+            break;
+        }
+        if (num_livres == cfg.em_voo) {
+            break; // Encerrando e sem pendências
+        }
+
+        ssize_t n = read(fd, entrada + entrada_usada, cfg.em_voo * sizeof(RespostaRede) - entrada_usada);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno != ECONNRESET) {
+                perror("Falha ao ler respostas");
+            }
+            break; // O servidor fechou a conexão
+        }
+        entrada_usada += n;
+        agora = agora_ns();
+        size_t posicao = 0;
+        for (; entrada_usada - posicao >= sizeof(RespostaRede); posicao += sizeof(RespostaRede)) {
+            RespostaRede resposta;
+            memcpy(&resposta, entrada + posicao, sizeof(resposta));
+            if (resposta.etiqueta >= (uint32_t)cfg.em_voo || enviado_ns[resposta.etiqueta] == 0) {
+                estado->inesperadas++;
+                continue;
+            }
+            registrar_latencia(estado, agora - enviado_ns[resposta.etiqueta]);
+            enviado_ns[resposta.etiqueta] = 0;
+            livres[num_livres++] = resposta.etiqueta;
+            if (resposta.resultado < 7) {
+                estado->resultados[resposta.resultado]++;
+            }
+            estado->repetidas += resposta.repetida;
+        }
+        entrada_usada -= posicao;
+        memmove(entrada, entrada + posicao, entrada_usada);
+    }
+
+    close(fd);
+    free(enviado_ns);
+    free(livres);
+    free(envio);
+    free(entrada);
+    return NULL;
+}
+
+static int comparar_latencias(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentil(const uint64_t *ordenadas, size_t n, double p) {
+    if (n == 0) {
+        return 0.0;
+    }
+    size_t posicao = (size_t)(p / 100.0 * (n - 1) + 0.5);
+    return ordenadas[posicao] / 1000.0;
+}
+
+static long ler_inteiro(const char *nome, const char *valor, long minimo) {
+    char *fim;
+    errno = 0;
+    long numero = strtol(valor, &fim, 10);
+    if (errno != 0 || fim == valor || *fim != '\0' || numero < minimo) {
+        fprintf(stderr, "Valor inválido para --%s: '%s' (mínimo %ld)\n", nome, valor, minimo);
+        exit(EXIT_FAILURE);
+    }
+    return numero;
+}
+
+static void mostrar_uso(const char *programa) {
+    printf("Uso: %s [opções]\n"
+           "  --host IP                 endereço IPv4 do servidor (padrão %s)\n"
+           "  --porta N                 porta TCP do servidor (padrão %d)\n"
+           "  --unix CAMINHO            conecta pelo socket Unix em vez de TCP\n"
+           "  --conexoes N              conexões simultâneas, uma thread cada (padrão %d)\n"
+           "  --em-voo N                pedidos pendentes por conexão (padrão %d)\n"
+           "  --duracao S               tempo de envio em segundos (padrão %d)\n"
+           "  --contas N                contas do servidor (padrão %d)\n"
+           "  --repetir P               percentual de pedidos reenviados com a chave do anterior (padrão 0)\n"
+           "  --baixa P                 percentual de pedidos com prioridade baixa (padrão 0)\n"
+           "  --folha P                 percentual de pedidos que são folhas de pagamento (padrão 0)\n"
+           "  --lancamentos N           créditos de cada folha de pagamento (padrão %d)\n"
+           "  --semente N               semente dos pedidos (padrão: derivada do relógio)\n"
+           "  --ajuda                   mostra esta mensagem\n",
+           programa, cfg.host, cfg.porta, cfg.conexoes, cfg.em_voo, cfg.duracao, cfg.num_contas,
+           cfg.creditos_por_folha);
+}
+
+static void ler_configuracao(int argc, char **argv) {
+    cfg.semente = (uint64_t)time(NULL);
+    static const struct option opcoes[] = {
+        {"host", required_argument, NULL, 0},
+        {"porta", required_argument, NULL, 0},
+        {"unix", required_argument, NULL, 0},
+        {"conexoes", required_argument, NULL, 0},
+        {"em-voo", required_argument, NULL, 0},
+        {"duracao", required_argument, NULL, 0},
+        {"contas", required_argument, NULL, 0},
+        {"repetir", required_argument, NULL, 0},
+        {"baixa", required_argument, NULL, 0},
+        {"folha", required_argument, NULL, 0},
+        {"lancamentos", required_argument, NULL, 0},
+        {"semente", required_argument, NULL, 0},
+        {"ajuda", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int indice;
+    int opcao;
+    while ((opcao = getopt_long(argc, argv, "h", opcoes, &indice)) != -1) {
+        if (opcao == 'h') {
+            mostrar_uso(argv[0]);
+            exit(EXIT_SUCCESS);
+        } else if (opcao != 0) {
+            mostrar_uso(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        const char *nome = opcoes[indice].name;
+        if (strcmp(nome, "host") == 0) {
+            cfg.host = optarg;
+        } else if (strcmp(nome, "porta") == 0) {
+            cfg.porta = ler_inteiro(nome, optarg, 1);
+        } else if (strcmp(nome, "unix") == 0) {
+            cfg.socket_unix = optarg;
+        } else if (strcmp(nome, "conexoes") == 0) {
+            cfg.conexoes = ler_inteiro(nome, optarg, 1);
+        } else if (strcmp(nome, "em-voo") == 0) {
+            cfg.em_voo = ler_inteiro(nome, optarg, 1);
+        } else if (strcmp(nome, "duracao") == 0) {
+            cfg.duracao = ler_inteiro(nome, optarg, 1);
+        } else if (strcmp(nome, "contas") == 0) {
+            cfg.num_contas = ler_inteiro(nome, optarg, 2);
+        } else if (strcmp(nome, "repetir") == 0) {
+            cfg.percentual_repetir = ler_inteiro(nome, optarg, 0);
+            if (cfg.percentual_repetir > 100) {
+                fprintf(stderr, "Valor inválido para --repetir: %d (máximo 100)\n", cfg.percentual_repetir);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(nome, "baixa") == 0) {
+            cfg.percentual_baixa = ler_inteiro(nome, optarg, 0);
+            if (cfg.percentual_baixa > 100) {
+                fprintf(stderr, "Valor inválido para --baixa: %d (máximo 100)\n", cfg.percentual_baixa);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(nome, "folha") == 0) {
+            cfg.percentual_folha = ler_inteiro(nome, optarg, 0);
+            if (cfg.percentual_folha > 100) {
+                fprintf(stderr, "Valor inválido para --folha: %d (máximo 100)\n", cfg.percentual_folha);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(nome, "lancamentos") == 0) {
+            cfg.creditos_por_folha = ler_inteiro(nome, optarg, 1);
+            if (cfg.creditos_por_folha >= MAX_LANCAMENTOS) {
+                fprintf(stderr, "Valor inválido para --lancamentos: %d (máximo %d)\n", cfg.creditos_por_folha,
+                        MAX_LANCAMENTOS - 1);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(nome, "semente") == 0) {
+            cfg.semente = (uint64_t)ler_inteiro(nome, optarg, 0);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ler_configuracao(argc, argv);
+
+    pthread_t *threads = malloc(cfg.conexoes * sizeof(pthread_t));
+    EstadoConexao *estados = calloc(cfg.conexoes, sizeof(EstadoConexao));
+    if (threads == NULL || estados == NULL) {
+        perror("Falha ao alocar conexões");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t inicio = agora_ns();
+    for (int i = 0; i < cfg.conexoes; i++) {
+        estados[i].indice = i;
+        if (pthread_create(&threads[i], NULL, conexao, &estados[i]) != 0) {
+            perror("Falha ao criar thread de conexão");
+            exit(EXIT_FAILURE);
+        }
+    }
+    sleep(cfg.duracao);
+    encerrar = true;
+    for (int i = 0; i < cfg.conexoes; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double segundos = (agora_ns() - inicio) / 1e9;
+
+    // Junta as latências de todas as conexões
+    size_t total = 0;
+    unsigned long resultados[7] = {0}, folhas = 0, repeticoes = 0, repetidas = 0, inesperadas = 0;
+    for (int i = 0; i < cfg.conexoes; i++) {
+        total += estados[i].num_latencias;
+        for (int r = 0; r < 7; r++) {
+            resultados[r] += estados[i].resultados[r];
+        }
+        folhas += estados[i].folhas;
+        repeticoes += estados[i].repeticoes;
+        repetidas += estados[i].repetidas;
+        inesperadas += estados[i].inesperadas;
+    }
+    uint64_t *latencias = malloc((total ? total : 1) * sizeof(uint64_t));
+    size_t n = 0;
+    for (int i = 0; i < cfg.conexoes; i++) {
+        memcpy(latencias + n, estados[i].latencias, estados[i].num_latencias * sizeof(uint64_t));
+        n += estados[i].num_latencias;
+        free(estados[i].latencias);
+    }
+    qsort(latencias, total, sizeof(uint64_t), comparar_latencias);
+
+    printf("Gerador: %zu respostas em %.2f s (%.0f ops/s), %d conexões com %d em voo cada\n",
+           total, segundos, total / segundos, cfg.conexoes, cfg.em_voo);
+    printf("Latência: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, máx %.1f us\n",
+           percentil(latencias, total, 50.0), percentil(latencias, total, 99.0),
+           percentil(latencias, total, 99.9), total ? latencias[total - 1] / 1000.0 : 0.0);
+    printf("Resultados: %lu ok, %lu saldo insuficiente, %lu inválidos, %lu recusados por sobrecarga, "
+           "%lu recusados no encerramento, %lu etiquetas inesperadas\n",
+           resultados[RESULTADO_OK], resultados[RESULTADO_SALDO_INSUFICIENTE], resultados[RESULTADO_INVALIDO],
+           resultados[RESULTADO_OCUPADO], resultados[RESULTADO_ENCERRANDO], inesperadas);
+    if (cfg.percentual_folha > 0) {
+        printf("Folhas: %lu enviadas com %d créditos cada\n", folhas, cfg.creditos_por_folha);
+    }
+    if (cfg.percentual_repetir > 0) {
+        printf("Repetições: %lu enviadas, %lu respondidas pelo cache do servidor (%lu ainda em andamento, "
+               "%lu com chave reaproveitada)\n",
+               repeticoes, repetidas, resultados[RESULTADO_EM_ANDAMENTO], resultados[RESULTADO_CHAVE_REUSADA]);
+    }
+
+    free(latencias);
+    free(estados);
+    free(threads);
+    return 0;
+}
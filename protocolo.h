@@ -0,0 +1,86 @@
+#ifndef PROTOCOLO_H
+#define PROTOCOLO_H
+
+#include <stdint.h>
+
+// Protocolo binário entre o servidor e clientes de rede (gerador_carga.c).
+// Pedidos e respostas são quadros de tamanho fixo, na ordem de bytes da máquina
+// (little-endian nas plataformas suportadas). Um cliente pode enviar vários
+// pedidos sem esperar as respostas; elas podem voltar fora de ordem e são
+// associadas aos pedidos pela etiqueta, que o servidor devolve sem interpretar.
+// Um pedido com chave de idempotência diferente de zero é executado uma única vez:
+// se o cliente o reenviar (por exemplo, após um tempo esgotado), o servidor devolve
+// o resultado da primeira execução sem tocar as contas. As chaves são globais, então
+// cada cliente deve sorteá-las de 64 bits aleatórios.
+// Com o servidor rodando com --wal, uma resposta só é enviada depois que o commit em
+// grupo levou ao disco os registros da operação (e das concluídas antes dela): o
+// resultado recebido sobrevive a uma queda do servidor. Sem --wal, não há garantia.
+// Um pedido OP_LANCAMENTOS é seguido, no mesmo fluxo, por origem quadros
+// LancamentoRede: débitos e créditos aplicados de uma só vez (todos ou nenhum).
+// A soma dos valores deve ser zero; um quadro com quantidade fora de
+// 1..MAX_LANCAMENTOS não pode ser delimitado e a conexão é fechada
+
+#define PORTA_PADRAO 7000
+#define MAX_LANCAMENTOS 1024 // Lançamentos de um pedido OP_LANCAMENTOS
+
+// Operações (mesma numeração de Requisicao.operacao)
+enum {
+    OP_DEPOSITO = 1,
+    OP_TRANSFERENCIA = 2,
+    OP_BALANCO = 3,
+    OP_LANCAMENTOS = 5, // 4 são os juros, só gerados pelo próprio servidor
+};
+
+// Resultado de um pedido
+enum {
+    RESULTADO_OK = 0,
+    RESULTADO_SALDO_INSUFICIENTE = 1, // Transferência recusada; nada foi alterado
+    RESULTADO_INVALIDO = 2,           // Operação ou conta inexistente, valor negativo ou acima de
+                                      // INT64_MAX / 2048, depósito que passaria a conta de INT64_MAX / 4
+    RESULTADO_ENCERRANDO = 3,         // O servidor está encerrando e não aceitou o pedido
+    RESULTADO_EM_ANDAMENTO = 4,       // Repetição de um pedido ainda não concluído; reenviar depois
+    RESULTADO_CHAVE_REUSADA = 5,      // A chave já foi usada por um pedido com outro conteúdo
+    RESULTADO_OCUPADO = 6,            // Recusado pelo controle de admissão (fila cheia) ou por falta de
+                                      // espaço no cache de idempotência; nada foi alterado
+};
+
+// Prioridade de um pedido; sob sobrecarga os de prioridade baixa são recusados primeiro
+enum {
+    PRIORIDADE_NORMAL = 0,
+    PRIORIDADE_ALTA = 1,
+    PRIORIDADE_BAIXA = 2,
+};
+
+typedef struct {
+    uint32_t etiqueta;   // Escolhida pelo cliente; volta na resposta
+    uint8_t operacao;    // OP_*
+    uint8_t prioridade;  // PRIORIDADE_*
+    uint8_t reservado[2];
+    int32_t origem;      // Com OP_LANCAMENTOS, quantos LancamentoRede seguem o pedido
+    int32_t destino;     // Ignorado fora das transferências
+    int64_t valor;       // Em centavos
+    uint64_t chave;      // Chave de idempotência (0 = sem deduplicação)
+} PedidoRede;
+
+typedef struct {
+    uint32_t etiqueta;
+    uint32_t id_operacao; // Id da Requisicao no servidor (0 se o pedido não foi aceito)
+    uint8_t resultado;    // RESULTADO_*
+    uint8_t operacao;
+    uint8_t repetida;     // 1 se a resposta veio do cache de idempotência
+    uint8_t reservado[5];
+    int64_t saldo;        // Saldo da conta de origem após a operação; total das contas no balanço.
+                          // Em OP_LANCAMENTOS, a origem é a conta de menor número com débito
+} RespostaRede;
+
+typedef struct {
+    int32_t conta;
+    uint32_t reservado;
+    int64_t valor;        // Em centavos; negativo debita a conta, positivo credita
+} LancamentoRede;
+
+_Static_assert(sizeof(PedidoRede) == 32, "PedidoRede deve ter 32 bytes");
+_Static_assert(sizeof(RespostaRede) == 24, "RespostaRede deve ter 24 bytes");
+_Static_assert(sizeof(LancamentoRede) == 16, "LancamentoRede deve ter 16 bytes");
+
+#endif
@@ -2,10 +2,12 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <time.h>
 
 #define NUM_THREADS 4      // Número de threads no pool
 #define NUM_CONTAS 10      // Número de contas bancárias
 #define MAX_REQUISICOES 50 // Tamanho máximo da fila de requisições
+#define DURACAO_EXECUCAO 20 // Segundos até o encerramento
 
 // Estrutura para armazenar uma conta bancária
 typedef struct {
@@ -29,6 +31,8 @@ int inicio_fila = 0, fim_fila = 0;
 int contador_operacoes = 0; // Conta operações para inserir balanço a cada 10
 pthread_mutex_t mutex_contas, mutex_fila;
 pthread_cond_t cond_requisicao;
+pthread_cond_t cond_espaco; // Sinalizada quando a fila libera posições
+int encerrar = 0; // Protegido por mutex_fila: a fila não aceita mais requisições
 
 // Funções de operações
 void deposito(int id, float valor, int op_id) {
@@ -68,13 +72,18 @@ void *trabalhador(void *arg) {
         Requisicao req;
 
         pthread_mutex_lock(&mutex_fila);
-        while (inicio_fila == fim_fila) {  // Fila vazia
+        while (inicio_fila == fim_fila && !encerrar) {  // Fila vazia
             pthread_cond_wait(&cond_requisicao, &mutex_fila);
         }
+        if (inicio_fila == fim_fila) {  // Encerrando e sem pendências: termina a thread
+            pthread_mutex_unlock(&mutex_fila);
+            break;
+        }
 
         // Retira requisição da fila
         req = fila_requisicoes[inicio_fila];
         inicio_fila = (inicio_fila + 1) % MAX_REQUISICOES;
+        pthread_cond_broadcast(&cond_espaco);
         pthread_mutex_unlock(&mutex_fila);
 
         // Processa a requisição
@@ -89,11 +98,26 @@ void *trabalhador(void *arg) {
     return NULL;
 }
 
+// Posições livres na fila circular; chamada com mutex_fila travado
+int posicoes_livres(void) {
+    return MAX_REQUISICOES - 1 - (fim_fila - inicio_fila + MAX_REQUISICOES) % MAX_REQUISICOES;
+}
+
 // Função do servidor para adicionar uma nova requisição
 void adicionar_requisicao(int operacao, int id_origem, int id_destino, float valor) {
     static int id_contador = 0; // Contador global para IDs únicos
 
     pthread_mutex_lock(&mutex_fila);
+    // A fila comporta MAX_REQUISICOES - 1 requisições (uma posição fica vazia para
+    // distinguir cheia de vazia); a cada 10 operações entra também um balanço
+    int necessarias = (contador_operacoes + 1) % 10 == 0 ? 2 : 1;
+    while (posicoes_livres() < necessarias && !encerrar) {  // Fila cheia
+        pthread_cond_wait(&cond_espaco, &mutex_fila);
+    }
+    if (encerrar) {  // Recusada: o servidor está encerrando
+        pthread_mutex_unlock(&mutex_fila);
+        return;
+    }
 
     // Adiciona nova requisição na fila com ID único
     fila_requisicoes[fim_fila].id = id_contador++;
@@ -118,11 +142,19 @@ void adicionar_requisicao(int operacao, int id_origem, int id_destino, float val
 // Função para gerar requisições aleatórias
 void *cliente(void *arg) {
     int id = *(int *)arg;
+    unsigned int semente = time(NULL) + id;  // rand() não é seguro entre threads
     while (1) {
-        int operacao = rand() % 2 + 1;  // 1 = deposito, 2 = transferencia
-        int id_origem = rand() % NUM_CONTAS;
-        int id_destino = rand() % NUM_CONTAS;
-        float valor = (float)(rand() % 1000) / 10.0;
+        pthread_mutex_lock(&mutex_fila);
+        int parar = encerrar;
+        pthread_mutex_unlock(&mutex_fila);
+        if (parar) {
+            break;
+        }
+
+        int operacao = rand_r(&semente) % 2 + 1;  // 1 = deposito, 2 = transferencia
+        int id_origem = rand_r(&semente) % NUM_CONTAS;
+        int id_destino = rand_r(&semente) % NUM_CONTAS;
+        float valor = (float)(rand_r(&semente) % 1000) / 10.0;
 
         if (operacao == 1) {
             adicionar_requisicao(operacao, id_origem, -1, valor);
@@ -134,15 +166,30 @@ void *cliente(void *arg) {
     return NULL;
 }
 
+// Fecha a fila após DURACAO_EXECUCAO segundos; os trabalhadores terminam o que
+// já foi aceito e saem
+void *temporizador(void *arg) {
+    sleep(DURACAO_EXECUCAO);
+    pthread_mutex_lock(&mutex_fila);
+    encerrar = 1;
+    pthread_cond_broadcast(&cond_requisicao);
+    pthread_cond_broadcast(&cond_espaco);
+    pthread_mutex_unlock(&mutex_fila);
+    printf("Tempo de execução máximo atingido. Encerrando o programa...\n");
+    return NULL;
+}
+
 int main() {
     pthread_t threads[NUM_THREADS];
     pthread_t clientes[2];
+    pthread_t timer_thread;
     int cliente_ids[2] = {0, 1};
 
     // Inicializa mutexes e variáveis de condição
     pthread_mutex_init(&mutex_contas, NULL);
     pthread_mutex_init(&mutex_fila, NULL);
     pthread_cond_init(&cond_requisicao, NULL);
+    pthread_cond_init(&cond_espaco, NULL);
 
     // Inicializa contas
     for (int i = 0; i < NUM_CONTAS; i++) {
@@ -150,6 +197,8 @@ int main() {
         contas[i].saldo = 1000.0;  // Saldo inicial de 1000
     }
 
+    pthread_create(&timer_thread, NULL, temporizador, NULL);
+
     // Cria threads trabalhadoras
     for (int i = 0; i < NUM_THREADS; i++) {
         pthread_create(&threads[i], NULL, trabalhador, NULL);
@@ -160,7 +209,8 @@ int main() {
         pthread_create(&clientes[i], NULL, cliente, &cliente_ids[i]);
     }
 
-    // Junta threads (não encerra o programa)
+    // Junta threads: clientes e trabalhadores saem após o temporizador
+    pthread_join(timer_thread, NULL);
     for (int i = 0; i < 2; i++) {
         pthread_join(clientes[i], NULL);
     }
@@ -172,6 +222,7 @@ int main() {
     pthread_mutex_destroy(&mutex_contas);
     pthread_mutex_destroy(&mutex_fila);
     pthread_cond_destroy(&cond_requisicao);
+    pthread_cond_destroy(&cond_espaco);
 
     return 0;
 }
@@ -29,7 +29,7 @@ Requisicao fila_requisicoes[MAX_REQUISICOES];
 int inicio_fila = 0, fim_fila = 0;
 int contador_operacoes = 0;
 pthread_mutex_t mutex_contas, mutex_fila;
-pthread_cond_t cond_requisicao;
+pthread_cond_t cond_requisicao, cond_espaco;
 
 void deposito(int id, float valor, int op_id) {
     pthread_mutex_lock(&mutex_contas);
@@ -86,6 +86,7 @@ void *trabalhador(void *arg) {
 
         req = fila_requisicoes[inicio_fila];
         inicio_fila = (inicio_fila + 1) % MAX_REQUISICOES;
+        pthread_cond_broadcast(&cond_espaco);
         pthread_mutex_unlock(&mutex_fila);
 
         if (req.operacao == 1) {
@@ -99,10 +100,18 @@ void *trabalhador(void *arg) {
     return NULL;
 }
 
+int posicoes_livres(void) {
+    return MAX_REQUISICOES - 1 - (fim_fila - inicio_fila + MAX_REQUISICOES) % MAX_REQUISICOES;
+}
+
 void adicionar_requisicao(int operacao, int id_origem, int id_destino, float valor) {
     static int id_contador = 0;
 
     pthread_mutex_lock(&mutex_fila);
+    int necessarias = (contador_operacoes + 1) % 10 == 0 ? 2 : 1;
+    while (posicoes_livres() < necessarias && !encerrar) {
+        pthread_cond_wait(&cond_espaco, &mutex_fila);
+    }
     if (encerrar) {
         pthread_mutex_unlock(&mutex_fila);
         return;
@@ -129,13 +138,20 @@ void adicionar_requisicao(int operacao, int id_origem, int id_destino, float val
 void *cliente(void *arg) {
     int id = *(int *)arg;
 
-    srand(time(NULL) + id);
+    unsigned int semente = time(NULL) + id;
+
+    while (1) {
+        pthread_mutex_lock(&mutex_fila);
+        int parar = encerrar;
+        pthread_mutex_unlock(&mutex_fila);
+        if (parar) {
+            break;
+        }
 
-    while (!encerrar) {
-        int operacao = rand() % 2 + 1;
-        int id_origem = rand() % NUM_CONTAS;
-        int id_destino = rand() % NUM_CONTAS;
-        float valor = (float)(rand() % 1000) / 10.0;
+        int operacao = rand_r(&semente) % 2 + 1;
+        int id_origem = rand_r(&semente) % NUM_CONTAS;
+        int id_destino = rand_r(&semente) % NUM_CONTAS;
+        float valor = (float)(rand_r(&semente) % 1000) / 10.0;
 
         if (operacao == 1) {
             adicionar_requisicao(operacao, id_origem, -1, valor);
@@ -152,6 +168,7 @@ void *temporizador(void *arg) {
     pthread_mutex_lock(&mutex_fila);
     encerrar = 1;
     pthread_cond_broadcast(&cond_requisicao);
+    pthread_cond_broadcast(&cond_espaco);
     pthread_mutex_unlock(&mutex_fila);
     printf("Tempo de execução máximo atingido. Encerrando o programa...\n");
     return NULL;
@@ -166,6 +183,7 @@ int main() {
     pthread_mutex_init(&mutex_contas, NULL);
     pthread_mutex_init(&mutex_fila, NULL);
     pthread_cond_init(&cond_requisicao, NULL);
+    pthread_cond_init(&cond_espaco, NULL);
 
     for (int i = 0; i < NUM_CONTAS; i++) {
         contas[i].id = i;
@@ -195,6 +213,7 @@ int main() {
     pthread_mutex_destroy(&mutex_contas);
     pthread_mutex_destroy(&mutex_fila);
     pthread_cond_destroy(&cond_requisicao);
+    pthread_cond_destroy(&cond_espaco);
 
     printf("Programa encerrado após %d segundos de execução.\n", DURACAO_EXECUCAO);
     return 0;
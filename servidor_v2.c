@@ -1,283 +1,7427 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <pthread.h>
-#include <unistd.h>
-#include <stdbool.h>
-#include <time.h>
-
-#define NUM_THREADS 4        // Número de threads no pool
-#define NUM_CONTAS 10        // Número de contas bancárias
-#define MAX_REQUISICOES 50   // Tamanho máximo da fila de requisições
-#define NUM_CLIENTES 2       // Número de threads clientes
-#define OPERACOES_PARA_BALANCO 10 // Insere balanço a cada 10 operações
-
-// Estrutura para armazenar uma conta bancária
-typedef struct {
-    int id;
-    float saldo;
-} Conta;
-
-// Estrutura para armazenar uma requisição
-typedef struct {
-    int id;          // ID único da operação
-    int operacao;    // 1 = deposito, 2 = transferencia, 3 = balanco
-    int id_origem;
-    int id_destino;
-    float valor;
-} Requisicao;
-
-// Estrutura para a fila de requisições
-typedef struct {
-    Requisicao dados[MAX_REQUISICOES];
-    int inicio;
-    int fim;
-    int tamanho;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond_nao_vazia;
-    pthread_cond_t cond_nao_cheia;
-} FilaRequisicoes;
-
-// Variáveis globais
-Conta contas[NUM_CONTAS];
-FilaRequisicoes fila_requisicoes;
-int contador_operacoes = 0; // Conta operações para inserir balanço a cada 10
-pthread_mutex_t mutex_contas;
-pthread_mutex_t mutex_contador;
-bool shutdown_flag = false;
-
-// Funções de operações
-void deposito(int id, float valor, int op_id) {
-    pthread_mutex_lock(&mutex_contas);
-    contas[id].saldo += valor;
-    printf("Operação %d: Depósito de %.2f na conta %d. Novo saldo: %.2f\n", op_id, valor, id, contas[id].saldo);
-    pthread_mutex_unlock(&mutex_contas);
-    sleep(1);
-}
-
-void transferencia(int origem, int destino, float valor, int op_id) {
-    pthread_mutex_lock(&mutex_contas);
-    if (contas[origem].saldo >= valor) {
-        contas[origem].saldo -= valor;
-        contas[destino].saldo += valor;
-        printf("Operação %d: Transferência de %.2f da conta %d para a conta %d\n", op_id, valor, origem, destino);
-    } else {
-        printf("Operação %d: Transferência falhou: saldo insuficiente na conta %d\n", op_id, origem);
-    }
-    pthread_mutex_unlock(&mutex_contas);
-    sleep(1);
-}
-
-void balanco(int op_id) {
-    pthread_mutex_lock(&mutex_contas);
-    printf("Operação %d: Balanço geral:\n", op_id);
-    for (int i = 0; i < NUM_CONTAS; i++) {
-        printf("Conta %d: Saldo = %.2f\n", contas[i].id, contas[i].saldo);
-    }
-    pthread_mutex_unlock(&mutex_contas);
-    sleep(1);
-}
-
-// Inicializa a fila de requisições
-void inicializar_fila(FilaRequisicoes *fila) {
-    fila->inicio = 0;
-    fila->fim = 0;
-    fila->tamanho = 0;
-    pthread_mutex_init(&fila->mutex, NULL);
-    pthread_cond_init(&fila->cond_nao_vazia, NULL);
-    pthread_cond_init(&fila->cond_nao_cheia, NULL);
-}
-
-// Adiciona uma requisição na fila
-bool enfileirar(FilaRequisicoes *fila, Requisicao req) {
-    pthread_mutex_lock(&fila->mutex);
-    while (fila->tamanho == MAX_REQUISICOES && !shutdown_flag) {
-        pthread_cond_wait(&fila->cond_nao_cheia, &fila->mutex);
-    }
-
-    if (shutdown_flag) {
-        pthread_mutex_unlock(&fila->mutex);
-        return false;
-    }
-
-    fila->dados[fila->fim] = req;
-    fila->fim = (fila->fim + 1) % MAX_REQUISICOES;
-    fila->tamanho++;
-    pthread_cond_signal(&fila->cond_nao_vazia);
-    pthread_mutex_unlock(&fila->mutex);
-    return true;
-}
-
-// Remove uma requisição da fila
-bool desenfileirar(FilaRequisicoes *fila, Requisicao *req) {
-    pthread_mutex_lock(&fila->mutex);
-    while (fila->tamanho == 0 && !shutdown_flag) {
-        pthread_cond_wait(&fila->cond_nao_vazia, &fila->mutex);
-    }
-
-    if (fila->tamanho == 0 && shutdown_flag) {
-        pthread_mutex_unlock(&fila->mutex);
-        return false;
-    }
-
-    *req = fila->dados[fila->inicio];
-    fila->inicio = (fila->inicio + 1) % MAX_REQUISICOES;
-    fila->tamanho--;
-    pthread_cond_signal(&fila->cond_nao_cheia);
-    pthread_mutex_unlock(&fila->mutex);
-    return true;
-}
-
-// Função para threads trabalhadoras processarem requisições
-void *trabalhador(void *arg) {
-    while (1) {
-        Requisicao req;
-        bool sucesso = desenfileirar(&fila_requisicoes, &req);
-        if (!sucesso) {
-            break; // Sinal para encerrar a thread
-        }
-
-        // Processa a requisição
-        if (req.operacao == 1) {
-            deposito(req.id_origem, req.valor, req.id);
-        } else if (req.operacao == 2) {
-            transferencia(req.id_origem, req.id_destino, req.valor, req.id);
-        } else if (req.operacao == 3) {
-            balanco(req.id);
-        }
-    }
-    return NULL;
-}
-
-// Função do servidor para adicionar uma nova requisição
-bool adicionar_requisicao(int operacao, int id_origem, int id_destino, float valor) {
-    static int id_contador = 0; // Contador global para IDs únicos
-    Requisicao req;
-
-    req.id = __sync_fetch_and_add(&id_contador, 1);
-    req.operacao = operacao;
-    req.id_origem = id_origem;
-    req.id_destino = id_destino;
-    req.valor = valor;
-
-    bool enfileirou = enfileirar(&fila_requisicoes, req);
-    if (!enfileirou) {
-        return false;
-    }
-
-    // Atualiza o contador de operações
-    pthread_mutex_lock(&mutex_contador);
-    contador_operacoes++;
-    int operacoes = contador_operacoes;
-    pthread_mutex_unlock(&mutex_contador);
-
-    if (operacoes % OPERACOES_PARA_BALANCO == 0) {  // Insere balanço geral a cada 10 operações
-        Requisicao bal_req;
-        bal_req.id = __sync_fetch_and_add(&id_contador, 1);
-        bal_req.operacao = 3;  // Operação de balanço
-        bal_req.id_origem = -1;
-        bal_req.id_destino = -1;
-        bal_req.valor = 0.0;
-
-        enfileirar(&fila_requisicoes, bal_req);
-        printf("Operação de balanço adicionada automaticamente após %d operações.\n", OPERACOES_PARA_BALANCO);
-    }
-
-    return true;
-}
-
-// Função para gerar requisições aleatórias
-void *cliente(void *arg) {
-    int id = *(int *)arg;
-    while (!shutdown_flag) {
-        int operacao = rand() % 2 + 1;  // 1 = deposito, 2 = transferencia
-        int id_origem = rand() % NUM_CONTAS;
-        int id_destino = rand() % NUM_CONTAS;
-        float valor = (float)(rand() % 1000) / 10.0;
-
-        bool adicionou = false;
-        if (operacao == 1) {
-            adicionou = adicionar_requisicao(operacao, id_origem, -1, valor);
-        } else if (operacao == 2 && id_origem != id_destino) {
-            adicionou = adicionar_requisicao(operacao, id_origem, id_destino, valor);
-        }
-
-        if (!adicionou) {
-            break; // Sinal para encerrar a thread
-        }
-
-        sleep(1);  // Espera antes de gerar nova requisição
-    }
-    return NULL;
-}
-
-// Função para encerrar todas as threads
-void encerrar_threads(pthread_t *clientes, pthread_t *trabalhadores, int num_clientes, int num_trabalhadores) {
-    // Sinaliza o shutdown
-    pthread_mutex_lock(&fila_requisicoes.mutex);
-    shutdown_flag = true;
-    pthread_cond_broadcast(&fila_requisicoes.cond_nao_vazia);
-    pthread_cond_broadcast(&fila_requisicoes.cond_nao_cheia);
-    pthread_mutex_unlock(&fila_requisicoes.mutex);
-
-    // Aguarda as threads clientes
-    for (int i = 0; i < num_clientes; i++) {
-        pthread_join(clientes[i], NULL);
-    }
-
-    // Aguarda as threads trabalhadoras
-    for (int i = 0; i < num_trabalhadores; i++) {
-        pthread_join(trabalhadores[i], NULL);
-    }
-}
-
-int main() {
-    pthread_t threads[NUM_THREADS];
-    pthread_t clientes_ids[NUM_CLIENTES];
-    int cliente_ids[NUM_CLIENTES];
-    srand(time(NULL));
-
-    // Inicializa mutexes e variáveis de condição
-    pthread_mutex_init(&mutex_contas, NULL);
-    pthread_mutex_init(&mutex_contador, NULL);
-    inicializar_fila(&fila_requisicoes);
-
-    // Inicializa contas
-    for (int i = 0; i < NUM_CONTAS; i++) {
-        contas[i].id = i;
-        contas[i].saldo = 1000.0;  // Saldo inicial de 1000
-    }
-
-    // Cria threads trabalhadoras
-    for (int i = 0; i < NUM_THREADS; i++) {
-        if (pthread_create(&threads[i], NULL, trabalhador, NULL) != 0) {
-            perror("Falha ao criar thread trabalhadora");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    // Cria threads clientes
-    for (int i = 0; i < NUM_CLIENTES; i++) {
-        cliente_ids[i] = i;
-        if (pthread_create(&clientes_ids[i], NULL, cliente, &cliente_ids[i]) != 0) {
-            perror("Falha ao criar thread cliente");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    // Executa por um período determinado ou até uma condição de encerramento
-    // Aqui, vamos executar por 30 segundos como exemplo
-    sleep(30);
-
-    // Encerra as threads
-    encerrar_threads(clientes_ids, threads, NUM_CLIENTES, NUM_THREADS);
-
-    // Libera recursos
-    pthread_mutex_destroy(&mutex_contas);
-    pthread_mutex_destroy(&mutex_contador);
-    pthread_mutex_destroy(&fila_requisicoes.mutex);
-    pthread_cond_destroy(&fila_requisicoes.cond_nao_vazia);
-    pthread_cond_destroy(&fila_requisicoes.cond_nao_cheia);
-
-    printf("Sistema encerrado com sucesso.\n");
-    return 0;
-}
+#define _GNU_SOURCE // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sched.h>
+#include <getopt.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h> // pow e log1p do gerador de carga (ligar com -lm)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "protocolo.h"
+
+#define OP_JUROS 4 // Juros sobre todas as contas: só o servidor gera, nunca vão pela rede (ver OP_* em protocolo.h)
+
+#define TAMANHO_LINHA_CACHE 64 // Alinhamento usado para evitar falso compartilhamento
+#define LOG_OPERACAO(...) do { if (cfg.log_operacoes) registrar_log(__VA_ARGS__); } while (0)
+#define HIST_SUB_BITS 5          // Sub-faixas por potência de 2 no histograma (erro relativo < 1/32)
+#define HIST_FAIXAS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+#define TAMANHO_BUFFER_LOG (64 * 1024)  // Buffer de log de cada thread
+#define TAMANHO_LINHA_LOG 256           // Maior linha de log formatada
+#define INTERVALO_ESCRITOR_LOG_US 1000  // Pausa do escritor quando não há nada a escrever
+#define TAMANHO_LOTE_SAIDA (256 * 1024) // Cada um dos dois lotes em que a escritora junta o log
+#define WAL_MAGICA 0x57414C32           // "WAL2" no início de cada registro do log de escrita antecipada
+#define CHECKPOINT_MAGICA 0x434B5054    // "CKPT" no início do arquivo de checkpoint
+#define CHECKPOINT_VERSAO 2             // Versão do formato do arquivo de checkpoint (2: saldos em centavos)
+#define SALDO_INICIAL 100000            // Saldo inicial de cada conta, em centavos
+#define LIMITE_SALDO (INT64_MAX / 4)    // Saldo que um depósito não pode ultrapassar (folga para créditos concorrentes)
+#define MAX_CONEXOES_IO 1024            // Conexões simultâneas atendidas por thread de E/S
+#define TAMANHO_ENTRADA_REDE (32 * 1024) // Bytes recebidos e ainda não decodificados, por conexão
+#define TAMANHO_SAIDA_REDE (32 * 1024)  // Respostas ainda não enviadas, por conexão
+#define LIMITE_EM_VOO_CONEXAO ((int)(TAMANHO_SAIDA_REDE / sizeof(RespostaRede))) // Pedidos pendentes por conexão
+#define LIMITE_EM_VOO_IO 16384          // Pedidos pendentes por thread de E/S
+#define PRAZO_ENTREGA_FINAL_MS 100      // Tempo para entregar as últimas respostas no encerramento
+
+// Implementação da fila (compile com -DFILA_LOCKFREE para usar a fila sem travas)
+#ifdef FILA_LOCKFREE
+#define NOME_FILA "lockfree"
+#else
+#define NOME_FILA "mutex"
+#endif
+#define GIROS_ANTES_DE_DORMIR 100 // Tentativas ativas antes de dormir no futex
+
+// Parâmetros de execução. Os valores padrão estão em cfg e podem ser trocados por
+// opções de linha de comando ou por um arquivo de configuração (--config)
+typedef struct {
+    int num_threads;            // Número de threads no pool
+    int num_contas;             // Número de contas bancárias
+    int max_requisicoes;        // Tamanho máximo da fila de requisições
+    int num_clientes;           // Número de threads clientes
+    int operacoes_para_balanco; // Insere balanço a cada N operações (0 desativa)
+    int duracao_execucao;       // Tempo de execução em segundos
+    int tamanho_lote;           // Máximo de requisições retiradas da fila de uma só vez
+    int num_travas;             // Número de travas (listras) que protegem as contas
+    long latencia_operacao_us;  // Espera do trabalhador após cada operação (0 desativa)
+    long latencia_cliente_us;   // Espera do cliente entre requisições (0 desativa)
+    long custo_operacao_ns;     // Trabalho simulado dentro da seção crítica
+    bool log_operacoes;         // Registra cada operação na saída
+    bool modo_vazao;            // Informa a vazão (ops/s) ao final
+    int carga;                  // Modelo de geração dos clientes (CARGA_*)
+    int janela;                 // Requisições pendentes por cliente na carga fechada
+    long taxa_alvo;             // Requisições por segundo (somando os clientes) na carga aberta
+    bool chegadas_poisson;      // Na carga aberta, intervalos exponenciais em vez de fixos
+    int rajada_ms;              // Na carga aberta, duração de cada rajada
+    int rajada_periodo_ms;      // Período entre o início de duas rajadas
+    int rajada_fator;           // Multiplicador da taxa durante a rajada (0 ou 1 desativa)
+    int distribuicao;           // Como os clientes sorteiam as contas (DISTRIBUICAO_*)
+    double zipf_expoente;       // Expoente s da distribuição Zipf: a k-ésima conta tem peso 1/k^s
+    int contas_quentes;         // Tamanho do conjunto quente (contas 0 a N-1)
+    int percentual_quente;      // Percentual dos sorteios que caem no conjunto quente
+    int mix[4];                 // Pesos de depósitos, transferências, balanços e folhas de pagamento dos clientes
+    int creditos_por_folha;     // Créditos de cada folha de pagamento (OP_LANCAMENTOS) gerada pelos clientes
+    const char *gravar_traco;   // Arquivo onde as requisições dos clientes são gravadas (NULL desativa)
+    const char *reproduzir_traco; // Traço reproduzido no lugar do gerador (NULL desativa)
+    uint64_t semente;           // Semente dos geradores aleatórios dos clientes
+    bool estresse;              // Confere ao final o destino de cada requisição; falha se algo não conferir
+    const char *gravar_execucao;     // Arquivo com as operações aplicadas, na ordem em série (NULL desativa)
+    const char *reproduzir_execucao; // Execução gravada reaplicada em série e conferida (NULL desativa)
+    bool benchmark;             // Emite o relatório de desempenho ao final
+    int formato;                // Formato do relatório (FORMATO_*)
+    const char *saida;          // Arquivo onde o relatório é acrescentado (NULL = stdout)
+    const char *arquivo_wal;    // Log de escrita antecipada (NULL desativa a durabilidade)
+    long wal_intervalo_us;      // Tempo máximo que um grupo de registros espera pelo fdatasync
+    long wal_limite_bytes;      // Tamanho de grupo que força o fdatasync antes do intervalo
+    const char *arquivo_checkpoint; // Arquivo mapeado com os saldos persistidos (NULL desativa)
+    long checkpoint_intervalo_ms;   // Intervalo entre checkpoints em segundo plano
+    bool roubo_trabalho;        // Uma fila por trabalhador, com roubo entre elas
+    int janela_ondas;           // Requisições por janela do executor em ondas (0 desativa)
+    bool faixas;                // Balanços e juros numa fila própria, separados das operações curtas
+    int peso_curtas;            // Com --faixas: lotes curtos atendidos por cada operação longa
+    int trabalhadores_longos;   // Com --faixas: trabalhadores dedicados às operações longas
+    bool otimista;              // Depósitos e transferências sem travas, validados por versão
+    int tentativas_otimistas;   // Conflitos de um débito antes de recorrer à trava da listra
+    int contas_por_listra;      // Contas consecutivas protegidas pela mesma trava (e do mesmo dono)
+    int dedup_entradas;         // Capacidade do cache de idempotência (0 desativa)
+    long dedup_ttl_ms;          // Tempo em que um resultado guardado ainda responde às repetições
+    int percentual_retentativas; // Requisições dos clientes reenviadas com a mesma chave
+    int admissao;               // O que fazer com a fila cheia (ADMISSAO_*)
+    long admissao_espera_us;    // Espera máxima por espaço com ADMISSAO_ESPERAR (e prioridade alta)
+    int limiar_baixa;           // Com ADMISSAO_PRIORIDADE: ocupação (%) a partir da qual a prioridade baixa é recusada
+    long drenagem_ms;           // Prazo do encerramento para concluir o que já foi aceito
+    int threads_min;            // Mínimo do pool elástico de trabalhadoras (0 = pool fixo de num_threads)
+    long pool_alvo_us;          // Espera estimada na fila acima da qual o pool cresce
+    long pool_intervalo_us;     // Intervalo entre as decisões do regulador do pool
+    bool fixar_nucleos;         // Fixa trabalhadores e clientes em CPUs distintas
+    bool numa;                  // Coloca as contas de cada dono na memória do nó da CPU dele
+    int operacoes_para_juros;   // Insere uma aplicação de juros a cada N operações (0 desativa)
+    int juros_pontos_base;      // Juros de cada aplicação, em centésimos de ponto percentual
+    const char *simd;           // Núcleos das operações em massa: auto, avx2, sse ou escalar
+    bool agregados;             // Balanços respondidos pelos agregados incrementais, sem varrer as contas
+    int baldes_agregados;       // Faixas de contas consecutivas com soma própria nos agregados
+    long limiar_saldo;          // Saldo (em centavos) abaixo do qual os agregados contam a conta
+    int conferir_agregados;     // Confere os agregados com uma varredura a cada N balanços (0: só ao final)
+    int porta_tcp;              // Porta TCP em que o servidor recebe pedidos (0 desativa)
+    const char *socket_unix;    // Caminho do socket Unix em que o servidor recebe pedidos (NULL desativa)
+    int threads_io;             // Threads de E/S com laço epoll atendendo as conexões
+    const char *arquivo_log;    // Arquivo de auditoria que recebe o log das operações (NULL = stdout)
+    bool io_uring_log;          // Envia o log pelo io_uring em vez de write
+    int metricas_porta;         // Porta local do endpoint HTTP de métricas (0 desativa)
+    long metricas_intervalo_ms; // Intervalo do despejo das métricas em stderr (0 desativa)
+} Configuracao;
+
+// Políticas do controle de admissão quando a fila está cheia
+enum {
+    ADMISSAO_BLOQUEAR,   // O produtor espera por espaço sem limite
+    ADMISSAO_ESPERAR,    // Espera até cfg.admissao_espera_us e então recusa
+    ADMISSAO_RECUSAR,    // Recusa na hora
+    ADMISSAO_PRIORIDADE, // Baixa recusada acima de cfg.limiar_baixa, normal com a fila cheia, alta espera
+};
+
+// Modelos de carga dos clientes
+enum {
+    CARGA_LIVRE,   // Gera continuamente; só bloqueia quando a fila enche
+    CARGA_FECHADA, // Cada cliente mantém no máximo cfg.janela requisições pendentes
+    CARGA_ABERTA,  // Requisições chegam num ritmo médio, independente das respostas
+};
+
+// Distribuição das contas sorteadas pelos clientes
+enum {
+    DISTRIBUICAO_UNIFORME,
+    DISTRIBUICAO_ZIPF,   // Poucas contas (as primeiras) concentram a maior parte das operações
+    DISTRIBUICAO_QUENTE, // cfg.percentual_quente dos sorteios caem nas cfg.contas_quentes primeiras
+};
+
+enum {
+    FORMATO_CSV,
+    FORMATO_JSON,
+};
+
+// Débito (valor negativo) ou crédito de uma operação com vários lançamentos
+typedef struct {
+    int32_t conta;
+    int32_t reservado; // Mantém o formato do registro no WAL
+    int64_t valor;     // Em centavos
+} Lancamento;
+
+_Static_assert(sizeof(Lancamento) == 16, "Lancamento deve ter 16 bytes");
+_Static_assert(TAMANHO_ENTRADA_REDE >= sizeof(PedidoRede) + MAX_LANCAMENTOS * sizeof(LancamentoRede),
+               "A entrada de uma conexão deve comportar o maior pedido");
+
+// Lançamentos de uma operação OP_LANCAMENTOS, aplicados atomicamente: todos ou
+// nenhum. Quem cria a requisição os normaliza (ver preparar_lancamentos): uma
+// entrada por conta, em ordem crescente de conta, somando zero, junto com as
+// listras que a operação trava. Alocados num só bloco, liberado ao concluir
+typedef struct {
+    int quantidade;
+    int num_listras;
+    int *listras;      // Ordenadas e sem repetição, logo após os itens
+    Lancamento itens[];
+} Lancamentos;
+
+// Estrutura para armazenar uma requisição
+typedef struct {
+    int id;          // ID único da operação
+    int operacao;    // 1 = deposito, 2 = transferencia, 3 = balanco, 4 = juros, 5 = lançamentos
+    int id_origem;
+    int id_destino;
+    int64_t valor;   // Em centavos
+    int cliente;         // Thread cliente de origem (-1 para balanços automáticos e pedidos da rede)
+    uint64_t criada_ns;  // Instante de criação, para medir a latência até a conclusão
+    int conexao;         // Conexão de rede que aguarda a resposta (-1 se não veio da rede)
+    uint32_t geracao_conexao; // Geração da conexão, para descartar respostas de conexões já fechadas
+    uint32_t etiqueta;   // Etiqueta do pedido, devolvida na resposta
+    int resultado;       // RESULTADO_*, preenchido pelo trabalhador
+    int prioridade;      // PRIORIDADE_*, usada pelo controle de admissão
+    int64_t saldo_final; // Saldo da origem após a operação (total no balanço)
+    uint64_t chave;      // Chave de idempotência escolhida pelo cliente (0 = sem deduplicação)
+    Lancamentos *lancamentos; // Só em OP_LANCAMENTOS; a origem é então a primeira conta debitada
+} Requisicao;
+
+#ifdef FILA_LOCKFREE
+// Posição da fila sem travas: o número de sequência indica se a célula está
+// livre para o produtor da volta atual (seq == pos) ou pronta para o consumidor (seq == pos + 1)
+// Cada célula começa numa linha de cache, para que produtores e consumidores de
+// células vizinhas não invalidem as linhas uns dos outros
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_size_t sequencia;
+    Requisicao req;
+} CelulaFila;
+
+// Fila limitada multi-produtor/multi-consumidor baseada em atômicos.
+// Cabeça, cauda e palavras de futex ficam em linhas de cache separadas
+typedef struct {
+    CelulaFila *celulas;
+    size_t capacidade;
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_size_t cabeca;   // Próxima posição a consumir
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_size_t cauda;    // Próxima posição a produzir
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_uint sinal_nao_vazia; // Incrementada a cada inserção
+    atomic_uint esperando_nao_vazia;
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_uint sinal_nao_cheia; // Incrementada a cada remoção
+    atomic_uint esperando_nao_cheia;
+} FilaRequisicoes;
+#else
+// Estrutura para a fila de requisições; alinhada para que as filas de um array
+// (--roubo) não compartilhem linhas de cache
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) Requisicao *dados;
+    int capacidade;
+    int inicio;
+    int fim;
+    int tamanho;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_nao_vazia;
+    pthread_cond_t cond_nao_cheia;
+} FilaRequisicoes;
+#endif
+
+// Variáveis globais
+Configuracao cfg = {
+    .num_threads = 4,
+    .num_contas = 10,
+    .max_requisicoes = 50,
+    .num_clientes = 2,
+    .operacoes_para_balanco = 10,
+    .duracao_execucao = 30,
+    .tamanho_lote = 16,
+    .num_travas = 16,
+    .latencia_operacao_us = 1000000,
+    .latencia_cliente_us = 1000000,
+    .custo_operacao_ns = 0,
+    .log_operacoes = true,
+    .modo_vazao = false,
+    .carga = CARGA_LIVRE,
+    .janela = 1,
+    .taxa_alvo = 1000,
+    .chegadas_poisson = true,
+    .rajada_ms = 0,
+    .rajada_periodo_ms = 0,
+    .rajada_fator = 0,
+    .distribuicao = DISTRIBUICAO_UNIFORME,
+    .zipf_expoente = 0.99,
+    .contas_quentes = 10,
+    .percentual_quente = 80,
+    .mix = {1, 1, 0, 0},
+    .creditos_por_folha = 100,
+    .gravar_traco = NULL,
+    .reproduzir_traco = NULL,
+    .semente = 0,
+    .estresse = false,
+    .gravar_execucao = NULL,
+    .reproduzir_execucao = NULL,
+    .benchmark = false,
+    .formato = FORMATO_CSV,
+    .saida = NULL,
+    .arquivo_wal = NULL,
+    .wal_intervalo_us = 2000,
+    .wal_limite_bytes = 256 * 1024,
+    .arquivo_checkpoint = NULL,
+    .checkpoint_intervalo_ms = 1000,
+    .roubo_trabalho = false,
+    .janela_ondas = 0,
+    .faixas = false,
+    .peso_curtas = 8,
+    .trabalhadores_longos = 0,
+    .otimista = false,
+    .tentativas_otimistas = 4,
+    .contas_por_listra = 1,
+    .dedup_entradas = 0,
+    .dedup_ttl_ms = 60000,
+    .percentual_retentativas = 0,
+    .admissao = 0, // ADMISSAO_BLOQUEAR
+    .admissao_espera_us = 1000,
+    .limiar_baixa = 50,
+    .drenagem_ms = 5000,
+    .threads_min = 0,
+    .pool_alvo_us = 1000,
+    .pool_intervalo_us = 1000,
+    .fixar_nucleos = false,
+    .numa = false,
+    .operacoes_para_juros = 0,
+    .juros_pontos_base = 1,
+    .simd = "auto",
+    .agregados = false,
+    .baldes_agregados = 16,
+    .limiar_saldo = 10000,
+    .conferir_agregados = 0,
+    .porta_tcp = 0,
+    .socket_unix = NULL,
+    .threads_io = 1,
+    .arquivo_log = NULL,
+    .io_uring_log = false,
+    .metricas_porta = 0,
+    .metricas_intervalo_ms = 0,
+};
+// Contas em estrutura de arrays, um array contíguo por campo, para que as operações
+// em massa percorram só os saldos. Os saldos (em centavos) são lidos sem travas
+// pelos balanços e acessados com __atomic_*, exceto nas seções exclusivas (juros).
+// saldos_anteriores[i] guarda o saldo do fim da época anterior à primeira
+// modificação feita na época indicada em epocas_contas[i]
+int *ids_contas;
+int64_t *saldos_contas;
+int64_t *saldos_anteriores;
+atomic_uint *epocas_contas; // Época da última modificação de cada conta
+atomic_uint *versoes_contas; // Com --otimista: par com a conta livre, ímpar durante um débito
+FilaRequisicoes fila_requisicoes;
+FilaRequisicoes *filas_trabalhadores; // Com --roubo: a fila i é do trabalhador i, os demais só roubam dela
+FilaRequisicoes fila_longas;          // Com --faixas: balanços e juros
+// Com --roubo ou --faixas os trabalhadores ociosos dormem no aviso da sua classe:
+// 0 para quem atende as operações curtas, 1 para os dedicados às longas
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_uint sinal; // Incrementado ao chegar trabalho com alguém ocioso
+    atomic_uint ociosos;
+} AvisoTrabalho;
+AvisoTrabalho avisos_trabalho[2];
+_Alignas(TAMANHO_LINHA_CACHE) unsigned long lotes_roubados = 0;
+// Cada trava ocupa a sua linha de cache, para que listras vizinhas não se disputem
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) pthread_mutex_t mutex;
+} TravaListra;
+
+TravaListra *travas_contas; // Conta i é protegida por travas_contas[trava_da_conta(i)]
+// Contadores escritos a cada requisição ou lote ficam em linhas próprias, longe
+// de shutdown_flag, que todos leem o tempo todo
+_Alignas(TAMANHO_LINHA_CACHE) int contador_operacoes = 0; // Conta operações para inserir balanço periodicamente
+pthread_mutex_t mutex_contador;
+_Alignas(TAMANHO_LINHA_CACHE) atomic_bool shutdown_flag = false;
+// O encerramento começa fechando a admissão: os produtores passam a ser recusados
+// enquanto os trabalhadores drenam o que já foi aceito. Esgotado o prazo da
+// drenagem, o que restar nas filas é respondido como descartado, sem ser executado
+atomic_bool admissao_fechada = false;
+atomic_bool descartar_pendentes = false;
+#define PRAZO_INDEFINIDO UINT64_MAX // Produtor espera por espaço na fila sem limite
+
+static inline bool admissao_encerrada(void) {
+    return shutdown_flag || admissao_fechada;
+}
+_Alignas(TAMANHO_LINHA_CACHE) unsigned long operacoes_concluidas = 0; // Usado para medir a vazão
+unsigned long lotes_processados = 0;    // Seções críticas executadas pelos trabalhadores
+atomic_uint_least64_t espera_fila_cheia_ns = 0; // Tempo total de produtores bloqueados com a fila cheia
+
+// Histograma log-linear (no estilo HDR) de latências em nanossegundos
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) uint64_t contagens[HIST_FAIXAS];
+    uint64_t total;
+    uint64_t maximo;
+} Histograma;
+
+// Estado de cada cliente compartilhado com os trabalhadores
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_uint em_voo; // Requisições enfileiradas ainda não concluídas
+} EstadoCliente;
+
+// Gerador xorshift64* de cada thread: rápido e reprodutível a partir da semente
+typedef struct {
+    uint64_t estado;
+} Gerador;
+
+// Contas que uma thread alterou pela primeira vez numa época (só com --agregados)
+typedef struct {
+    int *ids;
+    int quantidade;
+    int capacidade;
+} ContasTocadas;
+
+// Época anunciada por uma thread trabalhadora enquanto altera contas (0 = fora de seção),
+// junto com o total depositado por ela e as contas que tocou em cada época
+// (indexados pela paridade)
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_uint epoca;
+    atomic_int_least64_t depositado[2];
+    ContasTocadas tocadas[2];
+} SlotEpoca;
+
+EstadoCliente *estados_clientes;
+SlotEpoca *slots_epoca;  // Um por thread trabalhadora
+atomic_uint epoca_global = 1;  // Época em que as novas escritas entram
+atomic_uint epoca_drenada = 0; // Maior época cujos escritores já terminaram
+pthread_mutex_t mutex_snapshot; // Serializa os balanços (uma troca de época por vez)
+int64_t *saldos_snapshot;       // Visão consistente lida pelo último balanço
+int64_t total_depositado = 0;   // Depósitos e juros de todas as épocas já drenadas
+Histograma *histogramas; // Um por thread trabalhadora, somados ao final
+Histograma *histogramas_longas; // Só balanços e juros, para separar a cauda das operações curtas
+
+// Retorna o índice da trava (listra) que protege a conta. Blocos de
+// cfg.contas_por_listra contas consecutivas ficam na mesma listra: com 8 (ou 16)
+// uma linha de cache dos saldos (ou das épocas) nunca é escrita por duas listras
+static inline int trava_da_conta(int id) {
+    return id / cfg.contas_por_listra % cfg.num_travas;
+}
+
+// Trabalhador dono da conta: com --roubo recebe as requisições dela, e com --numa
+// as contas dele ficam na memória do seu nó
+static inline int dono_da_conta(int id) {
+    return trava_da_conta(id) % cfg.num_threads;
+}
+
+// Aloca memória alinhada à linha de cache, abortando em caso de falha
+void *alocar_alinhado(size_t bytes, const char *descricao) {
+    size_t arredondado = (bytes + TAMANHO_LINHA_CACHE - 1) / TAMANHO_LINHA_CACHE * TAMANHO_LINHA_CACHE;
+    void *memoria = aligned_alloc(TAMANHO_LINHA_CACHE, arredondado > 0 ? arredondado : TAMANHO_LINHA_CACHE);
+    if (memoria == NULL) {
+        fprintf(stderr, "Falha ao alocar %s (%zu bytes)\n", descricao, bytes);
+        exit(EXIT_FAILURE);
+    }
+    return memoria;
+}
+
+// Aloca páginas inteiras sem tocá-las, para que o primeiro toque decida o nó NUMA
+void *alocar_paginas(size_t bytes, const char *descricao) {
+    size_t pagina = (size_t)sysconf(_SC_PAGESIZE);
+    size_t arredondado = (bytes + pagina - 1) / pagina * pagina;
+    void *memoria = aligned_alloc(pagina, arredondado > 0 ? arredondado : pagina);
+    if (memoria == NULL) {
+        fprintf(stderr, "Falha ao alocar %s (%zu bytes)\n", descricao, bytes);
+        exit(EXIT_FAILURE);
+    }
+    return memoria;
+}
+
+// CPUs em que o processo pode rodar, em ordem. Com --fixar-nucleos o trabalhador i
+// fica na i-ésima e o cliente j na (num_threads + j)-ésima, dando a volta se faltarem
+int *cpus_permitidas;
+int num_cpus_permitidas = 0;
+
+void carregar_cpus_permitidas(void) {
+    cpu_set_t conjunto;
+    if (sched_getaffinity(0, sizeof(conjunto), &conjunto) != 0) {
+        perror("Falha ao consultar CPUs permitidas");
+        exit(EXIT_FAILURE);
+    }
+    num_cpus_permitidas = CPU_COUNT(&conjunto);
+    cpus_permitidas = malloc(num_cpus_permitidas * sizeof(int));
+    if (cpus_permitidas == NULL) {
+        perror("Falha ao alocar lista de CPUs");
+        exit(EXIT_FAILURE);
+    }
+    for (int cpu = 0, n = 0; n < num_cpus_permitidas; cpu++) {
+        if (CPU_ISSET(cpu, &conjunto)) {
+            cpus_permitidas[n++] = cpu;
+        }
+    }
+}
+
+static inline int cpu_da_posicao(int posicao) {
+    return cpus_permitidas[posicao % num_cpus_permitidas];
+}
+
+// Fixa a thread atual numa CPU; se falhar, a thread só continua livre
+void fixar_na_cpu(int cpu) {
+    cpu_set_t conjunto;
+    CPU_ZERO(&conjunto);
+    CPU_SET(cpu, &conjunto);
+    int erro = pthread_setaffinity_np(pthread_self(), sizeof(conjunto), &conjunto);
+    if (erro != 0) {
+        fprintf(stderr, "Falha ao fixar thread na CPU %d: %s\n", cpu, strerror(erro));
+    }
+}
+
+// Escreve os valores iniciais das contas do trabalhador indicado (-1 = todas)
+static void preencher_contas(int trabalhador) {
+    for (int inicio = 0; inicio < cfg.num_contas; inicio += cfg.contas_por_listra) {
+        if (trabalhador >= 0 && dono_da_conta(inicio) != trabalhador) {
+            continue;
+        }
+        int fim = inicio + cfg.contas_por_listra < cfg.num_contas ? inicio + cfg.contas_por_listra : cfg.num_contas;
+        for (int i = inicio; i < fim; i++) {
+            ids_contas[i] = i;
+            saldos_contas[i] = SALDO_INICIAL;
+            saldos_anteriores[i] = SALDO_INICIAL;
+            atomic_init(&epocas_contas[i], 0);
+            if (versoes_contas != NULL) {
+                atomic_init(&versoes_contas[i], 0);
+            }
+        }
+    }
+}
+
+// Thread temporária fixada na CPU do trabalhador, que toca primeiro as contas dele
+static void *posicionar_contas(void *arg) {
+    int trabalhador = *(int *)arg;
+    fixar_na_cpu(cpu_da_posicao(trabalhador));
+    preencher_contas(trabalhador);
+    return NULL;
+}
+
+// Informa em que nós ficaram as páginas dos saldos (move_pages sem destino só consulta)
+static void relatar_nos_numa(void) {
+    size_t pagina = (size_t)sysconf(_SC_PAGESIZE);
+    unsigned long num_paginas = ((size_t)cfg.num_contas * sizeof(int64_t) + pagina - 1) / pagina;
+    void **paginas = malloc(num_paginas * sizeof(void *));
+    int *nos = malloc(num_paginas * sizeof(int));
+    if (paginas == NULL || nos == NULL) {
+        perror("Falha ao alocar consulta NUMA");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned long i = 0; i < num_paginas; i++) {
+        paginas[i] = (char *)saldos_contas + i * pagina;
+    }
+    if (syscall(SYS_move_pages, 0, num_paginas, paginas, NULL, nos, 0) != 0) {
+        perror("Falha ao consultar nós das páginas");
+    } else {
+        int por_no[64] = {0};
+        for (unsigned long i = 0; i < num_paginas; i++) {
+            if (nos[i] >= 0 && nos[i] < 64) {
+                por_no[nos[i]]++;
+            }
+        }
+        printf("NUMA: páginas dos saldos por nó:");
+        for (int no = 0; no < 64; no++) {
+            if (por_no[no] > 0) {
+                printf(" nó %d = %d", no, por_no[no]);
+            }
+        }
+        printf("\n");
+    }
+    free(paginas);
+    free(nos);
+}
+
+// Aloca e preenche as contas. Com --numa cada bloco de contas é escrito pela
+// primeira vez por uma thread na CPU do seu dono, e a política de primeiro toque
+// do kernel o coloca na memória do nó dessa CPU. ler_configuracao arredonda os
+// blocos para páginas inteiras dos saldos (512 contas com páginas de 4 KiB)
+void inicializar_contas(void) {
+    ids_contas = alocar_paginas(cfg.num_contas * sizeof(int), "ids das contas");
+    saldos_contas = alocar_paginas(cfg.num_contas * sizeof(int64_t), "saldos das contas");
+    saldos_anteriores = alocar_paginas(cfg.num_contas * sizeof(int64_t), "saldos anteriores");
+    epocas_contas = alocar_paginas(cfg.num_contas * sizeof(atomic_uint), "épocas das contas");
+    if (cfg.otimista) {
+        versoes_contas = alocar_paginas(cfg.num_contas * sizeof(atomic_uint), "versões das contas");
+    }
+    if (!cfg.numa) {
+        preencher_contas(-1);
+        return;
+    }
+    pthread_t *threads = malloc(cfg.num_threads * sizeof(pthread_t));
+    int *indices = malloc(cfg.num_threads * sizeof(int));
+    if (threads == NULL || indices == NULL) {
+        perror("Falha ao alocar threads de posicionamento");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < cfg.num_threads; t++) {
+        indices[t] = t;
+        if (pthread_create(&threads[t], NULL, posicionar_contas, &indices[t]) != 0) {
+            perror("Falha ao criar thread de posicionamento");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int t = 0; t < cfg.num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    free(indices);
+    relatar_nos_numa();
+}
+
+// Trava as listras indicadas (já ordenadas e sem repetição) em ordem crescente,
+// evitando deadlock entre lotes que tocam as mesmas contas em ordens diferentes
+void travar_listras(const int *listras, int quantidade) {
+    for (int i = 0; i < quantidade; i++) {
+        pthread_mutex_lock(&travas_contas[listras[i]].mutex);
+    }
+}
+
+void destravar_listras(const int *listras, int quantidade) {
+    for (int i = quantidade - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&travas_contas[listras[i]].mutex);
+    }
+}
+
+// Simula o custo de processamento de uma operação (desativado quando 0)
+static inline void simular_custo(void) {
+    if (cfg.custo_operacao_ns <= 0) {
+        return;
+    }
+    struct timespec inicio, agora;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &agora);
+    } while ((agora.tv_sec - inicio.tv_sec) * 1000000000L + (agora.tv_nsec - inicio.tv_nsec) < cfg.custo_operacao_ns);
+}
+
+// Dorme pelo tempo indicado em microssegundos (nada faz se for 0)
+static void simular_latencia(long microssegundos) {
+    if (microssegundos <= 0) {
+        return;
+    }
+    struct timespec espera = { microssegundos / 1000000, (microssegundos % 1000000) * 1000 };
+    nanosleep(&espera, NULL);
+}
+
+static inline uint64_t agora_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+// Dorme até o instante absoluto indicado (relógio monotônico)
+static void dormir_ate(uint64_t instante_ns) {
+    struct timespec alvo = { (time_t)(instante_ns / 1000000000ULL), (long)(instante_ns % 1000000000ULL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &alvo, NULL) == EINTR) {
+    }
+}
+
+static inline void pausa_cpu(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void futex_esperar(atomic_uint *palavra, unsigned int valor) {
+    syscall(SYS_futex, palavra, FUTEX_WAIT_PRIVATE, valor, NULL, NULL, 0);
+}
+
+static void futex_acordar(atomic_uint *palavra, int quantidade) {
+    syscall(SYS_futex, palavra, FUTEX_WAKE_PRIVATE, quantidade, NULL, NULL, 0);
+}
+
+// Como futex_esperar, mas desiste no instante prazo_ns (relógio monotônico)
+static void futex_esperar_ate(atomic_uint *palavra, unsigned int valor, uint64_t prazo_ns) {
+    uint64_t agora = agora_ns();
+    if (agora >= prazo_ns) {
+        return;
+    }
+    uint64_t restante = prazo_ns - agora;
+    struct timespec espera = {.tv_sec = (time_t)(restante / 1000000000ULL), .tv_nsec = (long)(restante % 1000000000ULL)};
+    syscall(SYS_futex, palavra, FUTEX_WAIT_PRIVATE, valor, &espera, NULL, 0);
+}
+
+atomic_uint sinal_encerramento = 0; // Incrementada (com futex_acordar) a cada passo do encerramento
+
+static void avisar_passo_encerramento(void) {
+    atomic_fetch_add(&sinal_encerramento, 1);
+    futex_acordar(&sinal_encerramento, INT_MAX);
+}
+
+// Como simular_latencia, mas termina assim que *interromper ligar: os clientes
+// param de dormir quando a admissão fecha e os trabalhadores, quando a drenagem
+// esgota o prazo, para que o encerramento não espere por uma latência artificial
+static void simular_latencia_ate(long microssegundos, atomic_bool *interromper) {
+    if (microssegundos <= 0) {
+        return;
+    }
+    uint64_t fim = agora_ns() + (uint64_t)microssegundos * 1000ULL;
+    for (;;) {
+        unsigned int sinal = atomic_load(&sinal_encerramento); // Antes de olhar a flag, para não perder o aviso
+        if (atomic_load(interromper) || agora_ns() >= fim) {
+            return;
+        }
+        futex_esperar_ate(&sinal_encerramento, sinal, fim);
+    }
+}
+
+static void semear(Gerador *gerador, uint64_t semente) {
+    // Espalha a semente com splitmix64 para que sementes vizinhas gerem sequências distintas
+    uint64_t z = semente + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    gerador->estado = (z ^ (z >> 31)) | 1;
+}
+
+static inline uint64_t proximo_aleatorio(Gerador *gerador) {
+    uint64_t x = gerador->estado;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    gerador->estado = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Inteiro uniforme em [0, limite)
+static inline int aleatorio_ate(Gerador *gerador, int limite) {
+    return (int)((proximo_aleatorio(gerador) >> 32) * (uint64_t)limite >> 32);
+}
+
+static inline int indice_histograma(uint64_t valor) {
+    if (valor < (1ULL << HIST_SUB_BITS)) {
+        return (int)valor;
+    }
+    int expoente = 63 - __builtin_clzll(valor);
+    int deslocamento = expoente - HIST_SUB_BITS;
+    return ((deslocamento + 1) << HIST_SUB_BITS) + (int)((valor >> deslocamento) & ((1ULL << HIST_SUB_BITS) - 1));
+}
+
+// Maior valor que cai na faixa de índice indicado
+static uint64_t limite_faixa_histograma(int indice) {
+    if (indice < (1 << HIST_SUB_BITS)) {
+        return (uint64_t)indice;
+    }
+    int deslocamento = (indice >> HIST_SUB_BITS) - 1;
+    uint64_t base = (uint64_t)((1 << HIST_SUB_BITS) + (indice & ((1 << HIST_SUB_BITS) - 1)));
+    return ((base + 1) << deslocamento) - 1;
+}
+
+static inline void registrar_no_histograma(Histograma *hist, uint64_t valor) {
+    hist->contagens[indice_histograma(valor)]++;
+    hist->total++;
+    if (valor > hist->maximo) {
+        hist->maximo = valor;
+    }
+}
+
+static void somar_histograma(Histograma *destino, const Histograma *origem) {
+    for (int i = 0; i < HIST_FAIXAS; i++) {
+        destino->contagens[i] += origem->contagens[i];
+    }
+    destino->total += origem->total;
+    if (origem->maximo > destino->maximo) {
+        destino->maximo = origem->maximo;
+    }
+}
+
+// Remove de destino as amostras de origem (um subconjunto dele); o máximo fica
+// como limite superior
+static void descontar_histograma(Histograma *destino, const Histograma *origem) {
+    for (int i = 0; i < HIST_FAIXAS; i++) {
+        destino->contagens[i] -= origem->contagens[i];
+    }
+    destino->total -= origem->total;
+}
+
+// Histograma zerado para somas temporárias (calloc não garante o alinhamento da linha)
+static Histograma *criar_histograma(void) {
+    Histograma *hist = alocar_alinhado(sizeof(Histograma), "histograma");
+    memset(hist, 0, sizeof(Histograma));
+    return hist;
+}
+
+// Valor no percentil indicado (0 a 100)
+static uint64_t percentil_histograma(const Histograma *hist, double percentil) {
+    if (hist->total == 0) {
+        return 0;
+    }
+    uint64_t alvo = (uint64_t)(percentil / 100.0 * (double)hist->total + 0.5);
+    if (alvo == 0) {
+        alvo = 1;
+    }
+    uint64_t acumulado = 0;
+    for (int i = 0; i < HIST_FAIXAS; i++) {
+        acumulado += hist->contagens[i];
+        if (acumulado >= alvo) {
+            uint64_t limite = limite_faixa_histograma(i);
+            return limite < hist->maximo ? limite : hist->maximo;
+        }
+    }
+    return hist->maximo;
+}
+
+#define NUM_TIPOS_OPERACAO 6 // Índices de Requisicao.operacao (o 0 não é usado)
+
+// Métricas do caminho quente (--metricas-porta / --metricas-intervalo-ms). Cada
+// thread tem os seus contadores e histogramas, escritos só por ela com
+// operações relaxadas (sem instruções com lock) e registrados numa lista sem
+// travas; quem publica as métricas percorre a lista e soma tudo por leitura
+enum {
+    METRICA_TEMPO_NA_FILA,     // Da criação da requisição até sair da fila
+    METRICA_PROFUNDIDADE_FILA, // Requisições na fila a cada retirada (não é tempo)
+    METRICA_ESPERA_FILA_CHEIA, // Produtor esperando espaço (cond_nao_cheia / futex)
+    METRICA_ESPERA_FILA_VAZIA, // Trabalhador esperando requisições (cond_nao_vazia / futex)
+    METRICA_ESPERA_TRAVAS,     // Aquisição das listras de um lote
+    METRICA_POSSE_TRAVAS,      // Listras de um lote mantidas travadas
+    METRICA_SERVICO,           // Tempo de serviço; somado ao tipo da operação (1 a 5)
+    NUM_METRICAS = METRICA_SERVICO + NUM_TIPOS_OPERACAO,
+};
+
+#define AMOSTRAGEM_METRICAS 8 // Tempo na fila e de serviço de depósitos e transferências: 1 requisição a cada 8 (potência de 2)
+
+typedef struct MetricasThread {
+    Histograma histogramas[NUM_METRICAS];
+    uint64_t operacoes[NUM_TIPOS_OPERACAO]; // Concluídas por tipo (índice = operacao)
+    uint64_t enfileiradas;     // Requisições aceitas na fila por esta thread
+    struct MetricasThread *proximo;
+} MetricasThread;
+
+static const char *nomes_metricas[NUM_METRICAS] = {
+    "tempo_na_fila_ns", "profundidade_fila", "espera_fila_cheia_ns", "espera_fila_vazia_ns",
+    "espera_travas_ns", "posse_travas_ns", NULL, "servico_deposito_ns", "servico_transferencia_ns",
+    "servico_balanco_ns", "servico_juros_ns", "servico_lancamentos_ns",
+};
+
+bool metricas_ativas = false;
+static _Thread_local MetricasThread *metricas_local = NULL;
+static _Atomic(MetricasThread *) lista_metricas = NULL;
+
+static MetricasThread *obter_metricas(void) {
+    if (metricas_local == NULL) {
+        MetricasThread *metricas = alocar_alinhado(sizeof(MetricasThread), "métricas da thread");
+        memset(metricas, 0, sizeof(MetricasThread));
+        metricas->proximo = atomic_load(&lista_metricas);
+        while (!atomic_compare_exchange_weak(&lista_metricas, &metricas->proximo, metricas)) {
+        }
+        metricas_local = metricas;
+    }
+    return metricas_local;
+}
+
+// Incremento de quem é o único escritor: load e store relaxados, sem lock no barramento
+static inline void somar_relaxado(uint64_t *contador, uint64_t valor) {
+    __atomic_store_n(contador, __atomic_load_n(contador, __ATOMIC_RELAXED) + valor, __ATOMIC_RELAXED);
+}
+
+static inline void registrar_metrica(int metrica, uint64_t valor) {
+    if (!metricas_ativas) {
+        return;
+    }
+    Histograma *hist = &obter_metricas()->histogramas[metrica];
+    somar_relaxado(&hist->contagens[indice_histograma(valor)], 1);
+    somar_relaxado(&hist->total, 1);
+    if (valor > __atomic_load_n(&hist->maximo, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&hist->maximo, valor, __ATOMIC_RELAXED);
+    }
+}
+
+// Conta as operações concluídas de um lote por tipo, com um incremento por tipo
+static inline void contar_operacoes(const Requisicao *lote, int quantidade) {
+    if (!metricas_ativas) {
+        return;
+    }
+    uint64_t por_tipo[NUM_TIPOS_OPERACAO] = {0};
+    for (int i = 0; i < quantidade; i++) {
+        por_tipo[lote[i].operacao]++;
+    }
+    MetricasThread *metricas = obter_metricas();
+    for (int op = 1; op < NUM_TIPOS_OPERACAO; op++) {
+        if (por_tipo[op] > 0) {
+            somar_relaxado(&metricas->operacoes[op], por_tipo[op]);
+        }
+    }
+}
+
+static inline void contar_enfileirada(void) {
+    if (metricas_ativas) {
+        somar_relaxado(&obter_metricas()->enfileiradas, 1);
+    }
+}
+
+// Decide pelo id se a requisição entra na amostra, sem estado por thread
+static inline bool amostrar(const Requisicao *req) {
+    return metricas_ativas && (req->id & (AMOSTRAGEM_METRICAS - 1)) == 0;
+}
+
+// Soma as métricas de todas as threads em destino (leituras relaxadas, sem travar ninguém)
+static void agregar_metricas(MetricasThread *destino, int *threads) {
+    memset(destino, 0, sizeof(MetricasThread));
+    *threads = 0;
+    for (MetricasThread *m = atomic_load(&lista_metricas); m != NULL; m = m->proximo) {
+        for (int k = 0; k < NUM_METRICAS; k++) {
+            Histograma *hist = &destino->histogramas[k];
+            for (int i = 0; i < HIST_FAIXAS; i++) {
+                hist->contagens[i] += __atomic_load_n(&m->histogramas[k].contagens[i], __ATOMIC_RELAXED);
+            }
+            hist->total += __atomic_load_n(&m->histogramas[k].total, __ATOMIC_RELAXED);
+            uint64_t maximo = __atomic_load_n(&m->histogramas[k].maximo, __ATOMIC_RELAXED);
+            hist->maximo = maximo > hist->maximo ? maximo : hist->maximo;
+        }
+        for (int op = 1; op < NUM_TIPOS_OPERACAO; op++) {
+            destino->operacoes[op] += __atomic_load_n(&m->operacoes[op], __ATOMIC_RELAXED);
+        }
+        destino->enfileiradas += __atomic_load_n(&m->enfileiradas, __ATOMIC_RELAXED);
+        (*threads)++;
+    }
+}
+
+void liberar_metricas(void) {
+    MetricasThread *metricas = atomic_exchange(&lista_metricas, NULL);
+    while (metricas != NULL) {
+        MetricasThread *proximo = metricas->proximo;
+        free(metricas);
+        metricas = proximo;
+    }
+}
+
+// Buffer circular de log de uma thread: só a thread dona escreve e só a thread
+// que o descarrega lê, então os contadores dispensam travas. Serve tanto às
+// mensagens de texto quanto aos registros do WAL
+typedef struct BufferLog {
+    char dados[TAMANHO_BUFFER_LOG];
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_size_t produzido; // Total de bytes escritos pela thread
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_size_t consumido; // Total de bytes já enviados à saída
+    struct BufferLog *proximo;
+} BufferLog;
+
+static _Thread_local BufferLog *log_local = NULL;
+static _Atomic(BufferLog *) buffers_log = NULL; // Lista de buffers de texto registrados
+static _Atomic(BufferLog *) buffers_wal = NULL; // Lista de buffers de registros do WAL
+static atomic_bool log_encerrar = false;
+
+// Cria um buffer e o registra na lista percorrida pela thread que o descarrega
+static BufferLog *criar_buffer_log(_Atomic(BufferLog *) *lista) {
+    BufferLog *buffer = alocar_alinhado(sizeof(BufferLog), "buffer de log");
+    atomic_init(&buffer->produzido, 0);
+    atomic_init(&buffer->consumido, 0);
+    buffer->proximo = atomic_load(lista);
+    while (!atomic_compare_exchange_weak(lista, &buffer->proximo, buffer)) {
+    }
+    return buffer;
+}
+
+static BufferLog *obter_buffer_log(void) {
+    if (log_local == NULL) {
+        log_local = criar_buffer_log(&buffers_log);
+    }
+    return log_local;
+}
+
+// Copia n bytes para o buffer de uma só vez (quem lê nunca vê um pedaço).
+// Se o buffer estiver cheio, cede a CPU até a thread leitora liberar espaço
+static void anexar_buffer(BufferLog *buffer, const void *dados, size_t n) {
+    size_t produzido = atomic_load_explicit(&buffer->produzido, memory_order_relaxed);
+    while (TAMANHO_BUFFER_LOG - (produzido - atomic_load_explicit(&buffer->consumido, memory_order_acquire)) < n) {
+        sched_yield();
+    }
+    size_t pos = produzido % TAMANHO_BUFFER_LOG;
+    size_t ate_o_fim = TAMANHO_BUFFER_LOG - pos;
+    if (n <= ate_o_fim) {
+        memcpy(&buffer->dados[pos], dados, n);
+    } else {
+        memcpy(&buffer->dados[pos], dados, ate_o_fim);
+        memcpy(buffer->dados, (const char *)dados + ate_o_fim, n - ate_o_fim);
+    }
+    atomic_store_explicit(&buffer->produzido, produzido + n, memory_order_release);
+}
+
+// Move para destino (com pelo menos TAMANHO_BUFFER_LOG bytes livres) tudo o que está pendente
+static size_t retirar_buffer(BufferLog *buffer, char *destino) {
+    size_t consumido = atomic_load_explicit(&buffer->consumido, memory_order_relaxed);
+    size_t produzido = atomic_load_explicit(&buffer->produzido, memory_order_acquire);
+    size_t pendente = produzido - consumido;
+    if (pendente == 0) {
+        return 0;
+    }
+    size_t pos = consumido % TAMANHO_BUFFER_LOG;
+    size_t ate_o_fim = TAMANHO_BUFFER_LOG - pos;
+    if (pendente <= ate_o_fim) {
+        memcpy(destino, &buffer->dados[pos], pendente);
+    } else {
+        memcpy(destino, &buffer->dados[pos], ate_o_fim);
+        memcpy(destino + ate_o_fim, buffer->dados, pendente - ate_o_fim);
+    }
+    atomic_store_explicit(&buffer->consumido, produzido, memory_order_release);
+    return pendente;
+}
+
+// Formata uma linha e a copia para o buffer da thread; nunca toca em stdio.
+// Se o buffer estiver cheio, cede a CPU até o escritor liberar espaço
+void registrar_log(const char *formato, ...) {
+    char linha[TAMANHO_LINHA_LOG];
+    va_list args;
+    va_start(args, formato);
+    int tamanho = vsnprintf(linha, sizeof(linha), formato, args);
+    va_end(args);
+    if (tamanho <= 0) {
+        return;
+    }
+    size_t n = (size_t)tamanho < sizeof(linha) ? (size_t)tamanho : sizeof(linha) - 1;
+    anexar_buffer(obter_buffer_log(), linha, n);
+}
+
+// Saída do log de operações: a thread escritora junta o que os buffers das
+// threads acumularam em um lote e o envia com uma única chamada. Com --io-uring o
+// lote vai para um de dois buffers registrados no anel e a escrita é submetida
+// sem esperar, enquanto o outro buffer acumula o lote seguinte; só uma escrita
+// fica pendente por vez, o que preserva a ordem e permite completar escritas curtas.
+// Sem io_uring no kernel, cai para write comum
+typedef struct {
+    int fd;                  // stdout ou --log-arquivo
+    bool uring;              // Envia pelo io_uring (false = write)
+    char *lotes[2];          // Registrados no anel quando uring
+    size_t usado[2];
+    int atual;               // Lote sendo preenchido; o outro pode estar em voo
+    bool em_voo;
+    size_t confirmado;       // Bytes do lote em voo já escritos
+    int anel_fd;
+    unsigned *sq_cauda;
+    unsigned *sq_mascara;
+    unsigned *sq_indices;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_cabeca;
+    unsigned *cq_cauda;
+    unsigned *cq_mascara;
+    struct io_uring_cqe *cqes;
+    void *mapa_sq;
+    void *mapa_cq;
+    size_t tamanho_mapa_sq;
+    size_t tamanho_mapa_cq;
+    unsigned long syscalls;  // Chamadas feitas pela escritora para enviar o log
+    unsigned long lotes_enviados;
+    unsigned long long bytes;
+} SaidaLog;
+
+static SaidaLog saida_log = {.fd = STDOUT_FILENO, .anel_fd = -1};
+
+static int io_uring_setup(unsigned entradas, struct io_uring_params *parametros) {
+    return (int)syscall(__NR_io_uring_setup, entradas, parametros);
+}
+
+static int io_uring_enter(int fd, unsigned submeter, unsigned minimo, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submeter, minimo, flags, NULL, 0);
+}
+
+// Cria o anel e registra os dois lotes; retorna false (sem efeitos) se o kernel
+// não oferece io_uring ou recusa o registro
+static bool iniciar_uring(void) {
+    struct io_uring_params parametros;
+    memset(&parametros, 0, sizeof(parametros));
+    int fd = io_uring_setup(4, &parametros);
+    if (fd < 0) {
+        return false;
+    }
+    size_t tamanho_sq = parametros.sq_off.array + parametros.sq_entries * sizeof(unsigned);
+    size_t tamanho_cq = parametros.cq_off.cqes + parametros.cq_entries * sizeof(struct io_uring_cqe);
+    bool mapa_unico = parametros.features & IORING_FEAT_SINGLE_MMAP;
+    if (mapa_unico) {
+        tamanho_sq = tamanho_cq = tamanho_sq > tamanho_cq ? tamanho_sq : tamanho_cq;
+    }
+    void *mapa_sq = mmap(NULL, tamanho_sq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    void *mapa_cq = mapa_unico ? mapa_sq
+                               : mmap(NULL, tamanho_cq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                      IORING_OFF_CQ_RING);
+    void *sqes = mmap(NULL, parametros.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    struct iovec vetores[2] = {
+        {.iov_base = saida_log.lotes[0], .iov_len = TAMANHO_LOTE_SAIDA},
+        {.iov_base = saida_log.lotes[1], .iov_len = TAMANHO_LOTE_SAIDA},
+    };
+    if (mapa_sq == MAP_FAILED || mapa_cq == MAP_FAILED || sqes == MAP_FAILED ||
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, vetores, 2) < 0) {
+        int erro = errno;
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, parametros.sq_entries * sizeof(struct io_uring_sqe));
+        }
+        if (!mapa_unico && mapa_cq != MAP_FAILED) {
+            munmap(mapa_cq, tamanho_cq);
+        }
+        if (mapa_sq != MAP_FAILED) {
+            munmap(mapa_sq, tamanho_sq);
+        }
+        close(fd);
+        errno = erro;
+        return false;
+    }
+    char *sq = mapa_sq, *cq = mapa_cq;
+    saida_log.anel_fd = fd;
+    saida_log.sq_cauda = (unsigned *)(sq + parametros.sq_off.tail);
+    saida_log.sq_mascara = (unsigned *)(sq + parametros.sq_off.ring_mask);
+    saida_log.sq_indices = (unsigned *)(sq + parametros.sq_off.array);
+    saida_log.sqes = sqes;
+    saida_log.cq_cabeca = (unsigned *)(cq + parametros.cq_off.head);
+    saida_log.cq_cauda = (unsigned *)(cq + parametros.cq_off.tail);
+    saida_log.cq_mascara = (unsigned *)(cq + parametros.cq_off.ring_mask);
+    saida_log.cqes = (struct io_uring_cqe *)(cq + parametros.cq_off.cqes);
+    saida_log.mapa_sq = mapa_sq;
+    saida_log.mapa_cq = mapa_cq;
+    saida_log.tamanho_mapa_sq = tamanho_sq;
+    saida_log.tamanho_mapa_cq = mapa_unico ? 0 : tamanho_cq;
+    return true;
+}
+
+// Prepara a saída do log (arquivo, lotes e, se pedido, o anel). Chamada antes de
+// criar a thread escritora
+void iniciar_saida_log(void) {
+    if (cfg.arquivo_log != NULL) {
+        saida_log.fd = open(cfg.arquivo_log, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (saida_log.fd < 0) {
+            perror("Falha ao abrir arquivo de log");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        saida_log.lotes[i] = alocar_alinhado(TAMANHO_LOTE_SAIDA, "lote da saída do log");
+        saida_log.usado[i] = 0;
+    }
+    if (cfg.io_uring_log) {
+        saida_log.uring = iniciar_uring();
+        if (!saida_log.uring) {
+            fprintf(stderr, "io_uring indisponível (%s); log enviado com write\n", strerror(errno));
+        }
+    }
+}
+
+// Submete o restante do lote em voo a partir de saida_log.confirmado. Deslocamento
+// -1 usa a posição atual do arquivo, como write (e funciona com pipes e O_APPEND)
+static void submeter_lote(void) {
+    int indice = 1 - saida_log.atual;
+    unsigned cauda = *saida_log.sq_cauda;
+    unsigned posicao = cauda & *saida_log.sq_mascara;
+    struct io_uring_sqe *sqe = &saida_log.sqes[posicao];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = saida_log.fd;
+    sqe->addr = (uint64_t)(uintptr_t)(saida_log.lotes[indice] + saida_log.confirmado);
+    sqe->len = (uint32_t)(saida_log.usado[indice] - saida_log.confirmado);
+    sqe->off = (uint64_t)-1;
+    sqe->buf_index = (uint16_t)indice;
+    saida_log.sq_indices[posicao] = posicao;
+    __atomic_store_n(saida_log.sq_cauda, cauda + 1, __ATOMIC_RELEASE);
+    int resultado;
+    do {
+        saida_log.syscalls++;
+        resultado = io_uring_enter(saida_log.anel_fd, 1, 0, 0);
+    } while (resultado < 0 && errno == EINTR);
+    if (resultado < 0) {
+        perror("Falha ao submeter escrita do log");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Trata a conclusão da escrita em voo, se houver (esperando por ela quando pedido).
+// Uma escrita curta é resubmetida antes de qualquer outra, para não trocar a ordem
+static void recolher_lote(bool esperar) {
+    while (saida_log.em_voo) {
+        unsigned cabeca = *saida_log.cq_cabeca;
+        if (cabeca == __atomic_load_n(saida_log.cq_cauda, __ATOMIC_ACQUIRE)) {
+            if (!esperar) {
+                return;
+            }
+            saida_log.syscalls++;
+            if (io_uring_enter(saida_log.anel_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                perror("Falha ao esperar escrita do log");
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        int resultado = saida_log.cqes[cabeca & *saida_log.cq_mascara].res;
+        __atomic_store_n(saida_log.cq_cabeca, cabeca + 1, __ATOMIC_RELEASE);
+        int indice = 1 - saida_log.atual;
+        if (resultado < 0 && resultado != -EINTR && resultado != -EAGAIN) {
+            fprintf(stderr, "Falha ao escrever o log: %s\n", strerror(-resultado));
+            saida_log.confirmado = saida_log.usado[indice]; // Descarta o lote, como fazia o stdio
+        } else if (resultado > 0) {
+            saida_log.confirmado += (size_t)resultado;
+        }
+        if (saida_log.confirmado < saida_log.usado[indice]) {
+            submeter_lote();
+            continue;
+        }
+        saida_log.em_voo = false;
+        saida_log.usado[indice] = 0;
+        saida_log.lotes_enviados++;
+    }
+}
+
+// Envia o lote atual: com write, na hora; com io_uring, troca de lote e submete
+// (se o anterior ainda estiver em voo, só espera por ele quando o atual encheu)
+static void enviar_lote(bool forcar) {
+    int atual = saida_log.atual;
+    size_t tamanho = saida_log.usado[atual];
+    if (tamanho == 0) {
+        return;
+    }
+    if (!saida_log.uring) {
+        for (size_t escrito = 0; escrito < tamanho;) {
+            saida_log.syscalls++;
+            ssize_t n = write(saida_log.fd, saida_log.lotes[atual] + escrito, tamanho - escrito);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Falha ao escrever o log");
+                break;
+            }
+            escrito += (size_t)n;
+        }
+        saida_log.usado[atual] = 0;
+        saida_log.lotes_enviados++;
+        saida_log.bytes += tamanho;
+        return;
+    }
+    recolher_lote(forcar || TAMANHO_LOTE_SAIDA - tamanho < TAMANHO_BUFFER_LOG);
+    if (saida_log.em_voo) {
+        return; // Continua acumulando no lote atual
+    }
+    saida_log.atual = 1 - atual;
+    saida_log.em_voo = true;
+    saida_log.confirmado = 0;
+    saida_log.bytes += tamanho;
+    submeter_lote();
+}
+
+// Junta no lote atual o que está pendente nos buffers das threads, enquanto couber
+// um buffer inteiro; retorna os bytes retirados
+static size_t coletar_logs(void) {
+    size_t total = 0;
+    int atual = saida_log.atual;
+    for (BufferLog *buffer = atomic_load(&buffers_log); buffer != NULL; buffer = buffer->proximo) {
+        if (TAMANHO_LOTE_SAIDA - saida_log.usado[atual] < TAMANHO_BUFFER_LOG) {
+            break; // O restante sai no próximo lote
+        }
+        size_t n = retirar_buffer(buffer, saida_log.lotes[atual] + saida_log.usado[atual]);
+        saida_log.usado[atual] += n;
+        total += n;
+    }
+    return total;
+}
+
+// Thread escritora: a única que escreve o log durante a execução
+void *escritor_log(void *arg) {
+    (void)arg;
+    fflush(stdout); // O que main já imprimiu sai antes do log, que não passa pelo stdio
+    for (;;) {
+        bool encerrando = atomic_load(&log_encerrar); // Lido antes de drenar: nada fica para trás
+        size_t retirado = coletar_logs();
+        if (saida_log.uring) {
+            recolher_lote(false);
+        }
+        enviar_lote(false);
+        if (encerrando && retirado == 0) {
+            break;
+        }
+        if (retirado == 0) {
+            simular_latencia(INTERVALO_ESCRITOR_LOG_US);
+        }
+    }
+    if (saida_log.uring) {
+        recolher_lote(true);
+        enviar_lote(true);
+        recolher_lote(true);
+    }
+    return NULL;
+}
+
+// Fecha o anel, o arquivo de log e libera os lotes (depois da escritora terminar)
+void fechar_saida_log(void) {
+    if (saida_log.uring) {
+        munmap(saida_log.sqes, (*saida_log.sq_mascara + 1) * sizeof(struct io_uring_sqe));
+        if (saida_log.tamanho_mapa_cq > 0) {
+            munmap(saida_log.mapa_cq, saida_log.tamanho_mapa_cq);
+        }
+        munmap(saida_log.mapa_sq, saida_log.tamanho_mapa_sq);
+        close(saida_log.anel_fd);
+    }
+    if (saida_log.fd != STDOUT_FILENO) {
+        close(saida_log.fd);
+    }
+    free(saida_log.lotes[0]);
+    free(saida_log.lotes[1]);
+}
+
+void liberar_buffers_log(_Atomic(BufferLog *) *lista) {
+    BufferLog *buffer = atomic_exchange(lista, NULL);
+    while (buffer != NULL) {
+        BufferLog *proximo = buffer->proximo;
+        free(buffer);
+        buffer = proximo;
+    }
+}
+
+// Cabeçalho comum aos registros do WAL: tamanho permite registros de comprimento
+// variável e a soma de verificação detecta um registro rasgado no fim do arquivo
+typedef struct {
+    uint32_t magica;
+    uint16_t tipo;      // REGISTRO_*
+    uint16_t tamanho;   // Bytes do registro inteiro, incluindo o cabeçalho
+    uint32_t epoca;     // Época em que a operação foi aplicada
+    uint32_t soma;      // FNV-1a do registro com este campo zerado
+    uint64_t criado_ns; // Instante da aplicação, para medir a latência de commit
+} CabecalhoWal;
+
+enum {
+    REGISTRO_DEPOSITO = 1,
+    REGISTRO_TRANSFERENCIA = 2,
+    REGISTRO_JUROS = 3,
+    REGISTRO_LANCAMENTOS = 4,
+};
+
+// Efeito aplicado de um depósito, de uma transferência bem-sucedida ou de uma
+// aplicação de juros (valor é então o fator aplicado a todas as contas)
+typedef struct {
+    CabecalhoWal cabecalho;
+    int32_t id_operacao;
+    int32_t origem;  // -1 em juros
+    int32_t destino; // -1 em depósitos e juros
+    int32_t reservado; // Alinha valor em 8 bytes
+    int64_t valor;   // Em centavos
+} RegistroOperacaoWal;
+
+// Efeito de uma operação com vários lançamentos: um único registro, de tamanho
+// variável, para que a reprodução aplique todos os lançamentos ou nenhum
+typedef struct {
+    CabecalhoWal cabecalho;
+    int32_t id_operacao;
+    int32_t quantidade;
+    Lancamento itens[]; // quantidade lançamentos
+} RegistroLancamentosWal;
+
+#define TAMANHO_MAXIMO_REGISTRO_WAL (sizeof(RegistroLancamentosWal) + MAX_LANCAMENTOS * sizeof(Lancamento))
+_Static_assert(TAMANHO_MAXIMO_REGISTRO_WAL <= UINT16_MAX, "CabecalhoWal.tamanho deve comportar o maior registro");
+
+static _Thread_local BufferLog *wal_local = NULL;
+static atomic_bool wal_encerrar = false;
+static atomic_ulong passagens_wal = 0; // Passadas completas da thread do WAL pelos buffers
+static atomic_ulong passagem_duravel_wal = 0; // Última passada cujos registros recolhidos já passaram pelo fdatasync
+atomic_int threads_io_aguardando_wal = 0;     // Threads de E/S retendo respostas até o próximo commit
+static void acordar_threads_io_aguardando_wal(void);
+int fd_wal = -1;
+unsigned int maior_epoca_wal = 0;    // Maior época encontrada na reprodução do WAL
+// O WAL é o arquivo de --wal mais, entre dois checkpoints, o segmento anterior
+// (ARQUIVO.anterior), reaplicado antes dele. Um checkpoint publicado na época E
+// torna dispensáveis os registros até E: a thread do WAL então trunca o arquivo,
+// se nada nele passa de E, ou o renomeia para o segmento anterior, que é apagado
+// quando um checkpoint posterior também o cobrir
+static char *caminho_wal_anterior = NULL;
+static bool wal_anterior_existe = false;
+static unsigned int epoca_segmento_wal = 0;      // Maior época gravada no arquivo do WAL
+static unsigned int epoca_segmento_anterior = 0; // Maior época gravada no segmento anterior
+static atomic_uint epoca_checkpoint_wal = 0;      // Época do último checkpoint publicado
+unsigned long registros_wal = 0;     // Estatísticas mantidas só pela thread do WAL
+unsigned long recortes_wal = 0;      // Truncamentos e rotações depois de um checkpoint
+unsigned long fsyncs_wal = 0;
+unsigned long long bytes_wal = 0;
+Histograma latencia_commit_wal;
+
+static uint32_t soma_fnv1a(const void *dados, size_t n) {
+    const unsigned char *bytes = dados;
+    uint32_t soma = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        soma = (soma ^ bytes[i]) * 16777619u;
+    }
+    return soma;
+}
+
+// Acrescenta o efeito de uma operação aplicada ao buffer de WAL da thread; a thread
+// do WAL o torna durável no próximo grupo (os trabalhadores não esperam pelo fsync)
+void registrar_wal(int tipo, int id_operacao, int origem, int destino, int64_t valor, unsigned int epoca) {
+    if (fd_wal < 0) {
+        return;
+    }
+    if (wal_local == NULL) {
+        wal_local = criar_buffer_log(&buffers_wal);
+    }
+    RegistroOperacaoWal registro;
+    memset(&registro, 0, sizeof(registro));
+    registro.cabecalho.magica = WAL_MAGICA;
+    registro.cabecalho.tipo = (uint16_t)tipo;
+    registro.cabecalho.tamanho = sizeof(registro);
+    registro.cabecalho.epoca = epoca;
+    registro.cabecalho.criado_ns = agora_ns();
+    registro.id_operacao = id_operacao;
+    registro.origem = origem;
+    registro.destino = destino;
+    registro.valor = valor;
+    registro.cabecalho.soma = soma_fnv1a(&registro, sizeof(registro));
+    anexar_buffer(wal_local, &registro, sizeof(registro));
+}
+
+// Como registrar_wal, para uma operação com vários lançamentos
+void registrar_wal_lancamentos(int id_operacao, const Lancamentos *lancamentos, unsigned int epoca) {
+    if (fd_wal < 0) {
+        return;
+    }
+    if (wal_local == NULL) {
+        wal_local = criar_buffer_log(&buffers_wal);
+    }
+    static _Thread_local _Alignas(8) char bloco[TAMANHO_MAXIMO_REGISTRO_WAL];
+    RegistroLancamentosWal *registro = (RegistroLancamentosWal *)bloco;
+    size_t tamanho = sizeof(RegistroLancamentosWal) + lancamentos->quantidade * sizeof(Lancamento);
+    memset(registro, 0, sizeof(RegistroLancamentosWal));
+    registro->cabecalho.magica = WAL_MAGICA;
+    registro->cabecalho.tipo = REGISTRO_LANCAMENTOS;
+    registro->cabecalho.tamanho = (uint16_t)tamanho;
+    registro->cabecalho.epoca = epoca;
+    registro->cabecalho.criado_ns = agora_ns();
+    registro->id_operacao = id_operacao;
+    registro->quantidade = lancamentos->quantidade;
+    memcpy(registro->itens, lancamentos->itens, lancamentos->quantidade * sizeof(Lancamento));
+    registro->cabecalho.soma = soma_fnv1a(registro, tamanho);
+    anexar_buffer(wal_local, registro, tamanho);
+}
+
+// Grava o grupo acumulado com um único write + fdatasync e mede a latência de commit
+static void gravar_grupo_wal(char *grupo, size_t tamanho) {
+    size_t gravado = 0;
+    while (gravado < tamanho) {
+        ssize_t n = write(fd_wal, grupo + gravado, tamanho - gravado);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Falha ao gravar o WAL");
+            exit(EXIT_FAILURE);
+        }
+        gravado += (size_t)n;
+    }
+    if (fdatasync(fd_wal) != 0) {
+        perror("Falha no fdatasync do WAL");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t agora = agora_ns();
+    for (size_t pos = 0; pos < tamanho;) {
+        CabecalhoWal cabecalho;
+        memcpy(&cabecalho, grupo + pos, sizeof(cabecalho));
+        registrar_no_histograma(&latencia_commit_wal, agora - cabecalho.criado_ns);
+        if (cabecalho.epoca > epoca_segmento_wal) {
+            epoca_segmento_wal = cabecalho.epoca;
+        }
+        registros_wal++;
+        pos += cabecalho.tamanho;
+    }
+    fsyncs_wal++;
+    bytes_wal += tamanho;
+}
+
+// Persiste a entrada de diretório de caminho depois de um rename ou unlink
+static void sincronizar_diretorio(const char *caminho) {
+    char diretorio[PATH_MAX] = ".";
+    const char *barra = strrchr(caminho, '/');
+    if (barra == caminho) {
+        strcpy(diretorio, "/");
+    } else if (barra != NULL) {
+        snprintf(diretorio, sizeof(diretorio), "%.*s", (int)(barra - caminho), caminho);
+    }
+    int fd = open(diretorio, O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) {
+        perror("Falha ao sincronizar o diretório do WAL");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+// Descarta do WAL o que o checkpoint da época dada já contém. Chamada pela thread
+// do WAL entre dois grupos (ou no encerramento, depois dela), com tudo o que já foi
+// gravado no disco; o que ainda está no grupo vai para o arquivo que sobrar
+static void recortar_wal(unsigned int epoca) {
+    if (wal_anterior_existe && epoca_segmento_anterior <= epoca) {
+        if (unlink(caminho_wal_anterior) != 0) {
+            perror("Falha ao apagar o segmento anterior do WAL");
+            exit(EXIT_FAILURE);
+        }
+        sincronizar_diretorio(caminho_wal_anterior);
+        wal_anterior_existe = false;
+    }
+    if (epoca_segmento_wal <= epoca) {
+        if (lseek(fd_wal, 0, SEEK_END) == 0) {
+            return;
+        }
+        if (ftruncate(fd_wal, 0) != 0 || fdatasync(fd_wal) != 0) {
+            perror("Falha ao truncar o WAL");
+            exit(EXIT_FAILURE);
+        }
+    } else if (!wal_anterior_existe) {
+        // Há registros posteriores ao checkpoint: o arquivo inteiro vira o segmento
+        // anterior (já durável, cada grupo passa por fdatasync) e um novo começa
+        if (rename(cfg.arquivo_wal, caminho_wal_anterior) != 0) {
+            perror("Falha ao renomear o WAL");
+            exit(EXIT_FAILURE);
+        }
+        // dup2 mantém o número de fd_wal, que os trabalhadores consultam sem trava
+        int novo = open(cfg.arquivo_wal, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (novo < 0 || dup2(novo, fd_wal) < 0) {
+            perror("Falha ao criar o WAL");
+            exit(EXIT_FAILURE);
+        }
+        close(novo);
+        sincronizar_diretorio(cfg.arquivo_wal);
+        wal_anterior_existe = true;
+        epoca_segmento_anterior = epoca_segmento_wal;
+    } else {
+        return; // O segmento anterior ainda tem registros posteriores ao checkpoint
+    }
+    epoca_segmento_wal = 0;
+    recortes_wal++;
+}
+
+// Thread do WAL: junta os registros de todos os trabalhadores e faz um commit em
+// grupo quando o grupo atinge cfg.wal_limite_bytes ou espera cfg.wal_intervalo_us.
+// Depois de cada checkpoint publicado, recorta o arquivo (ver recortar_wal)
+void *escritor_wal(void *arg) {
+    (void)arg;
+    size_t capacidade = (size_t)cfg.wal_limite_bytes + TAMANHO_BUFFER_LOG;
+    char *grupo = alocar_alinhado(capacidade, "grupo do WAL");
+    size_t usado = 0;
+    uint64_t inicio_grupo = 0;
+    unsigned int epoca_recortada = atomic_load(&epoca_checkpoint_wal);
+    long pausa_us = cfg.wal_intervalo_us / 4 > 50 ? cfg.wal_intervalo_us / 4 : 50;
+
+    for (;;) {
+        bool encerrando = atomic_load(&wal_encerrar); // Lido antes de drenar: nada fica para trás
+        size_t retirado = 0;
+        for (BufferLog *buffer = atomic_load(&buffers_wal); buffer != NULL; buffer = buffer->proximo) {
+            if (capacidade - usado < TAMANHO_BUFFER_LOG) {
+                gravar_grupo_wal(grupo, usado);
+                usado = 0;
+            }
+            size_t n = retirar_buffer(buffer, grupo + usado);
+            if (n > 0 && usado == 0) {
+                inicio_grupo = agora_ns();
+            }
+            usado += n;
+            retirado += n;
+        }
+        if (usado > 0 && (encerrando || usado >= (size_t)cfg.wal_limite_bytes ||
+                          agora_ns() - inicio_grupo >= (uint64_t)cfg.wal_intervalo_us * 1000)) {
+            gravar_grupo_wal(grupo, usado);
+            usado = 0;
+        }
+        unsigned int epoca_checkpoint = atomic_load(&epoca_checkpoint_wal);
+        if (epoca_checkpoint != epoca_recortada) {
+            recortar_wal(epoca_checkpoint);
+            epoca_recortada = epoca_checkpoint;
+        }
+        unsigned long passagem = atomic_fetch_add(&passagens_wal, 1) + 1;
+        if (usado == 0) {
+            // Tudo o que as passadas até esta recolheram está no disco: libera as
+            // respostas da rede que esperavam por esses registros
+            atomic_store(&passagem_duravel_wal, passagem);
+            if (atomic_load(&threads_io_aguardando_wal) > 0) {
+                acordar_threads_io_aguardando_wal();
+            }
+        }
+        if (encerrando) {
+            break;
+        }
+        if (retirado == 0) {
+            simular_latencia(pausa_us);
+        }
+    }
+    free(grupo);
+    return NULL;
+}
+
+// Núcleos das operações em massa sobre arrays de saldos (auditoria do total,
+// extremos para o relatório e aplicação de juros). Há versões AVX2, SSE4.2 e
+// escalar com resultados idênticos; a escolha é feita uma vez ao iniciar
+typedef struct {
+    const char *nome;
+    int64_t (*somar)(const int64_t *saldos, int n);
+    void (*extremos)(const int64_t *saldos, int n, int64_t *minimo, int64_t *maximo);
+    int64_t (*aplicar_juros)(int64_t *saldos, int n, uint32_t fator); // Retorna o total creditado
+} NucleosSaldos;
+
+// Juros de um saldo não negativo: piso(saldo * fator / 2^32), calculado com dois
+// produtos de 32 x 32 bits para que as versões vetoriais façam exatamente a mesma conta
+static inline int64_t juros_do_saldo(int64_t saldo, uint32_t fator) {
+    uint64_t s = (uint64_t)saldo;
+    return (int64_t)((s >> 32) * fator + (((s & 0xFFFFFFFFu) * fator) >> 32));
+}
+
+static int64_t somar_escalar(const int64_t *saldos, int n) {
+    int64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += saldos[i];
+    }
+    return total;
+}
+
+static void extremos_escalar(const int64_t *saldos, int n, int64_t *minimo, int64_t *maximo) {
+    int64_t menor = INT64_MAX, maior = INT64_MIN;
+    for (int i = 0; i < n; i++) {
+        menor = saldos[i] < menor ? saldos[i] : menor;
+        maior = saldos[i] > maior ? saldos[i] : maior;
+    }
+    *minimo = menor;
+    *maximo = maior;
+}
+
+static int64_t aplicar_juros_escalar(int64_t *saldos, int n, uint32_t fator) {
+    int64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        int64_t juros = juros_do_saldo(saldos[i], fator);
+        saldos[i] += juros;
+        total += juros;
+    }
+    return total;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static int64_t somar_avx2(const int64_t *saldos, int n) {
+    __m256i a = _mm256_setzero_si256(), b = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a = _mm256_add_epi64(a, _mm256_loadu_si256((const __m256i *)&saldos[i]));
+        b = _mm256_add_epi64(b, _mm256_loadu_si256((const __m256i *)&saldos[i + 4]));
+    }
+    int64_t partes[4];
+    _mm256_storeu_si256((__m256i *)partes, _mm256_add_epi64(a, b));
+    return partes[0] + partes[1] + partes[2] + partes[3] + somar_escalar(saldos + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void extremos_avx2(const int64_t *saldos, int n, int64_t *minimo, int64_t *maximo) {
+    __m256i menor = _mm256_set1_epi64x(INT64_MAX), maior = _mm256_set1_epi64x(INT64_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&saldos[i]);
+        menor = _mm256_blendv_epi8(menor, v, _mm256_cmpgt_epi64(menor, v));
+        maior = _mm256_blendv_epi8(maior, v, _mm256_cmpgt_epi64(v, maior));
+    }
+    int64_t menores[4], maiores[4], resto_min, resto_max;
+    _mm256_storeu_si256((__m256i *)menores, menor);
+    _mm256_storeu_si256((__m256i *)maiores, maior);
+    extremos_escalar(saldos + i, n - i, &resto_min, &resto_max);
+    for (int k = 0; k < 4; k++) {
+        resto_min = menores[k] < resto_min ? menores[k] : resto_min;
+        resto_max = maiores[k] > resto_max ? maiores[k] : resto_max;
+    }
+    *minimo = resto_min;
+    *maximo = resto_max;
+}
+
+__attribute__((target("avx2")))
+static int64_t aplicar_juros_avx2(int64_t *saldos, int n, uint32_t fator) {
+    __m256i f = _mm256_set1_epi64x(fator), total = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&saldos[i]);
+        __m256i alto = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), f);
+        __m256i baixo = _mm256_srli_epi64(_mm256_mul_epu32(v, f), 32);
+        __m256i juros = _mm256_add_epi64(alto, baixo);
+        _mm256_storeu_si256((__m256i *)&saldos[i], _mm256_add_epi64(v, juros));
+        total = _mm256_add_epi64(total, juros);
+    }
+    int64_t partes[4];
+    _mm256_storeu_si256((__m256i *)partes, total);
+    return partes[0] + partes[1] + partes[2] + partes[3] + aplicar_juros_escalar(saldos + i, n - i, fator);
+}
+
+__attribute__((target("sse4.2")))
+static int64_t somar_sse(const int64_t *saldos, int n) {
+    __m128i a = _mm_setzero_si128(), b = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a = _mm_add_epi64(a, _mm_loadu_si128((const __m128i *)&saldos[i]));
+        b = _mm_add_epi64(b, _mm_loadu_si128((const __m128i *)&saldos[i + 2]));
+    }
+    int64_t partes[2];
+    _mm_storeu_si128((__m128i *)partes, _mm_add_epi64(a, b));
+    return partes[0] + partes[1] + somar_escalar(saldos + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static void extremos_sse(const int64_t *saldos, int n, int64_t *minimo, int64_t *maximo) {
+    __m128i menor = _mm_set1_epi64x(INT64_MAX), maior = _mm_set1_epi64x(INT64_MIN);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&saldos[i]);
+        menor = _mm_blendv_epi8(menor, v, _mm_cmpgt_epi64(menor, v));
+        maior = _mm_blendv_epi8(maior, v, _mm_cmpgt_epi64(v, maior));
+    }
+    int64_t menores[2], maiores[2], resto_min, resto_max;
+    _mm_storeu_si128((__m128i *)menores, menor);
+    _mm_storeu_si128((__m128i *)maiores, maior);
+    extremos_escalar(saldos + i, n - i, &resto_min, &resto_max);
+    for (int k = 0; k < 2; k++) {
+        resto_min = menores[k] < resto_min ? menores[k] : resto_min;
+        resto_max = maiores[k] > resto_max ? maiores[k] : resto_max;
+    }
+    *minimo = resto_min;
+    *maximo = resto_max;
+}
+
+__attribute__((target("sse4.2")))
+static int64_t aplicar_juros_sse(int64_t *saldos, int n, uint32_t fator) {
+    __m128i f = _mm_set1_epi64x(fator), total = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&saldos[i]);
+        __m128i alto = _mm_mul_epu32(_mm_srli_epi64(v, 32), f);
+        __m128i baixo = _mm_srli_epi64(_mm_mul_epu32(v, f), 32);
+        __m128i juros = _mm_add_epi64(alto, baixo);
+        _mm_storeu_si128((__m128i *)&saldos[i], _mm_add_epi64(v, juros));
+        total = _mm_add_epi64(total, juros);
+    }
+    int64_t partes[2];
+    _mm_storeu_si128((__m128i *)partes, total);
+    return partes[0] + partes[1] + aplicar_juros_escalar(saldos + i, n - i, fator);
+}
+#endif
+
+static NucleosSaldos nucleos = {"escalar", somar_escalar, extremos_escalar, aplicar_juros_escalar};
+
+// Escolhe os núcleos pedidos em cfg.simd ("auto" usa o melhor que a CPU suporta)
+static void selecionar_nucleos(void) {
+    bool automatico = strcmp(cfg.simd, "auto") == 0;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if ((automatico || strcmp(cfg.simd, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        nucleos = (NucleosSaldos){"avx2", somar_avx2, extremos_avx2, aplicar_juros_avx2};
+        return;
+    }
+    if ((automatico || strcmp(cfg.simd, "sse") == 0) && __builtin_cpu_supports("sse4.2")) {
+        nucleos = (NucleosSaldos){"sse4.2", somar_sse, extremos_sse, aplicar_juros_sse};
+        return;
+    }
+#endif
+    if (!automatico && strcmp(cfg.simd, "escalar") != 0) {
+        fprintf(stderr, "Núcleos '%s' indisponíveis nesta CPU; usando a versão escalar\n", cfg.simd);
+    }
+}
+
+// Fator de 32 bits equivalente a pontos_base / 10000 (1 ponto-base = 0,01%)
+static inline uint32_t fator_de_juros(int pontos_base) {
+    return (uint32_t)(((uint64_t)pontos_base << 32) / 10000);
+}
+
+// Gira brevemente e depois cede a CPU; usado nas esperas curtas entre épocas
+static inline void aguardar_um_pouco(int *giros) {
+    if (++*giros < 64) {
+        pausa_cpu();
+    } else {
+        sched_yield();
+    }
+}
+
+// Agregados incrementais (--agregados): a soma de cada balde de contas
+// consecutivas (e com ela o total), o menor e o maior saldo e quantas contas estão
+// abaixo de cfg.limiar_saldo, todos na visão da última época encerrada. Os
+// escritores só anotam, no próprio slot, as contas que alteram pela primeira vez
+// em cada época; quem encerra a época lê o saldo final delas e aplica a diferença.
+// Um balanço passa a custar o que foi tocado desde o anterior, não todas as contas
+typedef struct {
+    int *contas;  // Heap binário de contas, ordenado pelo saldo agregado
+    int *posicao; // Posição de cada conta em contas
+    bool maior;   // true: a raiz é a conta de maior saldo
+} HeapSaldos;
+
+typedef struct {
+    bool ativos;
+    int64_t *saldos;       // Saldo de cada conta ao fim da última época dobrada
+    int64_t *somas_baldes; // Soma dos saldos de cada balde
+    long abaixo_limiar;    // Contas com saldo abaixo de cfg.limiar_saldo
+    HeapSaldos menores;
+    HeapSaldos maiores;
+    unsigned long epocas_dobradas;  // Estatísticas, protegidas por mutex_snapshot
+    unsigned long contas_dobradas;
+    unsigned long balancos;         // Balanços respondidos pelos agregados
+    unsigned long conferencias;     // Varreduras completas que conferiram os agregados
+    unsigned long divergencias;
+} Agregados;
+
+Agregados agregados;
+static _Thread_local SlotEpoca *slot_da_thread = NULL; // Slot da última entrar_epoca da thread
+
+// Chamada pelo primeiro escritor da conta na época
+static void anotar_conta_tocada(int id, unsigned int epoca) {
+    ContasTocadas *tocadas = &slot_da_thread->tocadas[epoca & 1];
+    if (tocadas->quantidade == tocadas->capacidade) {
+        tocadas->capacidade = tocadas->capacidade > 0 ? 2 * tocadas->capacidade : 1024;
+        tocadas->ids = realloc(tocadas->ids, tocadas->capacidade * sizeof(int));
+        if (tocadas->ids == NULL) {
+            perror("Falha ao alocar contas tocadas");
+            exit(EXIT_FAILURE);
+        }
+    }
+    tocadas->ids[tocadas->quantidade++] = id;
+}
+
+// Anuncia a época atual no slot da thread antes de alterar contas. Uma escrita
+// só começa depois que todos os escritores da época anterior terminaram, então
+// um balanço da época S nunca vê metade de uma operação
+static unsigned int entrar_epoca(SlotEpoca *slot) {
+    slot_da_thread = slot;
+    unsigned int epoca;
+    do {
+        epoca = atomic_load(&epoca_global);
+        atomic_store(&slot->epoca, epoca);
+    } while (atomic_load(&epoca_global) != epoca);
+
+    int giros = 0;
+    while (atomic_load_explicit(&epoca_drenada, memory_order_acquire) + 1 < epoca) {
+        aguardar_um_pouco(&giros);
+    }
+    return epoca;
+}
+
+static void sair_epoca(SlotEpoca *slot) {
+    atomic_store_explicit(&slot->epoca, 0, memory_order_release);
+}
+
+#define EPOCA_PREPARANDO 0x80000000u // Em epocas_contas: um escritor otimista guarda o saldo anterior
+
+// Antes da primeira escrita em uma época, guarda o saldo que o balanço da época
+// anterior deve enxergar (chamada com a listra da conta travada)
+static inline void preparar_escrita(int id, unsigned int epoca) {
+    if (atomic_load_explicit(&epocas_contas[id], memory_order_relaxed) != epoca) {
+        saldos_anteriores[id] = __atomic_load_n(&saldos_contas[id], __ATOMIC_RELAXED);
+        atomic_store_explicit(&epocas_contas[id], epoca, memory_order_release);
+        if (agregados.ativos) {
+            anotar_conta_tocada(id, epoca);
+        }
+    }
+}
+
+static inline int64_t ler_saldo(int id) {
+    return __atomic_load_n(&saldos_contas[id], __ATOMIC_RELAXED);
+}
+
+// A gravação com release garante que quem enxergar o novo saldo também enxerga a nova época
+static inline void gravar_saldo(int id, int64_t saldo) {
+    __atomic_store_n(&saldos_contas[id], saldo, __ATOMIC_RELEASE);
+}
+
+// Espera um escritor otimista terminar de guardar o saldo anterior da conta e
+// retorna a época publicada
+static inline unsigned int epoca_publicada(int id) {
+    unsigned int epoca;
+    int giros = 0;
+    while ((epoca = atomic_load_explicit(&epocas_contas[id], memory_order_acquire)) & EPOCA_PREPARANDO) {
+        aguardar_um_pouco(&giros);
+    }
+    return epoca;
+}
+
+// Lê, sem travas, o saldo da conta ao fim da época S (já drenada)
+static int64_t ler_saldo_snapshot(int id, unsigned int epoca) {
+    unsigned int antes = epoca_publicada(id);
+    if (antes <= epoca) {
+        int64_t saldo = __atomic_load_n(&saldos_contas[id], __ATOMIC_ACQUIRE);
+        if (atomic_load_explicit(&epocas_contas[id], memory_order_relaxed) == antes) {
+            return saldo; // Nenhuma escrita da época seguinte alterou a conta durante a leitura
+        }
+    }
+    epoca_publicada(id); // Sincroniza com quem gravou saldos_anteriores
+    return saldos_anteriores[id];
+}
+
+static inline int balde_da_conta(int id) {
+    return (int)((int64_t)id * cfg.baldes_agregados / cfg.num_contas);
+}
+
+// Primeira conta do balde (a do balde seguinte, para b = cfg.baldes_agregados)
+static inline int inicio_do_balde(int b) {
+    return (int)(((int64_t)b * cfg.num_contas + cfg.baldes_agregados - 1) / cfg.baldes_agregados);
+}
+
+static inline bool antes_no_heap(const HeapSaldos *heap, int a, int b) {
+    return heap->maior ? agregados.saldos[a] > agregados.saldos[b] : agregados.saldos[a] < agregados.saldos[b];
+}
+
+static inline void trocar_no_heap(HeapSaldos *heap, int i, int j) {
+    int a = heap->contas[i], b = heap->contas[j];
+    heap->contas[i] = b;
+    heap->contas[j] = a;
+    heap->posicao[b] = i;
+    heap->posicao[a] = j;
+}
+
+static void descer_no_heap(HeapSaldos *heap, int i) {
+    for (;;) {
+        int filho = 2 * i + 1;
+        if (filho >= cfg.num_contas) {
+            return;
+        }
+        if (filho + 1 < cfg.num_contas && antes_no_heap(heap, heap->contas[filho + 1], heap->contas[filho])) {
+            filho++;
+        }
+        if (!antes_no_heap(heap, heap->contas[filho], heap->contas[i])) {
+            return;
+        }
+        trocar_no_heap(heap, i, filho);
+        i = filho;
+    }
+}
+
+// Recoloca a conta no heap depois que o saldo agregado dela mudou
+static void ajustar_heap(HeapSaldos *heap, int conta) {
+    int i = heap->posicao[conta];
+    while (i > 0 && antes_no_heap(heap, heap->contas[i], heap->contas[(i - 1) / 2])) {
+        trocar_no_heap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    descer_no_heap(heap, i);
+}
+
+static void montar_heap(HeapSaldos *heap) {
+    for (int i = 0; i < cfg.num_contas; i++) {
+        heap->contas[i] = i;
+        heap->posicao[i] = i;
+    }
+    for (int i = cfg.num_contas / 2 - 1; i >= 0; i--) {
+        descer_no_heap(heap, i);
+    }
+}
+
+// Recalcula os agregados a partir dos saldos atuais, sem escritores: no início
+// (depois da recuperação) e depois dos juros, que alteram todas as contas
+static void reconstruir_agregados(void) {
+    memset(agregados.somas_baldes, 0, cfg.baldes_agregados * sizeof(int64_t));
+    agregados.abaixo_limiar = 0;
+    for (int i = 0; i < cfg.num_contas; i++) {
+        int64_t saldo = ler_saldo(i);
+        agregados.saldos[i] = saldo;
+        agregados.somas_baldes[balde_da_conta(i)] += saldo;
+        agregados.abaixo_limiar += saldo < cfg.limiar_saldo;
+    }
+    montar_heap(&agregados.menores);
+    montar_heap(&agregados.maiores);
+}
+
+void inicializar_agregados(void) {
+    if (!cfg.agregados) {
+        return;
+    }
+    agregados.saldos = alocar_alinhado(cfg.num_contas * sizeof(int64_t), "saldos agregados");
+    agregados.somas_baldes = alocar_alinhado(cfg.baldes_agregados * sizeof(int64_t), "somas dos baldes");
+    agregados.menores = (HeapSaldos){alocar_alinhado(cfg.num_contas * sizeof(int), "heap dos menores saldos"),
+                                     alocar_alinhado(cfg.num_contas * sizeof(int), "posições no heap dos menores"),
+                                     false};
+    agregados.maiores = (HeapSaldos){alocar_alinhado(cfg.num_contas * sizeof(int), "heap dos maiores saldos"),
+                                     alocar_alinhado(cfg.num_contas * sizeof(int), "posições no heap dos maiores"),
+                                     true};
+    reconstruir_agregados();
+    agregados.ativos = true;
+}
+
+// Aplica aos agregados as contas alteradas na época encerrada. Chamada por
+// fechar_epoca depois que os escritores dela saíram; os da época seguinte anotam
+// na outra paridade, e os da próxima com esta paridade ainda esperam o
+// fechar_epoca seguinte, serializado por mutex_snapshot
+static void dobrar_agregados(unsigned int epoca) {
+    for (int t = 0; t < cfg.num_threads; t++) {
+        ContasTocadas *tocadas = &slots_epoca[t].tocadas[epoca & 1];
+        for (int k = 0; k < tocadas->quantidade; k++) {
+            int id = tocadas->ids[k];
+            int64_t anterior = agregados.saldos[id];
+            int64_t saldo = ler_saldo_snapshot(id, epoca);
+            if (saldo == anterior) {
+                continue;
+            }
+            agregados.saldos[id] = saldo;
+            agregados.somas_baldes[balde_da_conta(id)] += saldo - anterior;
+            agregados.abaixo_limiar += (saldo < cfg.limiar_saldo) - (anterior < cfg.limiar_saldo);
+            ajustar_heap(&agregados.menores, id);
+            ajustar_heap(&agregados.maiores, id);
+        }
+        agregados.contas_dobradas += tocadas->quantidade;
+        tocadas->quantidade = 0;
+    }
+    agregados.epocas_dobradas++;
+}
+
+// Encerra a época atual e espera seus escritores terminarem; retorna a época
+// encerrada, cuja visão fica estável até o próximo snapshot (mutex_snapshot travado)
+static unsigned int fechar_epoca(void) {
+    unsigned int epoca = atomic_fetch_add(&epoca_global, 1);
+    for (int t = 0; t < cfg.num_threads; t++) {
+        int giros = 0;
+        while (atomic_load(&slots_epoca[t].epoca) == epoca) {
+            aguardar_um_pouco(&giros);
+        }
+    }
+    for (int t = 0; t < cfg.num_threads; t++) {
+        atomic_int_least64_t *depositado = &slots_epoca[t].depositado[epoca & 1];
+        total_depositado += atomic_load_explicit(depositado, memory_order_relaxed);
+        atomic_store_explicit(depositado, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&epoca_drenada, epoca, memory_order_release);
+    if (agregados.ativos) {
+        dobrar_agregados(epoca);
+    }
+    return epoca;
+}
+
+// Espera a thread do WAL recolher tudo o que já foi anexado aos buffers: uma passada
+// completa iniciada depois desta chamada. Usada para ordenar os juros no arquivo
+static void aguardar_wal_recolher(void) {
+    if (fd_wal < 0) {
+        return;
+    }
+    unsigned long alvo = atomic_load(&passagens_wal) + 2;
+    while (atomic_load(&passagens_wal) < alvo) {
+        sched_yield();
+    }
+}
+
+// Confere e, se for posterior à época base, reaplica um registro de lançamentos
+// (inteiro no bloco); retorna false se ele estiver corrompido
+static bool reaplicar_lancamentos_wal(const char *dados, unsigned int epoca_base, const char *caminho) {
+    static _Alignas(8) char copia[TAMANHO_MAXIMO_REGISTRO_WAL];
+    const CabecalhoWal *cabecalho = (const CabecalhoWal *)dados;
+    if (cabecalho->tamanho < sizeof(RegistroLancamentosWal) || cabecalho->tamanho > TAMANHO_MAXIMO_REGISTRO_WAL ||
+        (cabecalho->tamanho - sizeof(RegistroLancamentosWal)) % sizeof(Lancamento) != 0) {
+        return false;
+    }
+    RegistroLancamentosWal *registro = (RegistroLancamentosWal *)copia;
+    memcpy(copia, dados, cabecalho->tamanho);
+    uint32_t soma = registro->cabecalho.soma;
+    registro->cabecalho.soma = 0;
+    if (soma_fnv1a(registro, cabecalho->tamanho) != soma ||
+        registro->quantidade != (int32_t)((cabecalho->tamanho - sizeof(RegistroLancamentosWal)) / sizeof(Lancamento))) {
+        return false;
+    }
+    for (int i = 0; i < registro->quantidade; i++) {
+        if (registro->itens[i].conta < 0 || registro->itens[i].conta >= cfg.num_contas) {
+            fprintf(stderr, "O WAL %s refere-se a contas inexistentes (há %d contas)\n", caminho, cfg.num_contas);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (registro->cabecalho.epoca <= epoca_base) {
+        return true;
+    }
+    for (int i = 0; i < registro->quantidade; i++) {
+        int conta = registro->itens[i].conta;
+        gravar_saldo(conta, ler_saldo(conta) + registro->itens[i].valor);
+    }
+    if (registro->cabecalho.epoca > maior_epoca_wal) {
+        maior_epoca_wal = registro->cabecalho.epoca;
+    }
+    return true;
+}
+
+// Reaplica os efeitos registrados num segmento do WAL posteriores à época base (os
+// anteriores já estão no checkpoint carregado) e guarda em maior_epoca a maior
+// época do segmento. Um registro incompleto ou corrompido no fim (queda durante a
+// gravação) é descartado e o arquivo é truncado nele
+static unsigned long reproduzir_segmento_wal(int fd, const char *caminho, unsigned int epoca_base,
+                                             unsigned int *maior_epoca) {
+    size_t capacidade = 1 << 20;
+    char *bloco = malloc(capacidade);
+    if (bloco == NULL) {
+        perror("Falha ao alocar buffer de leitura do WAL");
+        exit(EXIT_FAILURE);
+    }
+    size_t inicio = 0, fim = 0;
+    off_t deslocamento_valido = 0;
+    unsigned long reaplicados = 0;
+    bool corrompido = false;
+    *maior_epoca = 0;
+
+    for (;;) {
+        if (fim - inicio < sizeof(CabecalhoWal) || fim - inicio < ((CabecalhoWal *)(bloco + inicio))->tamanho) {
+            memmove(bloco, bloco + inicio, fim - inicio);
+            fim -= inicio;
+            inicio = 0;
+            ssize_t n = pread(fd, bloco + fim, capacidade - fim, deslocamento_valido + (off_t)fim);
+            if (n < 0) {
+                perror("Falha ao ler o WAL");
+                exit(EXIT_FAILURE);
+            }
+            if (n == 0) {
+                corrompido = fim > 0; // Sobrou um pedaço de registro
+                break;
+            }
+            fim += (size_t)n;
+            continue;
+        }
+
+        RegistroOperacaoWal registro;
+        CabecalhoWal *cabecalho = (CabecalhoWal *)(bloco + inicio);
+        if (cabecalho->magica == WAL_MAGICA && cabecalho->tipo == REGISTRO_LANCAMENTOS) {
+            if (!reaplicar_lancamentos_wal(bloco + inicio, epoca_base, caminho)) {
+                corrompido = true;
+                break;
+            }
+            if (cabecalho->epoca > *maior_epoca) {
+                *maior_epoca = cabecalho->epoca;
+            }
+            inicio += cabecalho->tamanho;
+            deslocamento_valido += cabecalho->tamanho;
+            reaplicados += cabecalho->epoca > epoca_base;
+            continue;
+        }
+        if (cabecalho->magica != WAL_MAGICA || cabecalho->tamanho != sizeof(registro)) {
+            corrompido = true;
+            break;
+        }
+        memcpy(&registro, bloco + inicio, sizeof(registro));
+        uint32_t soma = registro.cabecalho.soma;
+        registro.cabecalho.soma = 0;
+        if (soma_fnv1a(&registro, sizeof(registro)) != soma) {
+            corrompido = true;
+            break;
+        }
+        if ((registro.cabecalho.tipo != REGISTRO_JUROS &&
+             (registro.origem < 0 || registro.origem >= cfg.num_contas)) ||
+            (registro.cabecalho.tipo == REGISTRO_TRANSFERENCIA &&
+             (registro.destino < 0 || registro.destino >= cfg.num_contas))) {
+            fprintf(stderr, "O WAL %s refere-se a contas inexistentes (há %d contas)\n", caminho, cfg.num_contas);
+            exit(EXIT_FAILURE);
+        }
+
+        inicio += sizeof(registro);
+        deslocamento_valido += sizeof(registro);
+        if (registro.cabecalho.epoca > *maior_epoca) {
+            *maior_epoca = registro.cabecalho.epoca;
+        }
+        if (registro.cabecalho.epoca <= epoca_base) {
+            continue;
+        }
+        if (registro.cabecalho.tipo == REGISTRO_DEPOSITO) {
+            gravar_saldo(registro.origem, ler_saldo(registro.origem) + registro.valor);
+            total_depositado += registro.valor;
+        } else if (registro.cabecalho.tipo == REGISTRO_TRANSFERENCIA) {
+            gravar_saldo(registro.origem, ler_saldo(registro.origem) - registro.valor);
+            gravar_saldo(registro.destino, ler_saldo(registro.destino) + registro.valor);
+        } else {
+            // Os juros ficam no arquivo depois de tudo que os precedeu (ver aplicar_juros)
+            total_depositado += nucleos.aplicar_juros(saldos_contas, cfg.num_contas, (uint32_t)registro.valor);
+        }
+        if (registro.cabecalho.epoca > maior_epoca_wal) {
+            maior_epoca_wal = registro.cabecalho.epoca;
+        }
+        reaplicados++;
+    }
+    free(bloco);
+
+    if (corrompido) {
+        fprintf(stderr, "WAL: registro incompleto ou corrompido em %s na posição %lld; truncando\n", caminho,
+                (long long)deslocamento_valido);
+        if (ftruncate(fd, deslocamento_valido) != 0) {
+            perror("Falha ao truncar o WAL");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return reaplicados;
+}
+
+// Reaplica o segmento anterior, se houver, e depois o arquivo do WAL, que fica
+// aberto para novos registros
+void reproduzir_wal(const char *caminho, unsigned int epoca_base) {
+    caminho_wal_anterior = malloc(strlen(caminho) + sizeof(".anterior"));
+    if (caminho_wal_anterior == NULL) {
+        perror("Falha ao alocar o caminho do WAL");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(caminho_wal_anterior, "%s.anterior", caminho);
+    maior_epoca_wal = epoca_base;
+    unsigned long reaplicados = 0;
+    int fd = open(caminho_wal_anterior, O_RDWR);
+    if (fd >= 0) {
+        reaplicados += reproduzir_segmento_wal(fd, caminho_wal_anterior, epoca_base, &epoca_segmento_anterior);
+        close(fd);
+        wal_anterior_existe = true;
+    } else if (errno != ENOENT) {
+        perror("Falha ao abrir o segmento anterior do WAL");
+        exit(EXIT_FAILURE);
+    }
+    fd_wal = open(caminho, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd_wal < 0) {
+        perror("Falha ao abrir o WAL");
+        exit(EXIT_FAILURE);
+    }
+    reaplicados += reproduzir_segmento_wal(fd_wal, caminho, epoca_base, &epoca_segmento_wal);
+    if (reaplicados > 0) {
+        printf("WAL: %lu operações reaplicadas de %s (última época %u)\n", reaplicados, caminho, maior_epoca_wal);
+    }
+}
+
+// Descreve uma das duas regiões de saldos do arquivo de checkpoint. O checkpoint
+// escreve sempre na região mais antiga e só então publica o descritor, então uma
+// queda no meio deixa intacta a região publicada antes
+typedef struct {
+    uint64_t geracao;         // 0 = região ainda não publicada
+    uint64_t deslocamento;    // Início dos saldos no arquivo (alinhado à página)
+    int64_t total_depositado; // Depósitos e juros até a época do checkpoint, em centavos
+    uint32_t epoca;           // Época drenada cujo estado a região contém
+    uint32_t soma;            // FNV-1a do descritor com este campo zerado
+} RegiaoCheckpoint;
+
+typedef struct {
+    uint32_t magica;
+    uint32_t versao;
+    uint64_t num_contas;
+    RegiaoCheckpoint regioes[2];
+} CabecalhoCheckpoint;
+
+static CabecalhoCheckpoint *checkpoint_mapa = NULL; // Arquivo inteiro mapeado com MAP_SHARED
+static size_t tamanho_checkpoint = 0;
+static size_t tamanho_pagina = 0;
+static atomic_bool checkpoint_encerrar = false;
+unsigned long checkpoints_gravados = 0;  // Estatísticas mantidas só pelo checkpointer
+uint64_t checkpoint_copia_ns = 0;         // Tempo com mutex_snapshot travado
+uint64_t checkpoint_msync_ns = 0;
+
+static uint32_t soma_regiao(RegiaoCheckpoint regiao) {
+    regiao.soma = 0;
+    return soma_fnv1a(&regiao, sizeof(regiao));
+}
+
+static inline int64_t *saldos_da_regiao(const RegiaoCheckpoint *regiao) {
+    return (int64_t *)((char *)checkpoint_mapa + regiao->deslocamento);
+}
+
+// Persiste o intervalo [inicio, inicio + n) do mapa, arredondado para páginas inteiras
+static void sincronizar_mapa(void *inicio, size_t n) {
+    uintptr_t pagina = (uintptr_t)inicio & ~(uintptr_t)(tamanho_pagina - 1);
+    if (msync((void *)pagina, (uintptr_t)inicio + n - pagina, MS_SYNC) != 0) {
+        perror("Falha no msync do checkpoint");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Mapeia o arquivo de checkpoint (criando-o se não existir) e carrega nas contas a
+// região publicada mais recente. Retorna a época desse estado (0 se não houver),
+// a partir da qual o WAL ainda precisa ser reaplicado
+unsigned int carregar_checkpoint(const char *caminho) {
+    tamanho_pagina = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes_saldos = ((size_t)cfg.num_contas * sizeof(int64_t) + tamanho_pagina - 1) & ~(tamanho_pagina - 1);
+    size_t esperado = tamanho_pagina + 2 * bytes_saldos;
+
+    int fd = open(caminho, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("Falha ao abrir o checkpoint");
+        exit(EXIT_FAILURE);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Falha ao consultar o checkpoint");
+        exit(EXIT_FAILURE);
+    }
+    bool novo = info.st_size == 0;
+    if (novo && ftruncate(fd, (off_t)esperado) != 0) {
+        perror("Falha ao dimensionar o checkpoint");
+        exit(EXIT_FAILURE);
+    }
+    tamanho_checkpoint = novo ? esperado : (size_t)info.st_size;
+    checkpoint_mapa = mmap(NULL, tamanho_checkpoint, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (checkpoint_mapa == MAP_FAILED) {
+        perror("Falha ao mapear o checkpoint");
+        exit(EXIT_FAILURE);
+    }
+    close(fd); // O mapeamento mantém o arquivo aberto
+
+    if (novo) {
+        checkpoint_mapa->magica = CHECKPOINT_MAGICA;
+        checkpoint_mapa->versao = CHECKPOINT_VERSAO;
+        checkpoint_mapa->num_contas = (uint64_t)cfg.num_contas;
+        for (int r = 0; r < 2; r++) {
+            RegiaoCheckpoint *regiao = &checkpoint_mapa->regioes[r];
+            regiao->geracao = 0;
+            regiao->deslocamento = tamanho_pagina + r * bytes_saldos;
+            regiao->soma = soma_regiao(*regiao);
+        }
+        sincronizar_mapa(checkpoint_mapa, sizeof(CabecalhoCheckpoint));
+        return 0;
+    }
+
+    if (tamanho_checkpoint < sizeof(CabecalhoCheckpoint) || checkpoint_mapa->magica != CHECKPOINT_MAGICA) {
+        fprintf(stderr, "%s não é um arquivo de checkpoint\n", caminho);
+        exit(EXIT_FAILURE);
+    }
+    if (checkpoint_mapa->versao != CHECKPOINT_VERSAO) {
+        fprintf(stderr, "Checkpoint %s tem versão %u; esta versão do servidor lê a %d\n",
+                caminho, checkpoint_mapa->versao, CHECKPOINT_VERSAO);
+        exit(EXIT_FAILURE);
+    }
+    if (checkpoint_mapa->num_contas != (uint64_t)cfg.num_contas) {
+        fprintf(stderr, "Checkpoint %s tem %llu contas, mas o servidor foi configurado com %d\n",
+                caminho, (unsigned long long)checkpoint_mapa->num_contas, cfg.num_contas);
+        exit(EXIT_FAILURE);
+    }
+
+    const RegiaoCheckpoint *escolhida = NULL;
+    for (int r = 0; r < 2; r++) {
+        const RegiaoCheckpoint *regiao = &checkpoint_mapa->regioes[r];
+        if (regiao->soma != soma_regiao(*regiao) ||
+            regiao->deslocamento + (size_t)cfg.num_contas * sizeof(int64_t) > tamanho_checkpoint) {
+            fprintf(stderr, "Checkpoint: descritor da região %d corrompido; ignorando\n", r);
+            continue;
+        }
+        if (regiao->geracao > 0 && (escolhida == NULL || regiao->geracao > escolhida->geracao)) {
+            escolhida = regiao;
+        }
+    }
+    if (escolhida == NULL) {
+        return 0;
+    }
+    const int64_t *saldos = saldos_da_regiao(escolhida);
+    memcpy(saldos_contas, saldos, (size_t)cfg.num_contas * sizeof(int64_t));
+    memcpy(saldos_anteriores, saldos, (size_t)cfg.num_contas * sizeof(int64_t));
+    total_depositado = escolhida->total_depositado;
+    printf("Checkpoint: estado da época %u carregado de %s (geração %llu)\n",
+           escolhida->epoca, caminho, (unsigned long long)escolhida->geracao);
+    return escolhida->epoca;
+}
+
+// Grava um snapshot consistente na região mais antiga sem parar os trabalhadores:
+// só a cópia dos saldos acontece com mutex_snapshot travado (como num balanço); o
+// msync dos saldos e a publicação do descritor acontecem depois, fora da trava
+void gravar_checkpoint(void) {
+    RegiaoCheckpoint *regioes = checkpoint_mapa->regioes;
+    int alvo = regioes[0].geracao <= regioes[1].geracao ? 0 : 1;
+    RegiaoCheckpoint regiao = regioes[alvo];
+    int64_t *destino = saldos_da_regiao(&regiao);
+
+    uint64_t inicio = agora_ns();
+    pthread_mutex_lock(&mutex_snapshot);
+    unsigned int epoca = fechar_epoca();
+    for (int i = 0; i < cfg.num_contas; i++) {
+        destino[i] = ler_saldo_snapshot(i, epoca);
+    }
+    regiao.total_depositado = total_depositado;
+    pthread_mutex_unlock(&mutex_snapshot);
+    uint64_t copiado = agora_ns();
+
+    sincronizar_mapa(destino, (size_t)cfg.num_contas * sizeof(int64_t));
+    regiao.geracao = (regioes[0].geracao > regioes[1].geracao ? regioes[0].geracao : regioes[1].geracao) + 1;
+    regiao.epoca = epoca;
+    regiao.soma = soma_regiao(regiao);
+    regioes[alvo] = regiao;
+    sincronizar_mapa(&regioes[alvo], sizeof(regiao));
+    atomic_store(&epoca_checkpoint_wal, epoca); // Publicado: a thread do WAL pode recortar o arquivo
+
+    checkpoint_copia_ns += copiado - inicio;
+    checkpoint_msync_ns += agora_ns() - copiado;
+    checkpoints_gravados++;
+}
+
+// Thread de checkpoint: grava um snapshot a cada cfg.checkpoint_intervalo_ms
+void *checkpointer(void *arg) {
+    (void)arg;
+    uint64_t proximo = agora_ns() + (uint64_t)cfg.checkpoint_intervalo_ms * 1000000;
+    while (!atomic_load(&checkpoint_encerrar)) {
+        if (agora_ns() >= proximo) {
+            gravar_checkpoint();
+            proximo = agora_ns() + (uint64_t)cfg.checkpoint_intervalo_ms * 1000000;
+        }
+        simular_latencia(10000); // Acorda com frequência para não atrasar o encerramento
+    }
+    return NULL;
+}
+
+void fechar_checkpoint(void) {
+    munmap(checkpoint_mapa, tamanho_checkpoint);
+    checkpoint_mapa = NULL;
+}
+
+// Funções de operações (chamadas com as listras das contas envolvidas já travadas
+// e a época anunciada pela thread)
+
+// Retorna false se o depósito levaria a conta acima de LIMITE_SALDO; nada é alterado
+bool deposito(int id, int64_t valor, int op_id, SlotEpoca *slot, unsigned int epoca) {
+    if (ler_saldo(id) > LIMITE_SALDO - valor) {
+        LOG_OPERACAO("Operação %d: Depósito recusado: a conta %d passaria do limite\n", op_id, id);
+        return false;
+    }
+    preparar_escrita(id, epoca);
+    gravar_saldo(id, ler_saldo(id) + valor);
+    registrar_wal(REGISTRO_DEPOSITO, op_id, id, -1, valor, epoca);
+    atomic_int_least64_t *depositado = &slot->depositado[epoca & 1];
+    atomic_store_explicit(depositado, atomic_load_explicit(depositado, memory_order_relaxed) + valor,
+                          memory_order_relaxed);
+    simular_custo();
+    LOG_OPERACAO("Operação %d: Depósito de %.2f na conta %d. Novo saldo: %.2f\n", op_id, valor / 100.0, id,
+                 ler_saldo(id) / 100.0);
+    return true;
+}
+
+// Retorna false se a origem não tinha saldo e nada foi alterado
+bool transferencia(int origem, int destino, int64_t valor, int op_id, unsigned int epoca) {
+    if (ler_saldo(origem) >= valor) {
+        preparar_escrita(origem, epoca);
+        preparar_escrita(destino, epoca);
+        gravar_saldo(origem, ler_saldo(origem) - valor);
+        gravar_saldo(destino, ler_saldo(destino) + valor);
+        registrar_wal(REGISTRO_TRANSFERENCIA, op_id, origem, destino, valor, epoca);
+        simular_custo();
+        LOG_OPERACAO("Operação %d: Transferência de %.2f da conta %d para a conta %d\n", op_id, valor / 100.0,
+                     origem, destino);
+        return true;
+    }
+    LOG_OPERACAO("Operação %d: Transferência falhou: saldo insuficiente na conta %d\n", op_id, origem);
+    return false;
+}
+
+// Motor otimista (--otimista): o caminho comum não trava nada. Créditos (depósitos
+// e o destino das transferências) comutam entre si e com os débitos, então viram
+// um único fetch-add no saldo. Só o débito precisa de validação: ele lê a versão
+// e o saldo da origem e confirma com um CAS da versão lida para ímpar, que falha
+// se outro débito passou pela conta nesse meio tempo. Como só quem tem a versão
+// ímpar diminui o saldo, o saldo lido continua suficiente até o fim do débito
+atomic_bool juros_em_andamento = false; // Escritores otimistas esperam os juros terminarem
+static _Thread_local unsigned long conflitos_locais = 0, recuos_locais = 0;
+unsigned long conflitos_otimistas = 0; // Débitos repetidos porque a versão mudou
+unsigned long recuos_para_travas = 0;  // Débitos que esgotaram as tentativas e travaram a listra
+
+// Versão de preparar_escrita sem a trava da listra: o primeiro escritor da época
+// marca a conta, guarda o saldo anterior e publica a época; os concorrentes
+// esperam a publicação antes de alterar o saldo
+static inline void preparar_escrita_otimista(int id, unsigned int epoca) {
+    unsigned int atual = atomic_load_explicit(&epocas_contas[id], memory_order_acquire);
+    int giros = 0;
+    while (atual != epoca) {
+        if (atual & EPOCA_PREPARANDO) {
+            aguardar_um_pouco(&giros);
+            atual = atomic_load_explicit(&epocas_contas[id], memory_order_acquire);
+        } else if (atomic_compare_exchange_weak_explicit(&epocas_contas[id], &atual, epoca | EPOCA_PREPARANDO,
+                                                         memory_order_acquire, memory_order_acquire)) {
+            saldos_anteriores[id] = __atomic_load_n(&saldos_contas[id], __ATOMIC_RELAXED);
+            atomic_store_explicit(&epocas_contas[id], epoca, memory_order_release);
+            if (agregados.ativos) {
+                anotar_conta_tocada(id, epoca);
+            }
+            return;
+        }
+    }
+}
+
+// Anuncia a época como entrar_epoca, mas recua enquanto uma aplicação de juros
+// estiver em andamento: os juros reescrevem todos os saldos sem atômicos e
+// esperam até nenhum escritor ter época anunciada
+static unsigned int entrar_epoca_otimista(SlotEpoca *slot) {
+    for (;;) {
+        unsigned int epoca = entrar_epoca(slot);
+        if (!atomic_load(&juros_em_andamento)) {
+            return epoca;
+        }
+        sair_epoca(slot);
+        int giros = 0;
+        while (atomic_load(&juros_em_andamento)) {
+            aguardar_um_pouco(&giros);
+        }
+    }
+}
+
+// O limite é conferido antes do fetch-add: créditos concorrentes podem passar dele,
+// mas cada um é limitado a LIMITE_LANCAMENTO e a folga de LIMITE_SALDO os comporta
+bool deposito_otimista(int id, int64_t valor, int op_id, SlotEpoca *slot, unsigned int epoca) {
+    if (__atomic_load_n(&saldos_contas[id], __ATOMIC_RELAXED) > LIMITE_SALDO - valor) {
+        LOG_OPERACAO("Operação %d: Depósito recusado: a conta %d passaria do limite\n", op_id, id);
+        return false;
+    }
+    simular_custo();
+    preparar_escrita_otimista(id, epoca);
+    int64_t saldo = __atomic_add_fetch(&saldos_contas[id], valor, __ATOMIC_RELEASE);
+    registrar_wal(REGISTRO_DEPOSITO, op_id, id, -1, valor, epoca);
+    atomic_int_least64_t *depositado = &slot->depositado[epoca & 1];
+    atomic_store_explicit(depositado, atomic_load_explicit(depositado, memory_order_relaxed) + valor,
+                          memory_order_relaxed);
+    LOG_OPERACAO("Operação %d: Depósito de %.2f na conta %d. Novo saldo: %.2f\n", op_id, valor / 100.0, id,
+                 saldo / 100.0);
+    return true;
+}
+
+// Assume a versão da origem para debitar. Com travada, espera a versão ficar par
+// em vez de desistir (a listra já serializa os débitos que recuaram). Retorna a
+// versão assumida (ímpar), ou 0 se a versão mudou depois da leitura do saldo ou
+// se o saldo não basta (*suficiente = false)
+static unsigned int assumir_versao(int origem, int64_t valor, bool travada, bool *suficiente) {
+    atomic_uint *versao = &versoes_contas[origem];
+    unsigned int lida = atomic_load_explicit(versao, memory_order_acquire);
+    int giros = 0;
+    while (lida & 1) {
+        if (!travada) {
+            return 0;
+        }
+        aguardar_um_pouco(&giros);
+        lida = atomic_load_explicit(versao, memory_order_acquire);
+    }
+    *suficiente = __atomic_load_n(&saldos_contas[origem], __ATOMIC_ACQUIRE) >= valor;
+    if (!*suficiente) {
+        return 0;
+    }
+    simular_custo(); // O trabalho da operação acontece antes da validação
+    if (!atomic_compare_exchange_strong_explicit(versao, &lida, lida + 1, memory_order_acquire,
+                                                 memory_order_relaxed)) {
+        return 0;
+    }
+    return lida + 1;
+}
+
+// Retorna false se a origem não tinha saldo e nada foi alterado. Depois de
+// cfg.tentativas_otimistas conflitos trava a listra da origem, para que os débitos
+// de uma conta disputada façam fila em vez de repetir o CAS indefinidamente
+bool transferencia_otimista(int origem, int destino, int64_t valor, int op_id, unsigned int epoca) {
+    bool suficiente = true;
+    bool travada = false;
+    unsigned int versao = 0;
+    for (int tentativa = 0; versao == 0; tentativa++) {
+        conflitos_locais += tentativa > 0;
+        if (tentativa == cfg.tentativas_otimistas) {
+            pthread_mutex_lock(&travas_contas[trava_da_conta(origem)].mutex);
+            travada = true;
+            recuos_locais++;
+        } else if (tentativa > 0) {
+            pausa_cpu();
+        }
+        versao = assumir_versao(origem, valor, travada, &suficiente);
+        if (!suficiente) {
+            break;
+        }
+    }
+    if (versao != 0) {
+        preparar_escrita_otimista(origem, epoca);
+        preparar_escrita_otimista(destino, epoca);
+        __atomic_fetch_sub(&saldos_contas[origem], valor, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&saldos_contas[destino], valor, __ATOMIC_RELEASE);
+        atomic_store_explicit(&versoes_contas[origem], versao + 1, memory_order_release);
+        registrar_wal(REGISTRO_TRANSFERENCIA, op_id, origem, destino, valor, epoca);
+    }
+    if (travada) {
+        pthread_mutex_unlock(&travas_contas[trava_da_conta(origem)].mutex);
+    }
+    if (!suficiente) {
+        LOG_OPERACAO("Operação %d: Transferência falhou: saldo insuficiente na conta %d\n", op_id, origem);
+        return false;
+    }
+    LOG_OPERACAO("Operação %d: Transferência de %.2f da conta %d para a conta %d\n", op_id, valor / 100.0,
+                 origem, destino);
+    return true;
+}
+
+// Operações com vários lançamentos (OP_LANCAMENTOS): todos os débitos são
+// conferidos antes de qualquer escrita e todas as escritas acontecem na mesma
+// época, então nem um balanço nem a reprodução do WAL enxergam metade delas
+unsigned long lancamentos_aplicados = 0;      // Lançamentos das operações aplicadas
+unsigned long operacoes_lancamentos_ok = 0;   // Operações aplicadas
+unsigned long operacoes_lancamentos_recusadas = 0; // Recusadas por saldo insuficiente
+
+static void contar_lancamentos(const Lancamentos *lancamentos, bool aplicou) {
+    if (aplicou) {
+        __sync_fetch_and_add(&operacoes_lancamentos_ok, 1);
+        __sync_fetch_and_add(&lancamentos_aplicados, lancamentos->quantidade);
+    } else {
+        __sync_fetch_and_add(&operacoes_lancamentos_recusadas, 1);
+    }
+}
+
+// Com as listras de todas as contas travadas (ou no executor em ondas, que já
+// as reserva para a thread) e a época anunciada. Retorna false se algum débito
+// deixaria a conta negativa; nada é alterado nesse caso
+bool aplicar_lancamentos(int op_id, const Lancamentos *lancamentos, unsigned int epoca) {
+    const Lancamento *itens = lancamentos->itens;
+    for (int i = 0; i < lancamentos->quantidade; i++) {
+        if (itens[i].valor < 0 && ler_saldo(itens[i].conta) < -itens[i].valor) {
+            LOG_OPERACAO("Operação %d: Lançamentos recusados: saldo insuficiente na conta %d\n", op_id,
+                         itens[i].conta);
+            contar_lancamentos(lancamentos, false);
+            return false;
+        }
+    }
+    int64_t movimentado = 0;
+    for (int i = 0; i < lancamentos->quantidade; i++) {
+        preparar_escrita(itens[i].conta, epoca);
+        gravar_saldo(itens[i].conta, ler_saldo(itens[i].conta) + itens[i].valor);
+        movimentado += itens[i].valor > 0 ? itens[i].valor : 0;
+    }
+    registrar_wal_lancamentos(op_id, lancamentos, epoca);
+    simular_custo();
+    contar_lancamentos(lancamentos, true);
+    LOG_OPERACAO("Operação %d: %d lançamentos aplicados, %.2f movimentados\n", op_id, lancamentos->quantidade,
+                 movimentado / 100.0);
+    return true;
+}
+
+// Versão otimista: assume, em ordem de conta, a versão de cada conta debitada; um
+// conflito devolve as versões já assumidas e recomeça. Depois de
+// cfg.tentativas_otimistas conflitos trava todas as listras da operação, como a
+// transferência, e então espera cada versão ficar livre em vez de desistir
+bool aplicar_lancamentos_otimista(int op_id, const Lancamentos *lancamentos, unsigned int epoca) {
+    const Lancamento *itens = lancamentos->itens;
+    unsigned int versoes[MAX_LANCAMENTOS];
+    bool suficiente = true;
+    bool travada = false;
+    int assumidas = 0;
+    int debitos = 0;
+    for (int i = 0; i < lancamentos->quantidade; i++) {
+        debitos += itens[i].valor < 0;
+    }
+    for (int tentativa = 0; assumidas < debitos; tentativa++) {
+        conflitos_locais += tentativa > 0;
+        if (tentativa == cfg.tentativas_otimistas) {
+            travar_listras(lancamentos->listras, lancamentos->num_listras);
+            travada = true;
+            recuos_locais++;
+        } else if (tentativa > 0) {
+            pausa_cpu();
+        }
+        assumidas = 0;
+        for (int i = 0; i < lancamentos->quantidade && suficiente; i++) {
+            if (itens[i].valor >= 0) {
+                continue;
+            }
+            unsigned int versao = assumir_versao(itens[i].conta, -itens[i].valor, travada, &suficiente);
+            if (versao == 0) {
+                break;
+            }
+            versoes[assumidas++] = versao;
+        }
+        if (assumidas < debitos) {
+            // Devolve as versões assumidas; o saldo dessas contas não foi alterado
+            for (int i = 0, k = 0; k < assumidas; i++) {
+                if (itens[i].valor < 0) {
+                    atomic_store_explicit(&versoes_contas[itens[i].conta], versoes[k++] + 1, memory_order_release);
+                }
+            }
+        }
+        if (!suficiente) {
+            break;
+        }
+    }
+    int64_t movimentado = 0;
+    if (suficiente) {
+        for (int i = 0; i < lancamentos->quantidade; i++) {
+            preparar_escrita_otimista(itens[i].conta, epoca);
+            __atomic_fetch_add(&saldos_contas[itens[i].conta], itens[i].valor, __ATOMIC_RELEASE);
+            movimentado += itens[i].valor > 0 ? itens[i].valor : 0;
+        }
+        for (int i = 0, k = 0; k < assumidas; i++) {
+            if (itens[i].valor < 0) {
+                atomic_store_explicit(&versoes_contas[itens[i].conta], versoes[k++] + 1, memory_order_release);
+            }
+        }
+        registrar_wal_lancamentos(op_id, lancamentos, epoca);
+    }
+    if (travada) {
+        destravar_listras(lancamentos->listras, lancamentos->num_listras);
+    }
+    contar_lancamentos(lancamentos, suficiente);
+    if (!suficiente) {
+        LOG_OPERACAO("Operação %d: Lançamentos recusados: saldo insuficiente\n", op_id);
+        return false;
+    }
+    LOG_OPERACAO("Operação %d: %d lançamentos aplicados, %.2f movimentados\n", op_id, lancamentos->quantidade,
+                 movimentado / 100.0);
+    return true;
+}
+
+// Repassa aos totais os conflitos contados pela thread durante o lote
+static void publicar_conflitos(void) {
+    if (conflitos_locais != 0) {
+        __sync_fetch_and_add(&conflitos_otimistas, conflitos_locais);
+        conflitos_locais = 0;
+    }
+    if (recuos_locais != 0) {
+        __sync_fetch_and_add(&recuos_para_travas, recuos_locais);
+        recuos_locais = 0;
+    }
+}
+
+// Verificação sob estresse. Com --estresse cada requisição que recebe um id tem
+// exatamente um destino: concluída, descartada na drenagem ou recusada pela
+// admissão. Ao final a tabela de destinos acusa os ids perdidos (nenhum destino)
+// e os duplicados (mais de um), e a auditoria confere o dinheiro.
+// Com --gravar-execucao cada operação aplicada é anotada com a sua época e um
+// número de ordem tomado enquanto as contas dela estão exclusivas (listras
+// travadas ou, nas ondas, reservadas para a thread): duas operações sobre a mesma
+// conta ficam na ordem em que de fato ocorreram. Balanços e juros vão para o fim
+// da época que leram ou escreveram. Ordenada por época e ordem, a gravação é uma
+// execução em série equivalente à concorrente; --reproduzir-execucao a reaplica
+// numa única thread e confere cada resultado e os saldos finais. A mesma gravação
+// sempre se reproduz igual, e uma escrita perdida ou duplicada por uma corrida
+// aparece como divergência. O motor otimista credita sem exclusão e não tem esse
+// ponto de ordem, então não pode ser gravado. Sob o ThreadSanitizer:
+//   gcc -O1 -g -fsanitize=thread -pthread [-DFILA_LOCKFREE] -o servidor_tsan servidor_v2.c -lm
+//   ./servidor_tsan --estresse --gravar-execucao exec.bin && ./servidor_tsan --reproduzir-execucao exec.bin
+#define EXECUCAO_MAGICA 0x45584531   // "EXE1" no cabeçalho do arquivo de execução
+#define EXECUCAO_RODAPE 0x46494D31   // "FIM1" no rodapé, depois do último registro
+#define BITS_BLOCO_DESTINOS 20       // Ids por bloco da tabela de destinos (2^20)
+#define MAX_BLOCOS_DESTINOS (1 << (31 - BITS_BLOCO_DESTINOS))
+#define DIVERGENCIAS_DESCRITAS 10    // Divergências da reprodução descritas uma a uma
+
+typedef struct {
+    uint32_t magica;
+    uint32_t tamanho_registro;
+    int32_t num_contas;
+    int32_t saldo_inicial; // Em centavos, o mesmo para todas as contas
+} CabecalhoExecucao;
+
+// Uma operação aplicada; uma com lançamentos é seguida pelos seus Lancamento
+typedef struct {
+    uint32_t epoca;
+    uint8_t operacao;
+    uint8_t resultado;   // RESULTADO_*
+    uint16_t longa;      // 1 em balanços e juros, que vêm depois das demais operações da época
+    uint64_t ordem;
+    int32_t id;
+    int32_t origem;      // Em OP_LANCAMENTOS, quantos Lancamento seguem o registro
+    int32_t destino;
+    int32_t reservado;
+    int64_t valor;       // Fator nos juros; total em contas no balanço
+} RegistroExecucao;
+
+// Estado final a que a reprodução deve chegar
+typedef struct {
+    uint32_t magica;
+    uint32_t soma_saldos; // FNV-1a dos saldos finais
+    uint64_t registros;
+    int64_t total;
+} RodapeExecucao;
+
+_Static_assert(sizeof(RegistroExecucao) == 40, "RegistroExecucao deve ter 40 bytes");
+
+// Registros de execução de uma thread; só ela escreve, e a gravação só os lê
+// depois que todas as threads terminaram
+typedef struct BufferExecucao {
+    char *dados;
+    size_t usado;
+    size_t capacidade;
+    unsigned long registros;
+    struct BufferExecucao *proximo;
+} BufferExecucao;
+
+static _Atomic(atomic_uchar *) blocos_destinos[MAX_BLOCOS_DESTINOS];
+static _Thread_local BufferExecucao *execucao_local = NULL;
+static _Atomic(BufferExecucao *) buffers_execucao = NULL;
+static atomic_ulong ordem_execucao = 0;
+
+// Conta um destino para o id; o bloco é criado pela primeira thread que o toca
+static void marcar_destino(int id) {
+    _Atomic(atomic_uchar *) *entrada = &blocos_destinos[id >> BITS_BLOCO_DESTINOS];
+    atomic_uchar *bloco = atomic_load_explicit(entrada, memory_order_acquire);
+    if (bloco == NULL) {
+        atomic_uchar *novo = calloc((size_t)1 << BITS_BLOCO_DESTINOS, sizeof(atomic_uchar));
+        if (novo == NULL) {
+            perror("Falha ao alocar tabela de destinos");
+            exit(EXIT_FAILURE);
+        }
+        if (atomic_compare_exchange_strong_explicit(entrada, &bloco, novo, memory_order_acq_rel,
+                                                    memory_order_acquire)) {
+            bloco = novo;
+        } else {
+            free(novo);
+        }
+    }
+    atomic_fetch_add_explicit(&bloco[id & ((1 << BITS_BLOCO_DESTINOS) - 1)], 1, memory_order_relaxed);
+}
+
+static inline void marcar_destinos(const Requisicao *lote, int quantidade) {
+    for (int i = 0; i < quantidade; i++) {
+        marcar_destino(lote[i].id);
+    }
+}
+
+// Confere, com todas as threads encerradas, os destinos dos ids 0 a total - 1
+static bool verificar_destinos(int total, FILE *destino) {
+    unsigned long perdidas = 0, duplicadas = 0;
+    int primeira_perdida = -1, primeira_duplicada = -1;
+    for (int id = 0; id < total; id++) {
+        atomic_uchar *bloco = atomic_load(&blocos_destinos[id >> BITS_BLOCO_DESTINOS]);
+        unsigned int destinos = bloco != NULL ? atomic_load_explicit(&bloco[id & ((1 << BITS_BLOCO_DESTINOS) - 1)],
+                                                                     memory_order_relaxed) : 0;
+        if (destinos == 0) {
+            primeira_perdida = perdidas++ == 0 ? id : primeira_perdida;
+        } else if (destinos > 1) {
+            primeira_duplicada = duplicadas++ == 0 ? id : primeira_duplicada;
+        }
+    }
+    for (int b = 0; b < MAX_BLOCOS_DESTINOS; b++) {
+        free(atomic_load(&blocos_destinos[b]));
+    }
+    fprintf(destino, "Estresse: %d requisições com id, %lu perdidas (primeira %d), %lu duplicadas (primeira %d)\n",
+            total, perdidas, primeira_perdida, duplicadas, primeira_duplicada);
+    return perdidas == 0 && duplicadas == 0;
+}
+
+static void anotar_execucao(RegistroExecucao *registro, const Lancamentos *lancamentos) {
+    BufferExecucao *buffer = execucao_local;
+    if (buffer == NULL) {
+        buffer = calloc(1, sizeof(BufferExecucao));
+        if (buffer == NULL) {
+            perror("Falha ao alocar buffer de execução");
+            exit(EXIT_FAILURE);
+        }
+        buffer->proximo = atomic_load(&buffers_execucao);
+        while (!atomic_compare_exchange_weak(&buffers_execucao, &buffer->proximo, buffer)) {
+        }
+        execucao_local = buffer;
+    }
+    size_t bytes_itens = lancamentos != NULL ? lancamentos->quantidade * sizeof(Lancamento) : 0;
+    size_t n = sizeof(RegistroExecucao) + bytes_itens;
+    if (buffer->usado + n > buffer->capacidade) {
+        size_t capacidade = buffer->capacidade > 0 ? buffer->capacidade : 1 << 20;
+        while (capacidade < buffer->usado + n) {
+            capacidade *= 2;
+        }
+        char *dados = realloc(buffer->dados, capacidade);
+        if (dados == NULL) {
+            perror("Falha ao ampliar buffer de execução");
+            exit(EXIT_FAILURE);
+        }
+        buffer->dados = dados;
+        buffer->capacidade = capacidade;
+    }
+    // A ordem é tomada por último, ainda com as contas exclusivas: entre duas
+    // operações da mesma conta, a que ocorreu antes incrementa o contador antes
+    registro->ordem = atomic_fetch_add_explicit(&ordem_execucao, 1, memory_order_relaxed);
+    memcpy(buffer->dados + buffer->usado, registro, sizeof(RegistroExecucao));
+    if (bytes_itens > 0) {
+        memcpy(buffer->dados + buffer->usado + sizeof(RegistroExecucao), lancamentos->itens, bytes_itens);
+    }
+    buffer->usado += n;
+    buffer->registros++;
+}
+
+// Depósito, transferência ou lançamentos já aplicados, com as contas ainda exclusivas
+static void anotar_operacao(const Requisicao *req, unsigned int epoca) {
+    RegistroExecucao registro = {
+        .epoca = epoca, .operacao = (uint8_t)req->operacao, .resultado = (uint8_t)req->resultado,
+        .id = req->id, .origem = req->id_origem, .destino = req->id_destino, .valor = req->valor,
+    };
+    if (req->operacao == OP_LANCAMENTOS) {
+        registro.origem = req->lancamentos->quantidade;
+    }
+    anotar_execucao(&registro, req->operacao == OP_LANCAMENTOS ? req->lancamentos : NULL);
+}
+
+// Balanço (valor = total lido) ou juros (valor = fator) na época indicada
+static void anotar_longa(int operacao, int op_id, unsigned int epoca, int64_t valor) {
+    RegistroExecucao registro = {
+        .epoca = epoca, .operacao = (uint8_t)operacao, .resultado = RESULTADO_OK, .longa = 1,
+        .id = op_id, .origem = -1, .destino = -1, .valor = valor,
+    };
+    anotar_execucao(&registro, NULL);
+}
+
+static int comparar_registros_execucao(const void *a, const void *b) {
+    const RegistroExecucao *x = *(const RegistroExecucao *const *)a, *y = *(const RegistroExecucao *const *)b;
+    if (x->epoca != y->epoca) {
+        return x->epoca < y->epoca ? -1 : 1;
+    }
+    if (x->longa != y->longa) {
+        return x->longa < y->longa ? -1 : 1;
+    }
+    return (x->ordem > y->ordem) - (x->ordem < y->ordem);
+}
+
+static inline size_t tamanho_registro_execucao(const RegistroExecucao *registro) {
+    return sizeof(RegistroExecucao) +
+           (registro->operacao == OP_LANCAMENTOS ? (size_t)registro->origem * sizeof(Lancamento) : 0);
+}
+
+// Grava os registros de todas as threads na ordem em série, seguidos dos saldos
+// finais resumidos. Chamada com as threads encerradas e tudo drenado
+void gravar_execucao(const char *caminho, FILE *destino) {
+    unsigned long total = 0;
+    for (BufferExecucao *b = atomic_load(&buffers_execucao); b != NULL; b = b->proximo) {
+        total += b->registros;
+    }
+    RegistroExecucao **ordenados = malloc((total + 1) * sizeof(RegistroExecucao *));
+    if (ordenados == NULL) {
+        perror("Falha ao alocar gravação da execução");
+        exit(EXIT_FAILURE);
+    }
+    unsigned long n = 0;
+    for (BufferExecucao *b = atomic_load(&buffers_execucao); b != NULL; b = b->proximo) {
+        for (size_t pos = 0; pos < b->usado; pos += tamanho_registro_execucao(ordenados[n - 1])) {
+            ordenados[n++] = (RegistroExecucao *)(b->dados + pos);
+        }
+    }
+    qsort(ordenados, n, sizeof(RegistroExecucao *), comparar_registros_execucao);
+
+    FILE *arquivo = fopen(caminho, "wb");
+    if (arquivo == NULL) {
+        perror("Falha ao criar arquivo de execução");
+        exit(EXIT_FAILURE);
+    }
+    CabecalhoExecucao cabecalho = {EXECUCAO_MAGICA, sizeof(RegistroExecucao), cfg.num_contas, SALDO_INICIAL};
+    bool gravou = fwrite(&cabecalho, sizeof(cabecalho), 1, arquivo) == 1;
+    for (unsigned long i = 0; i < n && gravou; i++) {
+        gravou = fwrite(ordenados[i], tamanho_registro_execucao(ordenados[i]), 1, arquivo) == 1;
+    }
+    int64_t soma = 0;
+    for (int i = 0; i < cfg.num_contas; i++) {
+        soma += ler_saldo(i);
+    }
+    RodapeExecucao rodape = {EXECUCAO_RODAPE, soma_fnv1a(saldos_contas, cfg.num_contas * sizeof(int64_t)), n, soma};
+    gravou = gravou && fwrite(&rodape, sizeof(rodape), 1, arquivo) == 1;
+    if (fclose(arquivo) != 0 || !gravou) {
+        perror("Falha ao gravar arquivo de execução");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(destino, "Execução: %lu operações gravadas em %s na ordem em série\n", n, caminho);
+
+    free(ordenados);
+    BufferExecucao *buffer = atomic_exchange(&buffers_execucao, NULL);
+    while (buffer != NULL) {
+        BufferExecucao *proximo = buffer->proximo;
+        free(buffer->dados);
+        free(buffer);
+        buffer = proximo;
+    }
+}
+
+static int comparar_ids(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static const char *nome_resultado(int resultado) {
+    return resultado == RESULTADO_OK ? "ok" : resultado == RESULTADO_SALDO_INSUFICIENTE ? "saldo insuficiente"
+                                                                                        : "inválido";
+}
+
+// Reaplica em série, numa única thread, uma execução gravada com --gravar-execucao
+// e confere cada resultado, o total de cada balanço e os saldos finais. Retorna
+// true se tudo conferiu
+bool reproduzir_execucao(const char *caminho) {
+    FILE *arquivo = fopen(caminho, "rb");
+    if (arquivo == NULL) {
+        perror("Falha ao abrir arquivo de execução");
+        exit(EXIT_FAILURE);
+    }
+    fseek(arquivo, 0, SEEK_END);
+    long tamanho = ftell(arquivo);
+    fseek(arquivo, 0, SEEK_SET);
+    char *dados = tamanho > 0 ? malloc(tamanho) : NULL;
+    if (dados == NULL || fread(dados, 1, tamanho, arquivo) != (size_t)tamanho) {
+        fprintf(stderr, "Falha ao ler arquivo de execução: %s\n", caminho);
+        exit(EXIT_FAILURE);
+    }
+    fclose(arquivo);
+    CabecalhoExecucao cabecalho;
+    RodapeExecucao rodape;
+    if ((size_t)tamanho < sizeof(cabecalho) + sizeof(rodape)) {
+        fprintf(stderr, "Arquivo de execução inválido: %s\n", caminho);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&cabecalho, dados, sizeof(cabecalho));
+    memcpy(&rodape, dados + tamanho - sizeof(rodape), sizeof(rodape));
+    if (cabecalho.magica != EXECUCAO_MAGICA || cabecalho.tamanho_registro != sizeof(RegistroExecucao) ||
+        cabecalho.num_contas < 1 || rodape.magica != EXECUCAO_RODAPE) {
+        fprintf(stderr, "Arquivo de execução inválido ou incompleto: %s\n", caminho);
+        exit(EXIT_FAILURE);
+    }
+
+    int num_contas = cabecalho.num_contas;
+    int64_t *saldos = malloc(num_contas * sizeof(int64_t));
+    int32_t *ids = malloc((rodape.registros + 1) * sizeof(int32_t));
+    if (saldos == NULL || ids == NULL) {
+        perror("Falha ao alocar reprodução da execução");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_contas; i++) {
+        saldos[i] = cabecalho.saldo_inicial;
+    }
+
+    unsigned long registros = 0, balancos = 0, juros = 0, divergentes = 0;
+    size_t pos = sizeof(cabecalho), fim = tamanho - sizeof(rodape);
+    uint64_t inicio = agora_ns();
+    while (pos < fim) {
+        RegistroExecucao registro;
+        if (fim - pos < sizeof(registro)) {
+            break;
+        }
+        memcpy(&registro, dados + pos, sizeof(registro));
+        size_t n = tamanho_registro_execucao(&registro);
+        bool contas_validas = registro.operacao == OP_BALANCO || registro.operacao == OP_JUROS ||
+                              (registro.origem >= 0 && registro.origem < num_contas &&
+                               (registro.operacao != OP_TRANSFERENCIA ||
+                                (registro.destino >= 0 && registro.destino < num_contas)));
+        if (registro.operacao == OP_LANCAMENTOS) {
+            contas_validas = registro.origem >= 1 && registro.origem <= MAX_LANCAMENTOS;
+        }
+        if (!contas_validas || n > fim - pos) {
+            fprintf(stderr, "Registro inválido na posição %zu de %s\n", pos, caminho);
+            exit(EXIT_FAILURE);
+        }
+        int resultado = RESULTADO_OK;
+        int64_t lido = registro.valor;
+        if (registro.operacao == OP_DEPOSITO) {
+            if (saldos[registro.origem] > LIMITE_SALDO - registro.valor) {
+                resultado = RESULTADO_INVALIDO;
+            } else {
+                saldos[registro.origem] += registro.valor;
+            }
+        } else if (registro.operacao == OP_TRANSFERENCIA) {
+            if (saldos[registro.origem] >= registro.valor) {
+                saldos[registro.origem] -= registro.valor;
+                saldos[registro.destino] += registro.valor;
+            } else {
+                resultado = RESULTADO_SALDO_INSUFICIENTE;
+            }
+        } else if (registro.operacao == OP_LANCAMENTOS) {
+            Lancamento itens[MAX_LANCAMENTOS];
+            memcpy(itens, dados + pos + sizeof(registro), registro.origem * sizeof(Lancamento));
+            for (int i = 0; i < registro.origem; i++) {
+                if (itens[i].conta < 0 || itens[i].conta >= num_contas) {
+                    fprintf(stderr, "Lançamento inválido na posição %zu de %s\n", pos, caminho);
+                    exit(EXIT_FAILURE);
+                }
+                if (itens[i].valor < 0 && saldos[itens[i].conta] < -itens[i].valor) {
+                    resultado = RESULTADO_SALDO_INSUFICIENTE;
+                }
+            }
+            for (int i = 0; i < registro.origem && resultado == RESULTADO_OK; i++) {
+                saldos[itens[i].conta] += itens[i].valor;
+            }
+        } else if (registro.operacao == OP_BALANCO) {
+            lido = nucleos.somar(saldos, num_contas);
+            balancos++;
+        } else if (registro.operacao == OP_JUROS) {
+            nucleos.aplicar_juros(saldos, num_contas, (uint32_t)registro.valor);
+            juros++;
+        } else {
+            fprintf(stderr, "Operação %u desconhecida na posição %zu de %s\n", registro.operacao, pos, caminho);
+            exit(EXIT_FAILURE);
+        }
+        if (resultado != registro.resultado || lido != registro.valor) {
+            if (divergentes++ < DIVERGENCIAS_DESCRITAS) {
+                fprintf(stderr, "Execução DIVERGENTE: operação %d (tipo %u, época %u, ordem %llu) gravada com %s "
+                        "(valor %.2f), reproduzida com %s (valor %.2f)\n", registro.id, registro.operacao,
+                        registro.epoca, (unsigned long long)registro.ordem, nome_resultado(registro.resultado),
+                        registro.valor / 100.0, nome_resultado(resultado), lido / 100.0);
+            }
+        }
+        if (registros < rodape.registros) {
+            ids[registros] = registro.id;
+        }
+        registros++;
+        pos += n;
+    }
+    double micros = (agora_ns() - inicio) / 1000.0;
+
+    // Nenhuma requisição pode ter sido aplicada duas vezes
+    unsigned long repetidos = 0;
+    unsigned long conferidos = registros < rodape.registros ? registros : rodape.registros;
+    qsort(ids, conferidos, sizeof(int32_t), comparar_ids);
+    for (unsigned long i = 1; i < conferidos; i++) {
+        repetidos += ids[i] == ids[i - 1];
+    }
+    int64_t total = nucleos.somar(saldos, num_contas);
+    bool saldos_conferem = total == rodape.total &&
+                           soma_fnv1a(saldos, num_contas * sizeof(int64_t)) == rodape.soma_saldos;
+    bool confere = pos == fim && registros == rodape.registros && divergentes == 0 && repetidos == 0 &&
+                   saldos_conferem;
+    printf("Execução reproduzida em série: %lu de %llu operações de %s (%lu balanços, %lu juros) em %.1f us; "
+           "%lu resultados divergentes, %lu ids aplicados mais de uma vez; total final %.2f (gravado %.2f), "
+           "saldos finais %s: %s\n",
+           registros, (unsigned long long)rodape.registros, caminho, balancos, juros, micros, divergentes, repetidos,
+           total / 100.0, rodape.total / 100.0, saldos_conferem ? "conferem" : "DIVERGENTES",
+           confere ? "confere" : "DIVERGENTE");
+    free(dados);
+    free(saldos);
+    free(ids);
+    return confere;
+}
+
+// Balanço sobre um snapshot consistente: troca a época, espera os escritores da
+// época encerrada e lê os saldos sem travar as contas, enquanto as demais
+// operações seguem na nova época. O total confere com o dinheiro depositado.
+// Confere os agregados com os saldos de um snapshot da época que eles descrevem,
+// varrendo todas as contas; uma divergência é descrita em stderr
+static bool conferir_agregados(const int64_t *saldos, unsigned int epoca) {
+    int diferentes = 0;
+    long abaixo = 0;
+    int baldes_divergentes = 0;
+    for (int b = 0; b < cfg.baldes_agregados; b++) {
+        int64_t soma = 0;
+        for (int i = inicio_do_balde(b); i < inicio_do_balde(b + 1); i++) {
+            soma += saldos[i];
+            diferentes += saldos[i] != agregados.saldos[i];
+            abaixo += saldos[i] < cfg.limiar_saldo;
+        }
+        baldes_divergentes += soma != agregados.somas_baldes[b];
+    }
+    int64_t minimo, maximo;
+    nucleos.extremos(saldos, cfg.num_contas, &minimo, &maximo);
+    bool confere = diferentes == 0 && baldes_divergentes == 0 && abaixo == agregados.abaixo_limiar &&
+                   minimo == agregados.saldos[agregados.menores.contas[0]] &&
+                   maximo == agregados.saldos[agregados.maiores.contas[0]];
+    agregados.conferencias++;
+    if (!confere) {
+        agregados.divergencias++;
+        fprintf(stderr, "Agregados DIVERGENTES na época %u: %d contas e %d baldes diferentes, %ld abaixo do "
+                "limiar (agregado %ld), menor %.2f (agregado %.2f), maior %.2f (agregado %.2f)\n",
+                epoca, diferentes, baldes_divergentes, abaixo, agregados.abaixo_limiar, minimo / 100.0,
+                agregados.saldos[agregados.menores.contas[0]] / 100.0, maximo / 100.0,
+                agregados.saldos[agregados.maiores.contas[0]] / 100.0);
+    }
+    return confere;
+}
+
+// Balanço respondido pelos agregados, em O(baldes), depois que fechar_epoca dobrou
+// a época. A cada cfg.conferir_agregados balanços também varre as contas e os confere
+static int64_t balanco_agregado(int op_id, unsigned int epoca) {
+    int64_t total = 0;
+    for (int b = 0; b < cfg.baldes_agregados; b++) {
+        total += agregados.somas_baldes[b];
+    }
+    int64_t esperado = (int64_t)SALDO_INICIAL * cfg.num_contas + total_depositado;
+    int menor = agregados.menores.contas[0], maior = agregados.maiores.contas[0];
+    agregados.balancos++;
+    if (cfg.conferir_agregados > 0 && agregados.balancos % cfg.conferir_agregados == 0) {
+        for (int i = 0; i < cfg.num_contas; i++) {
+            saldos_snapshot[i] = ler_saldo_snapshot(i, epoca);
+        }
+        conferir_agregados(saldos_snapshot, epoca);
+    }
+    simular_custo();
+
+    LOG_OPERACAO("Operação %d: Balanço geral (época %u, pelos agregados):\n", op_id, epoca);
+    for (int b = 0; b < cfg.baldes_agregados; b++) {
+        LOG_OPERACAO("Contas %d a %d: Soma = %.2f\n", inicio_do_balde(b), inicio_do_balde(b + 1) - 1,
+                     agregados.somas_baldes[b] / 100.0);
+    }
+    LOG_OPERACAO("Total em contas: %.2f (esperado %.2f, %s); menor saldo %.2f (conta %d), maior %.2f (conta %d); "
+                 "%ld contas abaixo de %.2f\n", total / 100.0, esperado / 100.0,
+                 total == esperado ? "confere" : "DIVERGENTE", agregados.saldos[menor] / 100.0, menor,
+                 agregados.saldos[maior] / 100.0, maior, agregados.abaixo_limiar, cfg.limiar_saldo / 100.0);
+    return total;
+}
+
+// Retorna o total em contas
+int64_t balanco(int op_id) {
+    pthread_mutex_lock(&mutex_snapshot);
+    unsigned int epoca = fechar_epoca();
+    if (agregados.ativos) {
+        int64_t total = balanco_agregado(op_id, epoca);
+        if (cfg.gravar_execucao != NULL) {
+            anotar_longa(OP_BALANCO, op_id, epoca, total);
+        }
+        pthread_mutex_unlock(&mutex_snapshot);
+        return total;
+    }
+    for (int i = 0; i < cfg.num_contas; i++) {
+        saldos_snapshot[i] = ler_saldo_snapshot(i, epoca);
+    }
+    int64_t total = nucleos.somar(saldos_snapshot, cfg.num_contas);
+    int64_t esperado = (int64_t)SALDO_INICIAL * cfg.num_contas + total_depositado;
+    int64_t minimo, maximo;
+    nucleos.extremos(saldos_snapshot, cfg.num_contas, &minimo, &maximo);
+    simular_custo();
+
+    LOG_OPERACAO("Operação %d: Balanço geral (época %u):\n", op_id, epoca);
+    for (int i = 0; i < cfg.num_contas; i++) {
+        LOG_OPERACAO("Conta %d: Saldo = %.2f\n", ids_contas[i], saldos_snapshot[i] / 100.0);
+    }
+    LOG_OPERACAO("Total em contas: %.2f (esperado %.2f, %s); menor saldo %.2f, maior %.2f\n", total / 100.0,
+                 esperado / 100.0, total == esperado ? "confere" : "DIVERGENTE", minimo / 100.0, maximo / 100.0);
+    if (cfg.gravar_execucao != NULL) {
+        anotar_longa(OP_BALANCO, op_id, epoca, total);
+    }
+    pthread_mutex_unlock(&mutex_snapshot);
+    return total;
+}
+
+// Com --otimista os escritores não travam listras: os juros fecham a porta de
+// entrar_epoca_otimista e esperam quem já anunciou época sair
+static void excluir_escritores_otimistas(void) {
+    atomic_store(&juros_em_andamento, true);
+    for (int t = 0; t < cfg.num_threads; t++) {
+        int giros = 0;
+        while (atomic_load(&slots_epoca[t].epoca) != 0) {
+            aguardar_um_pouco(&giros);
+        }
+    }
+}
+
+// Aplica juros a todas as contas de uma vez com o núcleo vetorial. Trava todas as
+// listras (ou, com --otimista, barra os escritores) e roda numa época própria,
+// fechada antes e depois, de modo que um balanço vê os juros inteiros ou nada
+// deles. Com WAL, o registro dos juros entra no arquivo depois dos registros que
+// os precedem e antes dos seguintes, como a reprodução exige
+void aplicar_juros(int op_id) {
+    uint32_t fator = fator_de_juros(cfg.juros_pontos_base);
+    pthread_mutex_lock(&mutex_snapshot);
+    if (cfg.otimista) {
+        excluir_escritores_otimistas();
+    } else {
+        for (int t = 0; t < cfg.num_travas; t++) {
+            pthread_mutex_lock(&travas_contas[t].mutex);
+        }
+    }
+    fechar_epoca();
+    aguardar_wal_recolher();
+    unsigned int epoca = atomic_load(&epoca_global);
+    int64_t creditado = nucleos.aplicar_juros(saldos_contas, cfg.num_contas, fator);
+    registrar_wal(REGISTRO_JUROS, op_id, -1, -1, fator, epoca);
+    if (cfg.gravar_execucao != NULL) {
+        anotar_longa(OP_JUROS, op_id, epoca, fator);
+    }
+    aguardar_wal_recolher();
+    total_depositado += creditado;
+    fechar_epoca();
+    if (agregados.ativos) {
+        reconstruir_agregados();
+    }
+    if (cfg.otimista) {
+        atomic_store(&juros_em_andamento, false);
+    } else {
+        for (int t = cfg.num_travas - 1; t >= 0; t--) {
+            pthread_mutex_unlock(&travas_contas[t].mutex);
+        }
+    }
+    pthread_mutex_unlock(&mutex_snapshot);
+    LOG_OPERACAO("Operação %d: Juros de %d pontos-base aplicados a %d contas (%.2f creditados)\n",
+                 op_id, cfg.juros_pontos_base, cfg.num_contas, creditado / 100.0);
+}
+
+static int comparar_inteiros(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Preenche listras com as travas tocadas pelo lote, ordenadas e sem repetição
+// (balanços, juros e lançamentos travam por conta própria). listras deve
+// comportar 2 * quantidade
+int coletar_listras(const Requisicao *lote, int quantidade, int *listras) {
+    int n = 0;
+    for (int i = 0; i < quantidade; i++) {
+        if (lote[i].operacao != 1 && lote[i].operacao != 2) {
+            continue;
+        }
+        listras[n++] = trava_da_conta(lote[i].id_origem);
+        if (lote[i].operacao == 2) {
+            listras[n++] = trava_da_conta(lote[i].id_destino);
+        }
+    }
+    qsort(listras, n, sizeof(int), comparar_inteiros);
+    int unicas = 0;
+    for (int i = 0; i < n; i++) {
+        if (unicas == 0 || listras[unicas - 1] != listras[i]) {
+            listras[unicas++] = listras[i];
+        }
+    }
+    return unicas;
+}
+
+// Cache de idempotência: guarda o resultado de cada requisição com chave, para que
+// uma repetição (o cliente reenviando após um tempo esgotado) receba a resposta
+// original sem passar de novo pelas contas. É dividido em fragmentos escolhidos
+// pelo hash da chave, cada um com sua trava, tabela de endereçamento aberto e lista
+// LRU; as seções críticas são curtas e raramente disputadas
+#define MAX_FRAGMENTOS_DEDUP 256
+
+typedef struct {
+    uint64_t chave;       // 0 = entrada livre
+    uint64_t instante_ns; // Reserva ou conclusão; a entrada vence cfg.dedup_ttl_ms depois
+    int64_t saldo_final;
+    uint32_t impressao;   // Resumo do conteúdo, para recusar a chave reaproveitada noutro pedido
+    int32_t id_operacao;
+    int32_t mais_nova;    // Vizinhas na lista LRU (índices em entradas; -1 nas pontas)
+    int32_t mais_velha;
+    bool concluida;       // false enquanto a primeira execução está em andamento
+    uint8_t resultado;
+} EntradaDedup;
+
+// Posição da tabela; o hash guardado nela evita tocar as entradas de outras chaves
+// durante a sondagem e na remoção
+typedef struct {
+    int32_t indice;       // Em entradas; -1 = posição vazia
+    uint32_t hash;        // 32 bits baixos do hash da chave
+} PosicaoDedup;
+
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) pthread_mutex_t trava;
+    PosicaoDedup *posicoes; // Sondagem linear, com ao menos o dobro das entradas
+    EntradaDedup *entradas;
+    uint32_t mascara;
+    int32_t livre;        // Pilha de entradas livres, encadeadas por mais_velha
+    int32_t mais_nova;    // Pontas da lista LRU
+    int32_t mais_velha;
+    unsigned long consultas;     // Estatísticas protegidas pela trava do fragmento
+    unsigned long repetidas;
+    unsigned long em_andamento;
+    unsigned long reaproveitadas;
+    unsigned long expiradas;
+    unsigned long despejadas;
+    unsigned long lotados;       // Chaves novas recusadas com o fragmento cheio de entradas em andamento
+} FragmentoDedup;
+
+FragmentoDedup *fragmentos_dedup = NULL; // NULL = cache desativado
+int num_fragmentos_dedup = 0;
+uint64_t ttl_dedup_ns = 0;
+
+static inline uint64_t hash_chave(uint64_t chave) {
+    chave ^= chave >> 33;
+    chave *= 0xFF51AFD7ED558CCDULL;
+    chave ^= chave >> 33;
+    chave *= 0xC4CEB9FE1A85EC53ULL;
+    return chave ^ (chave >> 33);
+}
+
+static inline uint32_t impressao_requisicao(const Requisicao *req) {
+    uint64_t h = hash_chave(((uint64_t)(uint32_t)req->operacao << 32) ^ (uint32_t)req->id_origem);
+    h = hash_chave(h ^ ((uint64_t)(uint32_t)req->id_destino << 32) ^ (uint64_t)req->valor);
+    const Lancamentos *lancamentos = req->lancamentos;
+    for (int i = 0; lancamentos != NULL && i < lancamentos->quantidade; i++) {
+        h = hash_chave(h ^ ((uint64_t)(uint32_t)lancamentos->itens[i].conta << 32) ^
+                       (uint64_t)lancamentos->itens[i].valor);
+    }
+    return (uint32_t)h;
+}
+
+void inicializar_dedup(void) {
+    if (cfg.dedup_entradas == 0) {
+        return;
+    }
+    // Fragmentos com ao menos 64 entradas, para que a LRU de cada um ainda faça sentido
+    num_fragmentos_dedup = 1;
+    while (num_fragmentos_dedup < MAX_FRAGMENTOS_DEDUP && num_fragmentos_dedup * 128 <= cfg.dedup_entradas) {
+        num_fragmentos_dedup *= 2;
+    }
+    int por_fragmento = (cfg.dedup_entradas + num_fragmentos_dedup - 1) / num_fragmentos_dedup;
+    uint32_t posicoes = 2;
+    while (posicoes < 2 * (uint32_t)por_fragmento) {
+        posicoes *= 2;
+    }
+    ttl_dedup_ns = (uint64_t)cfg.dedup_ttl_ms * 1000000ULL;
+    fragmentos_dedup = alocar_alinhado(num_fragmentos_dedup * sizeof(FragmentoDedup), "fragmentos do cache de idempotência");
+    for (int f = 0; f < num_fragmentos_dedup; f++) {
+        FragmentoDedup *fragmento = &fragmentos_dedup[f];
+        memset(fragmento, 0, sizeof(*fragmento));
+        pthread_mutex_init(&fragmento->trava, NULL);
+        fragmento->posicoes = alocar_alinhado(posicoes * sizeof(PosicaoDedup), "posições do cache de idempotência");
+        fragmento->entradas = alocar_alinhado(por_fragmento * sizeof(EntradaDedup), "entradas do cache de idempotência");
+        fragmento->mascara = posicoes - 1;
+        for (uint32_t p = 0; p < posicoes; p++) {
+            fragmento->posicoes[p].indice = -1;
+        }
+        for (int i = 0; i < por_fragmento; i++) {
+            fragmento->entradas[i].chave = 0;
+            fragmento->entradas[i].mais_velha = i + 1 < por_fragmento ? i + 1 : -1;
+        }
+        fragmento->livre = 0;
+        fragmento->mais_nova = -1;
+        fragmento->mais_velha = -1;
+    }
+}
+
+void liberar_dedup(void) {
+    for (int f = 0; f < num_fragmentos_dedup; f++) {
+        pthread_mutex_destroy(&fragmentos_dedup[f].trava);
+        free(fragmentos_dedup[f].posicoes);
+        free(fragmentos_dedup[f].entradas);
+    }
+    free(fragmentos_dedup);
+    fragmentos_dedup = NULL;
+}
+
+static inline FragmentoDedup *fragmento_da_chave(uint64_t hash) {
+    return &fragmentos_dedup[(hash >> 32) & (uint64_t)(num_fragmentos_dedup - 1)];
+}
+
+// Posição da chave na tabela do fragmento ou, se ausente, a posição vazia que encerra a sondagem
+static uint32_t sondar_dedup(const FragmentoDedup *fragmento, uint64_t chave, uint64_t hash) {
+    uint32_t posicao = (uint32_t)hash & fragmento->mascara;
+    for (;;) {
+        const PosicaoDedup *atual = &fragmento->posicoes[posicao];
+        if (atual->indice < 0 || (atual->hash == (uint32_t)hash && fragmento->entradas[atual->indice].chave == chave)) {
+            return posicao;
+        }
+        posicao = (posicao + 1) & fragmento->mascara;
+    }
+}
+
+static void desligar_lru(FragmentoDedup *fragmento, int32_t indice) {
+    EntradaDedup *entrada = &fragmento->entradas[indice];
+    if (entrada->mais_nova >= 0) {
+        fragmento->entradas[entrada->mais_nova].mais_velha = entrada->mais_velha;
+    } else {
+        fragmento->mais_nova = entrada->mais_velha;
+    }
+    if (entrada->mais_velha >= 0) {
+        fragmento->entradas[entrada->mais_velha].mais_nova = entrada->mais_nova;
+    } else {
+        fragmento->mais_velha = entrada->mais_nova;
+    }
+}
+
+static void ligar_lru(FragmentoDedup *fragmento, int32_t indice) {
+    EntradaDedup *entrada = &fragmento->entradas[indice];
+    entrada->mais_nova = -1;
+    entrada->mais_velha = fragmento->mais_nova;
+    if (fragmento->mais_nova >= 0) {
+        fragmento->entradas[fragmento->mais_nova].mais_nova = indice;
+    } else {
+        fragmento->mais_velha = indice;
+    }
+    fragmento->mais_nova = indice;
+}
+
+// Remove a entrada da posição dada. Em vez de deixar uma lápide, puxa para o buraco
+// as posições seguintes da sequência cuja sondagem passaria por ele
+static void remover_dedup(FragmentoDedup *fragmento, uint32_t posicao) {
+    int32_t indice = fragmento->posicoes[posicao].indice;
+    desligar_lru(fragmento, indice);
+    fragmento->entradas[indice].chave = 0;
+    fragmento->entradas[indice].mais_velha = fragmento->livre;
+    fragmento->livre = indice;
+
+    uint32_t buraco = posicao;
+    for (uint32_t p = (posicao + 1) & fragmento->mascara; fragmento->posicoes[p].indice >= 0;
+         p = (p + 1) & fragmento->mascara) {
+        uint32_t ideal = fragmento->posicoes[p].hash & fragmento->mascara;
+        if (((p - ideal) & fragmento->mascara) >= ((p - buraco) & fragmento->mascara)) {
+            fragmento->posicoes[buraco] = fragmento->posicoes[p];
+            buraco = p;
+        }
+    }
+    fragmento->posicoes[buraco].indice = -1;
+}
+
+// Libera a entrada concluída menos recente do fragmento cheio. As em andamento
+// nunca saem: sem a reserva, uma repetição seria executada de novo. Retorna false
+// se todas as entradas do fragmento estão em andamento
+static bool despejar_dedup(FragmentoDedup *fragmento, uint64_t agora) {
+    int32_t indice = fragmento->mais_velha;
+    while (indice >= 0 && !fragmento->entradas[indice].concluida) {
+        indice = fragmento->entradas[indice].mais_nova;
+    }
+    if (indice < 0) {
+        return false;
+    }
+    EntradaDedup *velha = &fragmento->entradas[indice];
+    if (agora > velha->instante_ns && agora - velha->instante_ns > ttl_dedup_ns) {
+        fragmento->expiradas++;
+    } else {
+        fragmento->despejadas++;
+    }
+    remover_dedup(fragmento, sondar_dedup(fragmento, velha->chave, hash_chave(velha->chave)));
+    return true;
+}
+
+// Consulta a chave da requisição. Se ela é nova, reserva a entrada (em andamento) e
+// retorna false; a requisição segue para a fila. Se é uma repetição, preenche o
+// resultado a devolver ao cliente e retorna true; nesse caso nada deve ser executado.
+// Uma chave nova que não cabe (fragmento só com entradas em andamento) também
+// retorna true, com RESULTADO_OCUPADO: a requisição é recusada sem ser reservada
+bool consultar_dedup(Requisicao *req) {
+    if (fragmentos_dedup == NULL || req->chave == 0) {
+        return false;
+    }
+    uint64_t hash = hash_chave(req->chave);
+    uint64_t agora = req->criada_ns;
+    FragmentoDedup *fragmento = fragmento_da_chave(hash);
+    uint32_t impressao = impressao_requisicao(req);
+    pthread_mutex_lock(&fragmento->trava);
+    fragmento->consultas++;
+    uint32_t posicao = sondar_dedup(fragmento, req->chave, hash);
+    int32_t indice = fragmento->posicoes[posicao].indice;
+    if (indice >= 0 && fragmento->entradas[indice].concluida && agora > fragmento->entradas[indice].instante_ns &&
+        agora - fragmento->entradas[indice].instante_ns > ttl_dedup_ns) {
+        fragmento->expiradas++;
+        remover_dedup(fragmento, posicao);
+        posicao = sondar_dedup(fragmento, req->chave, hash);
+        indice = -1;
+    }
+    if (indice >= 0) {
+        EntradaDedup *entrada = &fragmento->entradas[indice];
+        desligar_lru(fragmento, indice);
+        ligar_lru(fragmento, indice);
+        req->id = 0;
+        req->saldo_final = 0;
+        if (entrada->impressao != impressao) {
+            fragmento->reaproveitadas++;
+            req->resultado = RESULTADO_CHAVE_REUSADA;
+        } else if (!entrada->concluida) {
+            fragmento->em_andamento++;
+            req->resultado = RESULTADO_EM_ANDAMENTO;
+        } else {
+            fragmento->repetidas++;
+            req->id = entrada->id_operacao;
+            req->resultado = entrada->resultado;
+            req->saldo_final = entrada->saldo_final;
+        }
+        pthread_mutex_unlock(&fragmento->trava);
+        return true;
+    }
+
+    if (fragmento->livre < 0) {
+        if (!despejar_dedup(fragmento, agora)) {
+            fragmento->lotados++;
+            pthread_mutex_unlock(&fragmento->trava);
+            req->id = 0;
+            req->saldo_final = 0;
+            req->resultado = RESULTADO_OCUPADO;
+            return true;
+        }
+        posicao = sondar_dedup(fragmento, req->chave, hash); // O despejo pode ter movido a sequência
+    }
+    indice = fragmento->livre;
+    EntradaDedup *entrada = &fragmento->entradas[indice];
+    fragmento->livre = entrada->mais_velha;
+    entrada->chave = req->chave;
+    entrada->instante_ns = agora;
+    entrada->impressao = impressao;
+    entrada->concluida = false;
+    fragmento->posicoes[posicao].indice = indice;
+    fragmento->posicoes[posicao].hash = (uint32_t)hash;
+    ligar_lru(fragmento, indice);
+    pthread_mutex_unlock(&fragmento->trava);
+    return false;
+}
+
+// Guarda o resultado da primeira execução na entrada reservada, que não pode ter
+// sido despejada nem vencido enquanto em andamento
+static void registrar_dedup(const Requisicao *req, uint64_t agora) {
+    uint64_t hash = hash_chave(req->chave);
+    FragmentoDedup *fragmento = fragmento_da_chave(hash);
+    pthread_mutex_lock(&fragmento->trava);
+    int32_t indice = fragmento->posicoes[sondar_dedup(fragmento, req->chave, hash)].indice;
+    if (indice >= 0 && !fragmento->entradas[indice].concluida) {
+        EntradaDedup *entrada = &fragmento->entradas[indice];
+        entrada->concluida = true;
+        entrada->instante_ns = agora;
+        entrada->id_operacao = req->id;
+        entrada->resultado = (uint8_t)req->resultado;
+        entrada->saldo_final = req->saldo_final;
+    }
+    pthread_mutex_unlock(&fragmento->trava);
+}
+
+// Desfaz a reserva feita por consultar_dedup para uma requisição que não chegou a
+// ser executada (recusada na admissão ou descartada na drenagem), para que o
+// cliente possa repeti-la sem receber RESULTADO_EM_ANDAMENTO até a entrada vencer
+static void cancelar_dedup(const Requisicao *req) {
+    if (fragmentos_dedup == NULL || req->chave == 0) {
+        return;
+    }
+    uint64_t hash = hash_chave(req->chave);
+    FragmentoDedup *fragmento = fragmento_da_chave(hash);
+    pthread_mutex_lock(&fragmento->trava);
+    uint32_t posicao = sondar_dedup(fragmento, req->chave, hash);
+    int32_t indice = fragmento->posicoes[posicao].indice;
+    if (indice >= 0 && !fragmento->entradas[indice].concluida) {
+        remover_dedup(fragmento, posicao);
+    }
+    pthread_mutex_unlock(&fragmento->trava);
+}
+
+static void responder_lote(const Requisicao *lote, int quantidade);
+
+// Registra quanto tempo as requisições da amostra passaram na fila, ao retirá-las
+static void medir_tempo_na_fila(const Requisicao *lote, int quantidade) {
+    if (!metricas_ativas) {
+        return;
+    }
+    uint64_t agora = 0;
+    for (int i = 0; i < quantidade; i++) {
+        if (amostrar(&lote[i])) {
+            agora = agora != 0 ? agora : agora_ns();
+            registrar_metrica(METRICA_TEMPO_NA_FILA, agora > lote[i].criada_ns ? agora - lote[i].criada_ns : 0);
+        }
+    }
+}
+
+// Balanços e juros percorrem todas as contas; com --faixas têm uma fila própria
+static inline bool operacao_longa(int operacao) {
+    return operacao == 3 || operacao == 4;
+}
+
+// Devolve ao cliente interno a posição que a requisição ocupava na janela
+static inline void liberar_janela(int cliente) {
+    EstadoCliente *estado = &estados_clientes[cliente];
+    if (atomic_fetch_sub(&estado->em_voo, 1) == (unsigned int)cfg.janela) {
+        futex_acordar(&estado->em_voo, 1); // O cliente pode estar esperando espaço na janela
+    }
+}
+
+static void liberar_lancamentos(const Requisicao *lote, int quantidade) {
+    for (int i = 0; i < quantidade; i++) {
+        free(lote[i].lancamentos);
+    }
+}
+
+// Registra a latência de cada requisição do lote nos histogramas do trabalhador,
+// guarda os resultados no cache de idempotência, libera a janela dos clientes e
+// devolve as respostas dos pedidos que vieram da rede
+void concluir_lote(const Requisicao *lote, int quantidade, int indice) {
+    contar_operacoes(lote, quantidade);
+    if (cfg.estresse) {
+        marcar_destinos(lote, quantidade);
+    }
+    uint64_t agora = agora_ns();
+    for (int i = 0; i < quantidade; i++) {
+        uint64_t latencia = agora > lote[i].criada_ns ? agora - lote[i].criada_ns : 0;
+        registrar_no_histograma(&histogramas[indice], latencia);
+        if (operacao_longa(lote[i].operacao)) {
+            registrar_no_histograma(&histogramas_longas[indice], latencia);
+        }
+        if (fragmentos_dedup != NULL && lote[i].chave != 0) {
+            registrar_dedup(&lote[i], agora); // Antes da resposta, para que uma repetição já a encontre
+        }
+        if (lote[i].cliente >= 0) {
+            liberar_janela(lote[i].cliente);
+        }
+    }
+    responder_lote(lote, quantidade);
+    liberar_lancamentos(lote, quantidade);
+}
+
+unsigned long requisicoes_descartadas = 0; // Aceitas mas não executadas por esgotar o prazo da drenagem
+
+// Esgotado o prazo da drenagem, o que ainda está na fila é respondido com
+// RESULTADO_ENCERRANDO sem ser executado
+static void descartar_lote(Requisicao *lote, int quantidade) {
+    for (int i = 0; i < quantidade; i++) {
+        lote[i].resultado = RESULTADO_ENCERRANDO;
+        lote[i].saldo_final = 0;
+        cancelar_dedup(&lote[i]);
+        if (lote[i].cliente >= 0) {
+            liberar_janela(lote[i].cliente);
+        }
+    }
+    __sync_fetch_and_add(&requisicoes_descartadas, quantidade);
+    if (cfg.estresse) {
+        marcar_destinos(lote, quantidade);
+    }
+    responder_lote(lote, quantidade);
+    liberar_lancamentos(lote, quantidade);
+}
+
+// Aplica um depósito, uma transferência ou uma operação com lançamentos (listras
+// travadas, época anunciada) e anota o resultado para a resposta
+static inline void executar_operacao(Requisicao *req, SlotEpoca *slot, unsigned int epoca) {
+    uint64_t inicio = amostrar(req) ? agora_ns() : 0;
+    if (req->operacao == 1) {
+        bool depositou = cfg.otimista ? deposito_otimista(req->id_origem, req->valor, req->id, slot, epoca)
+                                      : deposito(req->id_origem, req->valor, req->id, slot, epoca);
+        req->resultado = depositou ? RESULTADO_OK : RESULTADO_INVALIDO;
+    } else if (req->operacao == 2) {
+        bool transferiu = cfg.otimista
+            ? transferencia_otimista(req->id_origem, req->id_destino, req->valor, req->id, epoca)
+            : transferencia(req->id_origem, req->id_destino, req->valor, req->id, epoca);
+        req->resultado = transferiu ? RESULTADO_OK : RESULTADO_SALDO_INSUFICIENTE;
+    } else {
+        bool aplicou = cfg.otimista ? aplicar_lancamentos_otimista(req->id, req->lancamentos, epoca)
+                                    : aplicar_lancamentos(req->id, req->lancamentos, epoca);
+        req->resultado = aplicou ? RESULTADO_OK : RESULTADO_SALDO_INSUFICIENTE;
+    }
+    req->saldo_final = ler_saldo(req->id_origem);
+    if (cfg.gravar_execucao != NULL) {
+        anotar_operacao(req, epoca);
+    }
+    if (inicio != 0) {
+        registrar_metrica(METRICA_SERVICO + req->operacao, agora_ns() - inicio);
+    }
+}
+
+// Executa um balanço ou uma aplicação de juros (fora da seção crítica do lote)
+static void executar_operacao_longa(Requisicao *req) {
+    uint64_t inicio = metricas_ativas ? agora_ns() : 0;
+    if (req->operacao == 3) {
+        req->saldo_final = balanco(req->id);
+    } else {
+        aplicar_juros(req->id);
+    }
+    if (metricas_ativas) {
+        registrar_metrica(METRICA_SERVICO + req->operacao, agora_ns() - inicio);
+    }
+}
+
+// Uma operação com lançamentos pode tocar até MAX_LANCAMENTOS contas; em vez de
+// alargar a seção crítica do lote, ela trava sozinha as suas listras, já
+// ordenadas por quem criou a requisição
+static void executar_lancamentos(Requisicao *req, SlotEpoca *slot) {
+    const Lancamentos *lancamentos = req->lancamentos;
+    uint64_t inicio_espera = metricas_ativas ? agora_ns() : 0;
+    travar_listras(lancamentos->listras, lancamentos->num_listras);
+    uint64_t inicio_posse = metricas_ativas ? agora_ns() : 0;
+    unsigned int epoca = entrar_epoca(slot);
+    executar_operacao(req, slot, epoca);
+    sair_epoca(slot);
+    destravar_listras(lancamentos->listras, lancamentos->num_listras);
+    if (metricas_ativas) {
+        registrar_metrica(METRICA_ESPERA_TRAVAS, inicio_posse - inicio_espera);
+        registrar_metrica(METRICA_POSSE_TRAVAS, agora_ns() - inicio_posse);
+    }
+}
+
+// Aplica um lote inteiro em uma única seção crítica: coleta as listras tocadas
+// pelo lote, trava-as em ordem e executa as requisições em sequência (com
+// --otimista, sem travar nada). As operações com lançamentos travam as próprias
+// listras logo depois, e os balanços e juros do lote rodam por último, fora da
+// seção crítica
+void processar_lote(Requisicao *lote, int quantidade, int *listras, SlotEpoca *slot) {
+    int num_listras = cfg.otimista ? 0 : coletar_listras(lote, quantidade, listras);
+    uint64_t inicio_espera = metricas_ativas ? agora_ns() : 0;
+    travar_listras(listras, num_listras);
+    uint64_t inicio_posse = metricas_ativas ? agora_ns() : 0;
+    unsigned int epoca = cfg.otimista ? entrar_epoca_otimista(slot) : entrar_epoca(slot);
+    for (int i = 0; i < quantidade; i++) {
+        if (lote[i].operacao == 1 || lote[i].operacao == 2 || (cfg.otimista && lote[i].operacao == OP_LANCAMENTOS)) {
+            executar_operacao(&lote[i], slot, epoca);
+        }
+    }
+    sair_epoca(slot);
+    destravar_listras(listras, num_listras);
+    if (cfg.otimista) {
+        publicar_conflitos();
+    }
+    if (metricas_ativas && num_listras > 0) {
+        registrar_metrica(METRICA_ESPERA_TRAVAS, inicio_posse - inicio_espera);
+        registrar_metrica(METRICA_POSSE_TRAVAS, agora_ns() - inicio_posse);
+    }
+    for (int i = 0; i < quantidade && !cfg.otimista; i++) {
+        if (lote[i].operacao == OP_LANCAMENTOS) {
+            executar_lancamentos(&lote[i], slot);
+        }
+    }
+
+    for (int i = 0; i < quantidade; i++) {
+        if (lote[i].operacao == 3 || lote[i].operacao == 4) {
+            executar_operacao_longa(&lote[i]);
+        }
+    }
+
+    __sync_fetch_and_add(&operacoes_concluidas, quantidade);
+    __sync_fetch_and_add(&lotes_processados, 1);
+    simular_latencia_ate(quantidade * cfg.latencia_operacao_us, &descartar_pendentes);
+}
+
+// Threads de E/S com pedidos à espera de espaço em alguma fila (ver esperar_espaco)
+atomic_int threads_io_sem_espaco = 0;
+static void acordar_threads_io_sem_espaco(void);
+
+// Chamada depois de retirar requisições de uma fila. As threads de E/S não dormem
+// na fila: esperam no epoll até um trabalhador avisá-las por aqui
+static inline void avisar_espaco_threads_io(void) {
+    if (atomic_load_explicit(&threads_io_sem_espaco, memory_order_relaxed) > 0) {
+        acordar_threads_io_sem_espaco();
+    }
+}
+
+#ifdef FILA_LOCKFREE
+// Inicializa a fila de requisições
+void inicializar_fila(FilaRequisicoes *fila, int capacidade) {
+    fila->capacidade = capacidade;
+    fila->celulas = alocar_alinhado(capacidade * sizeof(CelulaFila), "fila de requisições");
+    for (size_t i = 0; i < fila->capacidade; i++) {
+        atomic_init(&fila->celulas[i].sequencia, i);
+    }
+    atomic_init(&fila->cabeca, 0);
+    atomic_init(&fila->cauda, 0);
+    atomic_init(&fila->sinal_nao_vazia, 0);
+    atomic_init(&fila->esperando_nao_vazia, 0);
+    atomic_init(&fila->sinal_nao_cheia, 0);
+    atomic_init(&fila->esperando_nao_cheia, 0);
+}
+
+// Tenta inserir sem bloquear; retorna false se a fila estiver cheia
+static bool tentar_enfileirar(FilaRequisicoes *fila, const Requisicao *req) {
+    size_t pos = atomic_load_explicit(&fila->cauda, memory_order_relaxed);
+    for (;;) {
+        CelulaFila *celula = &fila->celulas[pos % fila->capacidade];
+        size_t seq = atomic_load_explicit(&celula->sequencia, memory_order_acquire);
+        intptr_t diferenca = (intptr_t)seq - (intptr_t)pos;
+        if (diferenca == 0) {
+            if (atomic_compare_exchange_weak_explicit(&fila->cauda, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                celula->req = *req;
+                atomic_store_explicit(&celula->sequencia, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diferenca < 0) {
+            return false; // Cheia: a célula ainda não foi consumida na volta anterior
+        } else {
+            pos = atomic_load_explicit(&fila->cauda, memory_order_relaxed);
+        }
+    }
+}
+
+// Tenta remover sem bloquear; retorna false se a fila estiver vazia
+static bool tentar_desenfileirar(FilaRequisicoes *fila, Requisicao *req) {
+    size_t pos = atomic_load_explicit(&fila->cabeca, memory_order_relaxed);
+    for (;;) {
+        CelulaFila *celula = &fila->celulas[pos % fila->capacidade];
+        size_t seq = atomic_load_explicit(&celula->sequencia, memory_order_acquire);
+        intptr_t diferenca = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diferenca == 0) {
+            if (atomic_compare_exchange_weak_explicit(&fila->cabeca, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *req = celula->req;
+                atomic_store_explicit(&celula->sequencia, pos + fila->capacidade, memory_order_release);
+                return true;
+            }
+        } else if (diferenca < 0) {
+            return false; // Vazia: o produtor ainda não publicou esta célula
+        } else {
+            pos = atomic_load_explicit(&fila->cabeca, memory_order_relaxed);
+        }
+    }
+}
+
+// Requisições na fila no momento (aproximado enquanto há produtores e consumidores ativos)
+int profundidade_fila(FilaRequisicoes *fila) {
+    size_t cauda = atomic_load_explicit(&fila->cauda, memory_order_relaxed);
+    size_t cabeca = atomic_load_explicit(&fila->cabeca, memory_order_relaxed);
+    return cauda > cabeca ? (int)(cauda - cabeca) : 0;
+}
+
+// Incrementa a palavra de futex e acorda até quantidade threads, apenas se houver alguém dormindo
+static void notificar(atomic_uint *sinal, atomic_uint *esperando, int quantidade) {
+    atomic_fetch_add(sinal, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(esperando) > 0) {
+        futex_acordar(sinal, quantidade);
+    }
+}
+
+// Avisa quem espera espaço: os produtores dormindo no futex e as threads de E/S
+static void notificar_espaco(FilaRequisicoes *fila, int quantidade) {
+    notificar(&fila->sinal_nao_cheia, &fila->esperando_nao_cheia, quantidade);
+    avisar_espaco_threads_io(); // Ordenado depois da remoção pela barreira de notificar
+}
+
+// Adiciona uma requisição na fila: gira por um curto período e depois dorme no
+// futex até haver espaço ou até prazo_ns (0 = não espera, PRAZO_INDEFINIDO = sem
+// limite). Retorna RESULTADO_OK, RESULTADO_OCUPADO (prazo esgotado com a fila
+// cheia) ou RESULTADO_ENCERRANDO
+int enfileirar(FilaRequisicoes *fila, Requisicao req, uint64_t prazo_ns) {
+    uint64_t inicio_espera = 0;
+    for (int giro = 0; !admissao_encerrada(); giro++) {
+        if (tentar_enfileirar(fila, &req)) {
+            notificar(&fila->sinal_nao_vazia, &fila->esperando_nao_vazia, 1);
+            if (inicio_espera != 0) {
+                uint64_t espera = agora_ns() - inicio_espera;
+                atomic_fetch_add(&espera_fila_cheia_ns, espera);
+                registrar_metrica(METRICA_ESPERA_FILA_CHEIA, espera);
+            }
+            return RESULTADO_OK;
+        }
+        if (prazo_ns == 0) {
+            return RESULTADO_OCUPADO;
+        }
+        if (inicio_espera == 0) {
+            inicio_espera = agora_ns();
+        }
+        if (giro < GIROS_ANTES_DE_DORMIR) {
+            pausa_cpu();
+            continue;
+        }
+        if (prazo_ns != PRAZO_INDEFINIDO && agora_ns() >= prazo_ns) {
+            return RESULTADO_OCUPADO;
+        }
+
+        // Registra-se como esperando antes de tentar de novo, para não perder o aviso
+        unsigned int sinal = atomic_load(&fila->sinal_nao_cheia);
+        atomic_fetch_add(&fila->esperando_nao_cheia, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        bool inseriu = tentar_enfileirar(fila, &req);
+        if (!inseriu && !admissao_encerrada()) {
+            if (prazo_ns == PRAZO_INDEFINIDO) {
+                futex_esperar(&fila->sinal_nao_cheia, sinal);
+            } else {
+                futex_esperar_ate(&fila->sinal_nao_cheia, sinal, prazo_ns);
+            }
+        }
+        atomic_fetch_sub(&fila->esperando_nao_cheia, 1);
+        if (inseriu) {
+            notificar(&fila->sinal_nao_vazia, &fila->esperando_nao_vazia, 1);
+            uint64_t espera = agora_ns() - inicio_espera;
+            atomic_fetch_add(&espera_fila_cheia_ns, espera);
+            registrar_metrica(METRICA_ESPERA_FILA_CHEIA, espera);
+            return RESULTADO_OK;
+        }
+    }
+    return RESULTADO_ENCERRANDO;
+}
+
+// Remove uma requisição da fila; retorna false quando a fila está vazia e o sistema encerrando
+bool desenfileirar(FilaRequisicoes *fila, Requisicao *req) {
+    for (int giro = 0;; giro++) {
+        if (tentar_desenfileirar(fila, req)) {
+            notificar_espaco(fila, 1);
+            return true;
+        }
+        if (shutdown_flag) {
+            return false;
+        }
+        if (giro < GIROS_ANTES_DE_DORMIR) {
+            pausa_cpu();
+            continue;
+        }
+
+        unsigned int sinal = atomic_load(&fila->sinal_nao_vazia);
+        atomic_fetch_add(&fila->esperando_nao_vazia, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        bool removeu = tentar_desenfileirar(fila, req);
+        if (!removeu && !shutdown_flag) {
+            futex_esperar(&fila->sinal_nao_vazia, sinal);
+        }
+        atomic_fetch_sub(&fila->esperando_nao_vazia, 1);
+        if (removeu) {
+            notificar_espaco(fila, 1);
+            return true;
+        }
+    }
+}
+
+// Remove até max requisições: bloqueia pela primeira e recolhe as demais já
+// disponíveis, acordando de uma vez os produtores que esperam por espaço
+int desenfileirar_lote(FilaRequisicoes *fila, Requisicao *buf, int max) {
+    int quantidade = 0;
+    uint64_t inicio_espera = 0;
+    for (int giro = 0; quantidade == 0; giro++) {
+        while (quantidade < max && tentar_desenfileirar(fila, &buf[quantidade])) {
+            quantidade++;
+        }
+        if (quantidade > 0 || shutdown_flag) {
+            break;
+        }
+        if (inicio_espera == 0 && metricas_ativas) {
+            inicio_espera = agora_ns();
+        }
+        if (giro < GIROS_ANTES_DE_DORMIR) {
+            pausa_cpu();
+            continue;
+        }
+
+        unsigned int sinal = atomic_load(&fila->sinal_nao_vazia);
+        atomic_fetch_add(&fila->esperando_nao_vazia, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (quantidade < max && tentar_desenfileirar(fila, &buf[quantidade])) {
+            quantidade++;
+        }
+        if (quantidade == 0 && !shutdown_flag) {
+            futex_esperar(&fila->sinal_nao_vazia, sinal);
+        }
+        atomic_fetch_sub(&fila->esperando_nao_vazia, 1);
+    }
+    if (quantidade > 0) {
+        notificar_espaco(fila, quantidade);
+        if (inicio_espera != 0) {
+            registrar_metrica(METRICA_ESPERA_FILA_VAZIA, agora_ns() - inicio_espera);
+        }
+        if (metricas_ativas) {
+            registrar_metrica(METRICA_PROFUNDIDADE_FILA, profundidade_fila(fila) + quantidade);
+        }
+    }
+    return quantidade;
+}
+
+// Remove sem bloquear até max requisições; retorna 0 se a fila estiver vazia
+int tentar_desenfileirar_lote(FilaRequisicoes *fila, Requisicao *buf, int max) {
+    int quantidade = 0;
+    while (quantidade < max && tentar_desenfileirar(fila, &buf[quantidade])) {
+        quantidade++;
+    }
+    if (quantidade > 0) {
+        notificar_espaco(fila, quantidade);
+        if (metricas_ativas) {
+            registrar_metrica(METRICA_PROFUNDIDADE_FILA, profundidade_fila(fila) + quantidade);
+        }
+    }
+    return quantidade;
+}
+
+// Acorda os produtores que esperam por espaço, para que vejam a admissão encerrada
+void acordar_produtores(FilaRequisicoes *fila) {
+    atomic_fetch_add(&fila->sinal_nao_cheia, 1);
+    futex_acordar(&fila->sinal_nao_cheia, INT_MAX);
+}
+
+// Sinaliza o encerramento e acorda todas as threads dormindo na fila
+void sinalizar_encerramento(FilaRequisicoes *fila) {
+    shutdown_flag = true;
+    atomic_fetch_add(&fila->sinal_nao_vazia, 1);
+    atomic_fetch_add(&fila->sinal_nao_cheia, 1);
+    futex_acordar(&fila->sinal_nao_vazia, INT_MAX);
+    futex_acordar(&fila->sinal_nao_cheia, INT_MAX);
+}
+
+void destruir_fila(FilaRequisicoes *fila) {
+    free(fila->celulas);
+}
+#else
+// Inicializa a fila de requisições
+void inicializar_fila(FilaRequisicoes *fila, int capacidade) {
+    fila->dados = alocar_alinhado(capacidade * sizeof(Requisicao), "fila de requisições");
+    fila->capacidade = capacidade;
+    fila->inicio = 0;
+    fila->fim = 0;
+    fila->tamanho = 0;
+    pthread_mutex_init(&fila->mutex, NULL);
+    pthread_cond_init(&fila->cond_nao_vazia, NULL);
+    pthread_condattr_t atributos; // Prazos de admissão no relógio monotônico, o mesmo de agora_ns
+    pthread_condattr_init(&atributos);
+    pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+    pthread_cond_init(&fila->cond_nao_cheia, &atributos);
+    pthread_condattr_destroy(&atributos);
+}
+
+// Adiciona uma requisição na fila, esperando por espaço até prazo_ns (0 = não
+// espera, PRAZO_INDEFINIDO = sem limite). Retorna RESULTADO_OK, RESULTADO_OCUPADO
+// (prazo esgotado com a fila cheia) ou RESULTADO_ENCERRANDO
+int enfileirar(FilaRequisicoes *fila, Requisicao req, uint64_t prazo_ns) {
+    pthread_mutex_lock(&fila->mutex);
+    if (fila->tamanho == fila->capacidade && !admissao_encerrada() && prazo_ns != 0) {
+        uint64_t inicio_espera = agora_ns();
+        struct timespec prazo = {.tv_sec = (time_t)(prazo_ns / 1000000000ULL), .tv_nsec = (long)(prazo_ns % 1000000000ULL)};
+        while (fila->tamanho == fila->capacidade && !admissao_encerrada()) {
+            if (prazo_ns == PRAZO_INDEFINIDO) {
+                pthread_cond_wait(&fila->cond_nao_cheia, &fila->mutex);
+            } else if (pthread_cond_timedwait(&fila->cond_nao_cheia, &fila->mutex, &prazo) == ETIMEDOUT) {
+                break;
+            }
+        }
+        uint64_t espera = agora_ns() - inicio_espera;
+        atomic_fetch_add(&espera_fila_cheia_ns, espera);
+        registrar_metrica(METRICA_ESPERA_FILA_CHEIA, espera);
+    }
+
+    if (admissao_encerrada() || fila->tamanho == fila->capacidade) {
+        int resultado = admissao_encerrada() ? RESULTADO_ENCERRANDO : RESULTADO_OCUPADO;
+        pthread_mutex_unlock(&fila->mutex);
+        return resultado;
+    }
+
+    fila->dados[fila->fim] = req;
+    fila->fim = (fila->fim + 1) % fila->capacidade;
+    fila->tamanho++;
+    pthread_cond_signal(&fila->cond_nao_vazia);
+    pthread_mutex_unlock(&fila->mutex);
+    return RESULTADO_OK;
+}
+
+// Remove uma requisição da fila
+bool desenfileirar(FilaRequisicoes *fila, Requisicao *req) {
+    pthread_mutex_lock(&fila->mutex);
+    while (fila->tamanho == 0 && !shutdown_flag) {
+        pthread_cond_wait(&fila->cond_nao_vazia, &fila->mutex);
+    }
+
+    if (fila->tamanho == 0 && shutdown_flag) {
+        pthread_mutex_unlock(&fila->mutex);
+        return false;
+    }
+
+    *req = fila->dados[fila->inicio];
+    fila->inicio = (fila->inicio + 1) % fila->capacidade;
+    fila->tamanho--;
+    pthread_cond_signal(&fila->cond_nao_cheia);
+    pthread_mutex_unlock(&fila->mutex);
+    avisar_espaco_threads_io();
+    return true;
+}
+
+// Retira até max requisições já presentes na fila (chamada com a trava da fila)
+static int retirar_lote(FilaRequisicoes *fila, Requisicao *buf, int max) {
+    if (fila->tamanho > 0) {
+        registrar_metrica(METRICA_PROFUNDIDADE_FILA, fila->tamanho);
+    }
+    int quantidade = fila->tamanho < max ? fila->tamanho : max;
+    for (int i = 0; i < quantidade; i++) {
+        buf[i] = fila->dados[fila->inicio];
+        fila->inicio = (fila->inicio + 1) % fila->capacidade;
+    }
+    fila->tamanho -= quantidade;
+    if (quantidade == 1) {
+        pthread_cond_signal(&fila->cond_nao_cheia);
+    } else if (quantidade > 1) {
+        pthread_cond_broadcast(&fila->cond_nao_cheia);
+    }
+    return quantidade;
+}
+
+// Remove até max requisições de uma vez, com uma única aquisição da trava da fila.
+// Retorna 0 quando a fila está vazia e o sistema encerrando
+int desenfileirar_lote(FilaRequisicoes *fila, Requisicao *buf, int max) {
+    pthread_mutex_lock(&fila->mutex);
+    if (fila->tamanho == 0 && !shutdown_flag) {
+        uint64_t inicio_espera = metricas_ativas ? agora_ns() : 0;
+        while (fila->tamanho == 0 && !shutdown_flag) {
+            pthread_cond_wait(&fila->cond_nao_vazia, &fila->mutex);
+        }
+        if (metricas_ativas) {
+            registrar_metrica(METRICA_ESPERA_FILA_VAZIA, agora_ns() - inicio_espera);
+        }
+    }
+    int quantidade = retirar_lote(fila, buf, max);
+    pthread_mutex_unlock(&fila->mutex);
+    if (quantidade > 0) {
+        avisar_espaco_threads_io();
+    }
+    return quantidade;
+}
+
+// Remove sem bloquear até max requisições; uma fila com a trava ocupada é tratada
+// como vazia, já que quem a ocupa é um produtor ou outro consumidor
+int tentar_desenfileirar_lote(FilaRequisicoes *fila, Requisicao *buf, int max) {
+    if (pthread_mutex_trylock(&fila->mutex) != 0) {
+        return 0;
+    }
+    int quantidade = retirar_lote(fila, buf, max);
+    pthread_mutex_unlock(&fila->mutex);
+    if (quantidade > 0) {
+        avisar_espaco_threads_io();
+    }
+    return quantidade;
+}
+
+// Requisições na fila no momento
+int profundidade_fila(FilaRequisicoes *fila) {
+    pthread_mutex_lock(&fila->mutex);
+    int tamanho = fila->tamanho;
+    pthread_mutex_unlock(&fila->mutex);
+    return tamanho;
+}
+
+// Acorda os produtores que esperam por espaço, para que vejam a admissão encerrada
+void acordar_produtores(FilaRequisicoes *fila) {
+    pthread_mutex_lock(&fila->mutex);
+    pthread_cond_broadcast(&fila->cond_nao_cheia);
+    pthread_mutex_unlock(&fila->mutex);
+}
+
+// Sinaliza o encerramento e acorda todas as threads bloqueadas na fila
+void sinalizar_encerramento(FilaRequisicoes *fila) {
+    pthread_mutex_lock(&fila->mutex);
+    shutdown_flag = true;
+    pthread_cond_broadcast(&fila->cond_nao_vazia);
+    pthread_cond_broadcast(&fila->cond_nao_cheia);
+    pthread_mutex_unlock(&fila->mutex);
+}
+
+void destruir_fila(FilaRequisicoes *fila) {
+    free(fila->dados);
+    pthread_mutex_destroy(&fila->mutex);
+    pthread_cond_destroy(&fila->cond_nao_vazia);
+    pthread_cond_destroy(&fila->cond_nao_cheia);
+}
+#endif
+
+// Executor em ondas (--ondas N): o trabalhador 0 retira uma janela de até N
+// requisições e a divide em ondas em que nenhuma conta aparece duas vezes. Cada
+// requisição vai para a onda seguinte à última que tocou suas contas, então as
+// operações de uma mesma conta continuam na ordem da fila e o resultado (inclusive
+// quais transferências falham) é o mesmo da execução sequencial. Balanços e juros
+// ocupam uma onda sozinhos, depois de tudo que veio antes deles na janela. Ondas
+// grandes são divididas entre todos os trabalhadores sem travar contas; ondas
+// pequenas consecutivas viram uma fase sequencial do trabalhador 0, poupando barreiras
+typedef struct {
+    int inicio;
+    int fim;
+    bool paralela;
+} FaseOnda;
+
+static struct {
+    Requisicao *janela;       // Requisições na ordem da fila
+    Requisicao *ordenadas;    // As mesmas, agrupadas por onda
+    int *onda;                // Onda de cada requisição da janela
+    int *inicio_onda;         // Início de cada onda em ordenadas (ondas numeradas a partir de 1)
+    FaseOnda *fases;
+    int num_fases;            // 0 = encerrar
+    uint32_t *janela_da_conta; // Janela em que a conta foi tocada pela última vez
+    int *onda_da_conta;        // Última onda da conta nessa janela
+    uint32_t janela_atual;
+    pthread_barrier_t barreira;
+} plano;
+
+unsigned long janelas_executadas = 0; // Estatísticas mantidas só pelo trabalhador 0
+unsigned long ondas_executadas = 0;
+unsigned long fases_paralelas = 0;
+unsigned long operacoes_paralelas = 0;
+
+static inline int onda_da_conta(int id) {
+    return plano.janela_da_conta[id] == plano.janela_atual ? plano.onda_da_conta[id] : 0;
+}
+
+static inline void marcar_conta(int id, int onda) {
+    plano.janela_da_conta[id] = plano.janela_atual;
+    plano.onda_da_conta[id] = onda;
+}
+
+// Monta as ondas e as fases da janela em plano; retorna o número de fases
+static int planejar_ondas(int quantidade) {
+    plano.janela_atual++;
+    int ultima = 0, piso = 0;
+    for (int i = 0; i < quantidade; i++) {
+        const Requisicao *req = &plano.janela[i];
+        int onda;
+        if (req->operacao == 3 || req->operacao == 4) {
+            onda = ultima + 1; // Depois de tudo o que veio antes, e nada junto
+            piso = onda;
+        } else if (req->operacao == OP_LANCAMENTOS) {
+            // Depois da última onda de cada uma das contas, todas marcadas nela
+            onda = piso + 1;
+            const Lancamentos *lancamentos = req->lancamentos;
+            for (int k = 0; k < lancamentos->quantidade; k++) {
+                int anterior = onda_da_conta(lancamentos->itens[k].conta);
+                onda = anterior >= onda ? anterior + 1 : onda;
+            }
+            for (int k = 0; k < lancamentos->quantidade; k++) {
+                marcar_conta(lancamentos->itens[k].conta, onda);
+            }
+        } else {
+            onda = piso + 1;
+            int anterior = onda_da_conta(req->id_origem);
+            onda = anterior >= onda ? anterior + 1 : onda;
+            if (req->operacao == 2) {
+                anterior = onda_da_conta(req->id_destino);
+                onda = anterior >= onda ? anterior + 1 : onda;
+                marcar_conta(req->id_destino, onda);
+            }
+            marcar_conta(req->id_origem, onda);
+        }
+        plano.onda[i] = onda;
+        ultima = onda > ultima ? onda : ultima;
+    }
+
+    // Ordenação estável por contagem: ordenadas fica agrupada por onda
+    memset(plano.inicio_onda, 0, (ultima + 2) * sizeof(int));
+    for (int i = 0; i < quantidade; i++) {
+        plano.inicio_onda[plano.onda[i] + 1]++;
+    }
+    for (int w = 1; w <= ultima + 1; w++) {
+        plano.inicio_onda[w] += plano.inicio_onda[w - 1];
+    }
+    for (int i = 0; i < quantidade; i++) {
+        plano.ordenadas[plano.inicio_onda[plano.onda[i]]++] = plano.janela[i];
+    }
+    for (int w = ultima + 1; w > 0; w--) {
+        plano.inicio_onda[w] = plano.inicio_onda[w - 1];
+    }
+
+    int limiar = 2 * cfg.num_threads; // Abaixo disso a barreira custa mais do que o paralelismo rende
+    int num_fases = 0;
+    for (int w = 1; w <= ultima; w++) {
+        int inicio = plano.inicio_onda[w], fim = plano.inicio_onda[w + 1];
+        int operacao = plano.ordenadas[inicio].operacao;
+        bool paralela = fim - inicio >= limiar && operacao != 3 && operacao != 4;
+        if (!paralela && num_fases > 0 && !plano.fases[num_fases - 1].paralela) {
+            plano.fases[num_fases - 1].fim = fim;
+        } else {
+            plano.fases[num_fases++] = (FaseOnda){inicio, fim, paralela};
+        }
+    }
+    ondas_executadas += ultima;
+    return num_fases;
+}
+
+// Aplica requisições em sequência sem travar listras: no executor em ondas só
+// esta thread toca essas contas durante a fase. Balanços e juros rodam fora da época
+static void executar_sequencia(Requisicao *reqs, int quantidade, SlotEpoca *slot) {
+    bool dentro = false;
+    unsigned int epoca = 0;
+    for (int i = 0; i < quantidade; i++) {
+        Requisicao *req = &reqs[i];
+        if (req->operacao == 3 || req->operacao == 4) {
+            if (dentro) {
+                sair_epoca(slot);
+                dentro = false;
+            }
+            executar_operacao_longa(req);
+            continue;
+        }
+        if (!dentro) {
+            epoca = entrar_epoca(slot);
+            dentro = true;
+        }
+        executar_operacao(req, slot, epoca);
+    }
+    if (dentro) {
+        sair_epoca(slot);
+    }
+}
+
+static void *trabalhador_ondas(int indice) {
+    SlotEpoca *slot = &slots_epoca[indice];
+    for (;;) {
+        if (indice == 0) {
+            int quantidade = desenfileirar_lote(&fila_requisicoes, plano.janela, cfg.janela_ondas);
+            while (quantidade > 0 && atomic_load(&descartar_pendentes)) {
+                descartar_lote(plano.janela, quantidade);
+                quantidade = desenfileirar_lote(&fila_requisicoes, plano.janela, cfg.janela_ondas);
+            }
+            medir_tempo_na_fila(plano.janela, quantidade);
+            plano.num_fases = quantidade > 0 ? planejar_ondas(quantidade) : 0;
+        }
+        pthread_barrier_wait(&plano.barreira); // Plano pronto
+        int num_fases = plano.num_fases; // Depois da última barreira o trabalhador 0 já monta o próximo plano
+        if (num_fases == 0) {
+            break;
+        }
+
+        int executadas = 0;
+        for (int f = 0; f < num_fases; f++) {
+            FaseOnda fase = plano.fases[f];
+            int inicio = fase.inicio, fim = fase.fim;
+            if (fase.paralela) {
+                int tamanho = fase.fim - fase.inicio;
+                inicio = fase.inicio + (int)((long)tamanho * indice / cfg.num_threads);
+                fim = fase.inicio + (int)((long)tamanho * (indice + 1) / cfg.num_threads);
+            } else if (indice != 0) {
+                inicio = fim; // Fase sequencial: só o trabalhador 0
+            }
+            if (fim > inicio) {
+                executar_sequencia(&plano.ordenadas[inicio], fim - inicio, slot);
+                concluir_lote(&plano.ordenadas[inicio], fim - inicio, indice);
+                executadas += fim - inicio;
+            }
+            if (indice == 0 && fase.paralela) {
+                fases_paralelas++;
+                operacoes_paralelas += fase.fim - fase.inicio;
+            }
+            pthread_barrier_wait(&plano.barreira); // Fim da fase
+        }
+        if (indice == 0) {
+            janelas_executadas++;
+            __sync_fetch_and_add(&lotes_processados, 1);
+        }
+        __sync_fetch_and_add(&operacoes_concluidas, executadas);
+        simular_latencia_ate(executadas * cfg.latencia_operacao_us, &descartar_pendentes);
+    }
+    return NULL;
+}
+
+void inicializar_ondas(void) {
+    int janela = cfg.janela_ondas;
+    plano.janela = alocar_alinhado(janela * sizeof(Requisicao), "janela do executor em ondas");
+    plano.ordenadas = alocar_alinhado(janela * sizeof(Requisicao), "ondas do executor");
+    plano.onda = alocar_alinhado(janela * sizeof(int), "ondas das requisições");
+    plano.inicio_onda = alocar_alinhado((janela + 2) * sizeof(int), "início das ondas");
+    plano.fases = alocar_alinhado(janela * sizeof(FaseOnda), "fases das ondas");
+    plano.janela_da_conta = alocar_alinhado(cfg.num_contas * sizeof(uint32_t), "janelas das contas");
+    plano.onda_da_conta = alocar_alinhado(cfg.num_contas * sizeof(int), "ondas das contas");
+    memset(plano.janela_da_conta, 0, cfg.num_contas * sizeof(uint32_t));
+    plano.janela_atual = 0;
+    pthread_barrier_init(&plano.barreira, NULL, cfg.num_threads);
+}
+
+void destruir_ondas(void) {
+    pthread_barrier_destroy(&plano.barreira);
+    free(plano.janela);
+    free(plano.ordenadas);
+    free(plano.onda);
+    free(plano.inicio_onda);
+    free(plano.fases);
+    free(plano.janela_da_conta);
+    free(plano.onda_da_conta);
+}
+
+// Pega operações curtas da fila comum ou, com --roubo, da própria fila e, se ela
+// estiver vazia, rouba metade de um lote da primeira outra que tiver requisições
+static int coletar_curtas(int indice, Requisicao *lote, int max) {
+    if (!cfg.roubo_trabalho) {
+        return tentar_desenfileirar_lote(&fila_requisicoes, lote, max);
+    }
+    int quantidade = tentar_desenfileirar_lote(&filas_trabalhadores[indice], lote, max);
+    if (quantidade > 0) {
+        return quantidade;
+    }
+    for (int d = 1; d < cfg.num_threads; d++) {
+        int vitima = (indice + d) % cfg.num_threads;
+        quantidade = tentar_desenfileirar_lote(&filas_trabalhadores[vitima], lote, (max + 1) / 2);
+        if (quantidade > 0) {
+            __sync_fetch_and_add(&lotes_roubados, 1);
+            return quantidade;
+        }
+    }
+    return 0;
+}
+
+static int profundidade_curtas(void) {
+    if (!cfg.roubo_trabalho) {
+        return profundidade_fila(&fila_requisicoes);
+    }
+    int total = 0;
+    for (int i = 0; i < cfg.num_threads; i++) {
+        total += profundidade_fila(&filas_trabalhadores[i]);
+    }
+    return total;
+}
+
+// Os últimos cfg.trabalhadores_longos trabalhadores só atendem a fila das longas
+static inline int classe_do_trabalhador(int indice) {
+    return indice >= cfg.num_threads - cfg.trabalhadores_longos ? 1 : 0;
+}
+
+static inline int classe_da_requisicao(const Requisicao *req) {
+    return cfg.trabalhadores_longos > 0 && operacao_longa(req->operacao) ? 1 : 0;
+}
+
+static _Thread_local int lotes_curtos_seguidos = 0; // Desde a última vez que olhou as longas
+
+// Escolhe a fila do próximo lote. Sem --faixas só há operações curtas. Com elas,
+// os dedicados tiram uma longa por vez; os demais, se não há dedicados, atendem
+// uma longa a cada cfg.peso_curtas lotes curtos, ou quando não há curtas, para
+// que os balanços andem sem que uma rajada deles segure as transferências
+static int coletar_trabalho(int indice, Requisicao *lote, int max) {
+    if (!cfg.faixas) {
+        return coletar_curtas(indice, lote, max);
+    }
+    if (classe_do_trabalhador(indice) == 1) {
+        return tentar_desenfileirar_lote(&fila_longas, lote, 1);
+    }
+    bool atende_longas = cfg.trabalhadores_longos == 0;
+    int quantidade;
+    if (atende_longas && lotes_curtos_seguidos >= cfg.peso_curtas) {
+        lotes_curtos_seguidos = 0;
+        quantidade = tentar_desenfileirar_lote(&fila_longas, lote, 1);
+        if (quantidade > 0) {
+            return quantidade;
+        }
+    }
+    quantidade = coletar_curtas(indice, lote, max);
+    if (quantidade > 0) {
+        lotes_curtos_seguidos++;
+        return quantidade;
+    }
+    if (atende_longas) {
+        quantidade = tentar_desenfileirar_lote(&fila_longas, lote, 1);
+        lotes_curtos_seguidos = 0;
+    }
+    return quantidade;
+}
+
+// Confere, antes de dormir, se alguma fila que o trabalhador atende tem requisições:
+// tentar_desenfileirar_lote também devolve 0 quando só perdeu a disputa pela trava
+static bool ha_trabalho(int indice) {
+    if (cfg.faixas && (classe_do_trabalhador(indice) == 1 || cfg.trabalhadores_longos == 0) &&
+        profundidade_fila(&fila_longas) > 0) {
+        return true;
+    }
+    return classe_do_trabalhador(indice) == 0 && profundidade_curtas() > 0;
+}
+
+// Equivalente a desenfileirar_lote com várias filas (--roubo, --faixas): gira
+// procurando trabalho e depois dorme no aviso da sua classe até chegar mais
+static int obter_trabalho(int indice, Requisicao *lote, int max) {
+    AvisoTrabalho *aviso = &avisos_trabalho[classe_do_trabalhador(indice)];
+    for (int giro = 0;; giro++) {
+        int quantidade = coletar_trabalho(indice, lote, max);
+        if (quantidade > 0 || shutdown_flag) {
+            return quantidade;
+        }
+        if (giro < GIROS_ANTES_DE_DORMIR) {
+            pausa_cpu();
+            continue;
+        }
+
+        // Registra-se como ocioso antes de procurar de novo, para não perder o aviso
+        unsigned int sinal = atomic_load(&aviso->sinal);
+        atomic_fetch_add(&aviso->ociosos, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        quantidade = coletar_trabalho(indice, lote, max);
+        if (quantidade == 0 && !shutdown_flag && !ha_trabalho(indice)) {
+            uint64_t inicio_espera = metricas_ativas ? agora_ns() : 0;
+            futex_esperar(&aviso->sinal, sinal);
+            if (metricas_ativas) {
+                registrar_metrica(METRICA_ESPERA_FILA_VAZIA, agora_ns() - inicio_espera);
+            }
+        }
+        atomic_fetch_sub(&aviso->ociosos, 1);
+        if (quantidade > 0) {
+            return quantidade;
+        }
+    }
+}
+
+// Com --faixas balanços e juros vão para a fila das longas. Com --roubo as demais
+// vão para o dono da listra da conta de origem: a mesma thread altera sempre as
+// mesmas contas (e travas), salvo quando alguém rouba
+static FilaRequisicoes *fila_da_requisicao(const Requisicao *req) {
+    if (cfg.faixas && operacao_longa(req->operacao)) {
+        return &fila_longas;
+    }
+    if (!cfg.roubo_trabalho) {
+        return &fila_requisicoes;
+    }
+    int dono = req->id_origem >= 0 ? dono_da_conta(req->id_origem) : req->id % cfg.num_threads;
+    return &filas_trabalhadores[dono];
+}
+
+// Acorda um trabalhador ocioso da classe que atende a requisição enfileirada. Só
+// toca no sinal quando há alguém dormindo, para os clientes não disputarem essa linha
+static void avisar_trabalho(const Requisicao *req) {
+    if (!cfg.roubo_trabalho && !cfg.faixas) {
+        return;
+    }
+    AvisoTrabalho *aviso = &avisos_trabalho[classe_da_requisicao(req)];
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&aviso->ociosos) > 0) {
+        atomic_fetch_add(&aviso->sinal, 1);
+        futex_acordar(&aviso->sinal, 1);
+    }
+}
+
+// Pool elástico (--threads-min): as cfg.num_threads trabalhadoras são criadas no
+// início, mas só as primeiras pool.ativas retiram operações curtas; as demais ficam
+// estacionadas, cada uma no futex da sua vaga. O regulador acorda ou dispensa
+// trabalhadoras conforme a espera estimada na fila (profundidade vezes o tempo de
+// serviço medido por operação, dividido pelas ativas). Acordar custa um FUTEX_WAKE;
+// uma trabalhadora dispensada estaciona ao terminar o lote em andamento
+typedef struct {
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_uint sinal; // Futex em que a trabalhadora estacionada dorme
+    atomic_ullong acordada_ns;  // Instante em que o regulador a chamou, para medir o despertar
+    atomic_ullong servico_ns;   // Tempo processando lotes (escrito só pela dona)
+    atomic_ullong operacoes;
+} VagaPool;
+
+#define REDUCAO_APOS_RODADAS 20 // Rodadas seguidas com folga antes de dispensar uma trabalhadora
+
+static struct {
+    VagaPool *vagas;            // NULL = pool fixo
+    _Alignas(TAMANHO_LINHA_CACHE) atomic_int ativas; // Trabalhadoras curtas liberadas para atender
+    atomic_bool encerrar;
+    pthread_t regulador;
+    unsigned long crescimentos; // Estatísticas mantidas pelo regulador
+    unsigned long reducoes;
+    unsigned long rodadas;
+    unsigned long soma_ativas;
+    int maximo_ativas;
+    atomic_ulong despertares;   // Despertares medidos pelas próprias trabalhadoras
+    atomic_ullong despertar_soma_ns;
+    atomic_ullong despertar_maximo_ns;
+} pool;
+
+// Trabalhadoras que o pool pode estacionar: as curtas (as longas dedicadas ficam sempre ativas)
+static inline int trabalhadoras_curtas(void) {
+    return cfg.num_threads - cfg.trabalhadores_longos;
+}
+
+// Estaciona a trabalhadora enquanto ela estiver além das ativas
+static void estacionar_se_excedente(int indice) {
+    VagaPool *vaga = &pool.vagas[indice];
+    bool estacionou = false;
+    for (;;) {
+        unsigned int sinal = atomic_load(&vaga->sinal);
+        if (indice < atomic_load(&pool.ativas) || atomic_load(&pool.encerrar)) {
+            break;
+        }
+        futex_esperar(&vaga->sinal, sinal);
+        estacionou = true;
+    }
+    uint64_t chamada = atomic_exchange(&vaga->acordada_ns, 0);
+    if (estacionou && chamada != 0) {
+        uint64_t agora = agora_ns();
+        uint64_t espera = agora > chamada ? agora - chamada : 0;
+        atomic_fetch_add(&pool.despertares, 1);
+        atomic_fetch_add(&pool.despertar_soma_ns, espera);
+        unsigned long long maximo = atomic_load(&pool.despertar_maximo_ns);
+        while (espera > maximo && !atomic_compare_exchange_weak(&pool.despertar_maximo_ns, &maximo, espera)) {
+        }
+    }
+}
+
+static void registrar_servico(int indice, uint64_t duracao_ns, int quantidade) {
+    VagaPool *vaga = &pool.vagas[indice];
+    atomic_store_explicit(&vaga->servico_ns, atomic_load_explicit(&vaga->servico_ns, memory_order_relaxed) + duracao_ns,
+                          memory_order_relaxed);
+    atomic_store_explicit(&vaga->operacoes, atomic_load_explicit(&vaga->operacoes, memory_order_relaxed) + quantidade,
+                          memory_order_relaxed);
+}
+
+// Libera as trabalhadoras até a posição alvo ou dispensa as que passaram dela
+static void ajustar_pool(int alvo) {
+    int ativas = atomic_load(&pool.ativas);
+    atomic_store(&pool.ativas, alvo);
+    uint64_t agora = agora_ns();
+    for (int i = ativas; i < alvo; i++) {
+        atomic_store(&pool.vagas[i].acordada_ns, agora);
+        atomic_fetch_add(&pool.vagas[i].sinal, 1);
+        futex_acordar(&pool.vagas[i].sinal, 1);
+    }
+}
+
+static void *regulador_pool(void *arg) {
+    (void)arg;
+    int curtas = trabalhadoras_curtas();
+    uint64_t servico_anterior = 0, operacoes_anterior = 0;
+    double servico_por_operacao = 0.0; // Média móvel, em ns
+    double alvo_ns = cfg.pool_alvo_us * 1000.0;
+    int rodadas_com_folga = 0;
+    while (!atomic_load(&pool.encerrar)) {
+        simular_latencia(cfg.pool_intervalo_us);
+        uint64_t servico = 0, operacoes = 0;
+        for (int i = 0; i < curtas; i++) {
+            servico += atomic_load_explicit(&pool.vagas[i].servico_ns, memory_order_relaxed);
+            operacoes += atomic_load_explicit(&pool.vagas[i].operacoes, memory_order_relaxed);
+        }
+        if (operacoes > operacoes_anterior) {
+            double amostra = (double)(servico - servico_anterior) / (operacoes - operacoes_anterior);
+            servico_por_operacao = servico_por_operacao == 0.0 ? amostra : 0.75 * servico_por_operacao + 0.25 * amostra;
+        }
+        servico_anterior = servico;
+        operacoes_anterior = operacoes;
+
+        int ativas = atomic_load(&pool.ativas);
+        int fila = profundidade_curtas();
+        double espera_ns = fila * servico_por_operacao / ativas;
+        int alvo = ativas;
+        if (espera_ns > alvo_ns || (servico_por_operacao == 0.0 && fila > ativas * cfg.tamanho_lote)) {
+            // Quantas trabalhadoras escoariam a fila atual dentro do alvo
+            int necessarias = servico_por_operacao > 0.0 ? (int)ceil(fila * servico_por_operacao / alvo_ns) : ativas + 1;
+            alvo = necessarias > ativas ? necessarias : ativas + 1;
+            alvo = alvo < curtas ? alvo : curtas;
+            rodadas_com_folga = 0;
+        } else if (espera_ns < alvo_ns / 4 && ativas > cfg.threads_min) {
+            if (++rodadas_com_folga >= REDUCAO_APOS_RODADAS) {
+                alvo = ativas - 1;
+                rodadas_com_folga = 0;
+            }
+        } else {
+            rodadas_com_folga = 0;
+        }
+        if (alvo != ativas) {
+            if (alvo > ativas) {
+                pool.crescimentos++;
+            } else {
+                pool.reducoes++;
+            }
+            ajustar_pool(alvo);
+        }
+        pool.rodadas++;
+        pool.soma_ativas += alvo;
+        pool.maximo_ativas = alvo > pool.maximo_ativas ? alvo : pool.maximo_ativas;
+    }
+    return NULL;
+}
+
+void iniciar_pool(void) {
+    pool.vagas = alocar_alinhado(cfg.num_threads * sizeof(VagaPool), "vagas do pool elástico");
+    for (int i = 0; i < cfg.num_threads; i++) {
+        atomic_init(&pool.vagas[i].sinal, 0);
+        atomic_init(&pool.vagas[i].acordada_ns, 0);
+        atomic_init(&pool.vagas[i].servico_ns, 0);
+        atomic_init(&pool.vagas[i].operacoes, 0);
+    }
+    atomic_store(&pool.ativas, cfg.threads_min);
+    pool.maximo_ativas = cfg.threads_min;
+    if (pthread_create(&pool.regulador, NULL, regulador_pool, NULL) != 0) {
+        perror("Falha ao criar thread reguladora do pool");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Para o regulador e libera todas as trabalhadoras, para que drenem as filas e terminem
+void encerrar_pool(void) {
+    atomic_store(&pool.encerrar, true);
+    pthread_join(pool.regulador, NULL);
+    atomic_store(&pool.ativas, trabalhadoras_curtas());
+    for (int i = 0; i < trabalhadoras_curtas(); i++) {
+        atomic_fetch_add(&pool.vagas[i].sinal, 1);
+        futex_acordar(&pool.vagas[i].sinal, 1);
+    }
+}
+
+// Função para threads trabalhadoras processarem requisições
+void *trabalhador(void *arg) {
+    int indice = *(int *)arg;
+    if (cfg.fixar_nucleos) {
+        fixar_na_cpu(cpu_da_posicao(indice));
+    }
+    if (cfg.janela_ondas > 0) {
+        return trabalhador_ondas(indice);
+    }
+    Requisicao *lote = alocar_alinhado(cfg.tamanho_lote * sizeof(Requisicao), "lote do trabalhador");
+    int *listras = alocar_alinhado(2 * cfg.tamanho_lote * sizeof(int), "listras do trabalhador");
+    bool elastica = pool.vagas != NULL && indice < trabalhadoras_curtas();
+    while (1) {
+        if (elastica) {
+            estacionar_se_excedente(indice);
+        }
+        int quantidade = cfg.roubo_trabalho || cfg.faixas ? obter_trabalho(indice, lote, cfg.tamanho_lote)
+                                                          : desenfileirar_lote(&fila_requisicoes, lote, cfg.tamanho_lote);
+        if (quantidade == 0) {
+            break; // Sinal para encerrar a thread
+        }
+        if (atomic_load(&descartar_pendentes)) {
+            descartar_lote(lote, quantidade);
+            continue;
+        }
+        medir_tempo_na_fila(lote, quantidade);
+
+        // Processa as requisições
+        uint64_t inicio = elastica ? agora_ns() : 0;
+        processar_lote(lote, quantidade, listras, &slots_epoca[indice]);
+        concluir_lote(lote, quantidade, indice);
+        if (elastica) {
+            registrar_servico(indice, agora_ns() - inicio, quantidade);
+        }
+    }
+    free(lote);
+    free(listras);
+    return NULL;
+}
+
+// Função do servidor para adicionar uma nova requisição
+static int id_contador = 0; // Contador global para IDs únicos
+
+// Preenche os campos comuns de uma requisição que não veio da rede
+static Requisicao nova_requisicao(int cliente, int operacao, int id_origem, int id_destino, int64_t valor,
+                                  uint64_t criada_ns) {
+    Requisicao req;
+    req.id = 0;
+    req.operacao = operacao;
+    req.id_origem = id_origem;
+    req.id_destino = id_destino;
+    req.valor = valor;
+    req.cliente = cliente;
+    req.criada_ns = criada_ns;
+    req.conexao = -1;
+    req.geracao_conexao = 0;
+    req.etiqueta = 0;
+    req.resultado = RESULTADO_OK;
+    req.prioridade = PRIORIDADE_NORMAL;
+    req.saldo_final = 0;
+    req.chave = 0;
+    req.lancamentos = NULL;
+    return req;
+}
+
+// Teto de cada lançamento: mesmo somando MAX_LANCAMENTOS deles nada transborda
+#define LIMITE_LANCAMENTO (INT64_MAX / (2 * MAX_LANCAMENTOS))
+
+static int comparar_lancamentos(const void *a, const void *b) {
+    const Lancamento *x = a, *y = b;
+    return (x->conta > y->conta) - (x->conta < y->conta);
+}
+
+// Aloca espaço para quantidade lançamentos e as listras deles, num só bloco
+static Lancamentos *alocar_lancamentos(int quantidade) {
+    Lancamentos *lancamentos = malloc(sizeof(Lancamentos) + quantidade * (sizeof(Lancamento) + sizeof(int)));
+    if (lancamentos == NULL) {
+        perror("Falha ao alocar lançamentos");
+        exit(EXIT_FAILURE);
+    }
+    lancamentos->quantidade = quantidade;
+    lancamentos->num_listras = 0;
+    lancamentos->listras = (int *)(lancamentos->itens + quantidade);
+    return lancamentos;
+}
+
+// Normaliza os lançamentos da requisição (em ordem de conta, uma entrada por
+// conta, sem valores zero), calcula as listras que ela trava e preenche a origem
+// (primeira conta debitada), o destino (-1) e o valor (total debitado). Retorna
+// false se eles não formam uma operação válida: conta inexistente, valor acima
+// do limite ou soma diferente de zero
+static bool preparar_lancamentos(Requisicao *req) {
+    Lancamentos *lancamentos = req->lancamentos;
+    Lancamento *itens = lancamentos->itens;
+    int64_t soma = 0;
+    for (int i = 0; i < lancamentos->quantidade; i++) {
+        if (itens[i].conta < 0 || itens[i].conta >= cfg.num_contas || itens[i].valor > LIMITE_LANCAMENTO ||
+            itens[i].valor < -LIMITE_LANCAMENTO) {
+            return false;
+        }
+        itens[i].reservado = 0;
+        soma += itens[i].valor;
+    }
+    if (soma != 0) {
+        return false;
+    }
+    qsort(itens, lancamentos->quantidade, sizeof(Lancamento), comparar_lancamentos);
+    int n = 0;
+    for (int i = 0; i < lancamentos->quantidade; i++) {
+        if (n > 0 && itens[n - 1].conta == itens[i].conta) {
+            itens[n - 1].valor += itens[i].valor;
+        } else {
+            itens[n++] = itens[i];
+        }
+    }
+    int restantes = 0;
+    int64_t debitado = 0;
+    for (int i = 0; i < n; i++) {
+        if (itens[i].valor != 0) {
+            debitado -= itens[i].valor < 0 ? itens[i].valor : 0;
+            itens[restantes++] = itens[i];
+        }
+    }
+    lancamentos->quantidade = restantes;
+    if (restantes == 0) {
+        return false; // Só lançamentos que se anulavam na mesma conta
+    }
+
+    int *listras = lancamentos->listras;
+    for (int i = 0; i < restantes; i++) {
+        listras[i] = trava_da_conta(itens[i].conta);
+    }
+    qsort(listras, restantes, sizeof(int), comparar_inteiros);
+    int num_listras = 0;
+    for (int i = 0; i < restantes; i++) {
+        if (num_listras == 0 || listras[num_listras - 1] != listras[i]) {
+            listras[num_listras++] = listras[i];
+        }
+    }
+    lancamentos->num_listras = num_listras;
+
+    int origem = 0;
+    while (itens[origem].valor > 0) {
+        origem++;
+    }
+    req->id_origem = itens[origem].conta;
+    req->id_destino = -1;
+    req->valor = debitado;
+    return true;
+}
+
+#define RESULTADO_ADIADO (-1) // Interno: fila cheia para a thread de E/S, que tenta o pedido de novo depois
+
+unsigned long recusadas_ocupado[3] = {0}; // Recusas do controle de admissão, por prioridade
+unsigned long recusadas_encerramento = 0;  // Recusas depois de fechada a admissão
+atomic_int produtores_admitindo = 0;       // Threads dentro de admitir; o encerramento espera zerar
+
+// Controle de admissão: enfileira a requisição conforme cfg.admissao e a prioridade
+// dela. Retorna RESULTADO_OK, RESULTADO_OCUPADO ou RESULTADO_ENCERRANDO. Quem não
+// pode esperar (as threads de E/S) só tenta uma vez; se a política mandaria esperar
+// e o prazo dela, contado da chegada do pedido, ainda não passou, o retorno é
+// RESULTADO_ADIADO e o pedido deve ser tentado de novo quando a fila tiver espaço
+static int admitir(const Requisicao *req, bool pode_esperar) {
+    FilaRequisicoes *fila = fila_da_requisicao(req);
+    atomic_fetch_add(&produtores_admitindo, 1); // Antes de olhar a admissão (ver encerrar_threads)
+    uint64_t prazo = PRAZO_INDEFINIDO;
+    uint64_t espera = (uint64_t)cfg.admissao_espera_us * 1000ULL;
+    int resultado = RESULTADO_OK;
+    if (cfg.admissao == ADMISSAO_ESPERAR) {
+        prazo = agora_ns() + espera;
+    } else if (cfg.admissao == ADMISSAO_RECUSAR) {
+        prazo = 0;
+    } else if (cfg.admissao == ADMISSAO_PRIORIDADE) {
+        // A baixa é recusada antes de a fila encher, deixando espaço para as demais
+        prazo = req->prioridade == PRIORIDADE_ALTA ? agora_ns() + espera : 0;
+        if (req->prioridade == PRIORIDADE_BAIXA &&
+            profundidade_fila(fila) * 100L >= (long)fila->capacidade * cfg.limiar_baixa) {
+            resultado = RESULTADO_OCUPADO;
+        }
+    }
+    bool adiavel = false;
+    if (!pode_esperar && prazo != 0) {
+        adiavel = prazo == PRAZO_INDEFINIDO || agora_ns() < req->criada_ns + espera;
+        prazo = 0;
+    }
+    if (resultado == RESULTADO_OK) {
+        resultado = enfileirar(fila, *req, prazo);
+    }
+    if (resultado == RESULTADO_OCUPADO && adiavel) {
+        resultado = RESULTADO_ADIADO;
+    } else if (resultado == RESULTADO_OCUPADO) {
+        __sync_fetch_and_add(&recusadas_ocupado[req->prioridade], 1);
+    } else if (resultado == RESULTADO_ENCERRANDO) {
+        __sync_fetch_and_add(&recusadas_encerramento, 1);
+    }
+    atomic_fetch_sub(&produtores_admitindo, 1);
+    return resultado;
+}
+
+// Enfileira uma operação gerada pelo próprio servidor (balanço ou juros); elas têm
+// prioridade alta, para não serem as primeiras descartadas sob sobrecarga
+static void inserir_operacao_automatica(int operacao, bool pode_esperar) {
+    Requisicao req = nova_requisicao(-1, operacao, -1, -1, 0, agora_ns());
+    req.id = __sync_fetch_and_add(&id_contador, 1);
+    req.prioridade = PRIORIDADE_ALTA;
+
+    if (admitir(&req, pode_esperar) == RESULTADO_OK) {
+        avisar_trabalho(&req);
+    } else if (cfg.estresse) {
+        marcar_destino(req.id);
+    }
+}
+
+// Atribui o id, enfileira a requisição e insere as operações automáticas. Usada
+// pelos clientes internos e pelas threads de E/S; retorna o resultado da admissão.
+// Uma requisição recusada (ou adiada) libera a chave reservada no cache de idempotência
+int enfileirar_requisicao(Requisicao *req, bool pode_esperar) {
+    req->id = __sync_fetch_and_add(&id_contador, 1);
+    int resultado = admitir(req, pode_esperar);
+    if (resultado != RESULTADO_OK) {
+        cancelar_dedup(req);
+        if (cfg.estresse) {
+            marcar_destino(req->id);
+        }
+        return resultado;
+    }
+    avisar_trabalho(req);
+    contar_enfileirada();
+
+    // Atualiza o contador de operações
+    pthread_mutex_lock(&mutex_contador);
+    contador_operacoes++;
+    int operacoes = contador_operacoes;
+    pthread_mutex_unlock(&mutex_contador);
+
+    if (cfg.operacoes_para_balanco > 0 && operacoes % cfg.operacoes_para_balanco == 0) {  // Insere balanço geral periodicamente
+        inserir_operacao_automatica(3, pode_esperar);
+        LOG_OPERACAO("Operação de balanço adicionada automaticamente após %d operações.\n", cfg.operacoes_para_balanco);
+    }
+    if (cfg.operacoes_para_juros > 0 && operacoes % cfg.operacoes_para_juros == 0) {
+        inserir_operacao_automatica(OP_JUROS, pode_esperar);
+    }
+
+    return RESULTADO_OK;
+}
+
+static Lancamentos *montar_folha(int pagador, int creditos, int64_t semente);
+
+// Uma repetição respondida pelo cache de idempotência não entra na fila: a
+// posição dela na janela do cliente é liberada na hora. Os balanços pedidos pelos
+// clientes têm prioridade baixa. Uma folha de pagamento (OP_LANCAMENTOS) chega
+// como pagador, número de créditos e semente, e é expandida aqui
+int adicionar_requisicao(int cliente, int operacao, int id_origem, int id_destino, int64_t valor, uint64_t criada_ns,
+                         uint64_t chave) {
+    Requisicao req = nova_requisicao(cliente, operacao, id_origem, id_destino, valor, criada_ns);
+    req.chave = chave;
+    req.prioridade = operacao == OP_BALANCO ? PRIORIDADE_BAIXA : PRIORIDADE_NORMAL;
+    if (operacao == OP_LANCAMENTOS) {
+        req.lancamentos = montar_folha(id_origem, id_destino, valor);
+        if (!preparar_lancamentos(&req)) {
+            free(req.lancamentos);
+            return RESULTADO_INVALIDO;
+        }
+    }
+    if (consultar_dedup(&req)) {
+        free(req.lancamentos);
+        if (req.resultado == RESULTADO_OCUPADO) {
+            return RESULTADO_OCUPADO; // Sem espaço no cache: recusada como pela admissão
+        }
+        liberar_janela(cliente);
+        return RESULTADO_OK;
+    }
+    int resultado = enfileirar_requisicao(&req, true);
+    if (resultado != RESULTADO_OK) {
+        free(req.lancamentos);
+    }
+    return resultado;
+}
+
+// Na carga fechada, espera até o cliente ter menos de cfg.janela requisições pendentes
+static void esperar_janela(EstadoCliente *estado) {
+    unsigned int pendentes;
+    while ((pendentes = atomic_load(&estado->em_voo)) >= (unsigned int)cfg.janela) {
+        futex_esperar(&estado->em_voo, pendentes);
+    }
+}
+
+// Gerador de carga dos clientes. As contas seguem a distribuição escolhida
+// (uniforme, Zipf ou um conjunto quente, com a conta 0 como a mais procurada), as
+// operações seguem os pesos de --mix e, na carga aberta, as chegadas formam um
+// processo de Poisson. As requisições geradas podem ser gravadas num traço
+// binário e reproduzidas depois no lugar do gerador, com os mesmos instantes
+#define TRACO_MAGICA 0x54524332        // "TRC2" no cabeçalho do arquivo de traço
+#define REGISTROS_POR_ESCRITA_TRACO 2048 // Registros acumulados por cliente antes de cada write
+
+typedef struct {
+    uint32_t magica;
+    uint32_t tamanho_registro;
+    int32_t num_contas;   // Contas da execução gravada; a reprodução exige ao menos estas
+    int32_t num_clientes;
+    uint64_t semente;
+    // Distribuição da gravação: a reprodução a reaplica para remontar as folhas de pagamento
+    int32_t distribuicao;
+    int32_t contas_quentes;
+    int32_t percentual_quente;
+    int32_t reservado;
+    double zipf_expoente;
+} CabecalhoTraco;
+
+typedef struct {
+    uint64_t instante_ns; // Criação, contada do início dos clientes
+    int32_t cliente;      // Na reprodução, o registro vai para o cliente (cliente % cfg.num_clientes)
+    int32_t operacao;
+    int32_t origem;
+    int32_t destino;
+    int64_t valor;
+} RegistroTraco;
+
+_Static_assert(sizeof(RegistroTraco) == 32, "RegistroTraco deve ter 32 bytes");
+
+// Tabela de alias (método de Vose): sorteia uma conta com pesos arbitrários usando
+// um único número aleatório, metade para a coluna e metade para o limiar dela
+typedef struct {
+    uint64_t *limiar; // Em unidades de 2^-32; abaixo dele fica a própria coluna
+    int *alias;
+} TabelaAlias;
+
+typedef struct {
+    RegistroTraco *registros;
+    size_t quantidade;
+} TracoCliente;
+
+TabelaAlias tabela_zipf;
+int contas_sorteio;              // Contas sorteadas: cfg.num_contas, ou as do traço reproduzido
+TracoCliente *tracos_clientes;   // Com --reproduzir-traco: as requisições de cada cliente
+RegistroTraco *registros_traco;  // Conteúdo do arquivo reproduzido
+int fd_traco = -1;               // Com --gravar-traco
+unsigned long requisicoes_traco = 0; // Gravadas ou reproduzidas
+uint64_t inicio_clientes_ns;     // Referência dos instantes do traço
+unsigned long retentativas_enviadas = 0; // Repetições geradas pelos clientes (--retentativas)
+
+// Monta a tabela de alias dos pesos 1/k^s, k = 1..num_contas
+void montar_tabela_zipf(void) {
+    int n = contas_sorteio;
+    double *escala = malloc(n * sizeof(double));
+    int *pequenos = malloc(n * sizeof(int));
+    int *grandes = malloc(n * sizeof(int));
+    tabela_zipf.limiar = alocar_alinhado(n * sizeof(uint64_t), "limiares da tabela Zipf");
+    tabela_zipf.alias = alocar_alinhado(n * sizeof(int), "alias da tabela Zipf");
+    if (escala == NULL || pequenos == NULL || grandes == NULL) {
+        perror("Falha ao alocar tabela Zipf");
+        exit(EXIT_FAILURE);
+    }
+    double soma = 0.0;
+    for (int i = 0; i < n; i++) {
+        escala[i] = pow(i + 1, -cfg.zipf_expoente);
+        soma += escala[i];
+    }
+    int num_pequenos = 0, num_grandes = 0;
+    for (int i = 0; i < n; i++) {
+        escala[i] *= n / soma; // Média 1: cada coluna da tabela vale 1/n
+        if (escala[i] < 1.0) {
+            pequenos[num_pequenos++] = i;
+        } else {
+            grandes[num_grandes++] = i;
+        }
+    }
+    while (num_pequenos > 0 && num_grandes > 0) {
+        int pequeno = pequenos[--num_pequenos];
+        int grande = grandes[num_grandes - 1];
+        tabela_zipf.limiar[pequeno] = (uint64_t)(escala[pequeno] * 4294967296.0);
+        tabela_zipf.alias[pequeno] = grande;
+        escala[grande] -= 1.0 - escala[pequeno];
+        if (escala[grande] < 1.0) {
+            num_grandes--;
+            pequenos[num_pequenos++] = grande;
+        }
+    }
+    // As sobras valem 1 (a menos de arredondamento) e sempre ficam com a própria coluna
+    while (num_grandes > 0) {
+        int i = grandes[--num_grandes];
+        tabela_zipf.limiar[i] = 1ULL << 32;
+        tabela_zipf.alias[i] = i;
+    }
+    while (num_pequenos > 0) {
+        int i = pequenos[--num_pequenos];
+        tabela_zipf.limiar[i] = 1ULL << 32;
+        tabela_zipf.alias[i] = i;
+    }
+    free(escala);
+    free(pequenos);
+    free(grandes);
+}
+
+static inline int sortear_conta(Gerador *gerador) {
+    if (cfg.distribuicao == DISTRIBUICAO_ZIPF) {
+        uint64_t x = proximo_aleatorio(gerador);
+        int coluna = (int)((x >> 32) * (uint64_t)contas_sorteio >> 32);
+        return (x & 0xFFFFFFFFULL) < tabela_zipf.limiar[coluna] ? coluna : tabela_zipf.alias[coluna];
+    }
+    if (cfg.distribuicao == DISTRIBUICAO_QUENTE) {
+        if (aleatorio_ate(gerador, 100) < cfg.percentual_quente) {
+            return aleatorio_ate(gerador, cfg.contas_quentes);
+        }
+        return cfg.contas_quentes + aleatorio_ate(gerador, contas_sorteio - cfg.contas_quentes);
+    }
+    return aleatorio_ate(gerador, contas_sorteio);
+}
+
+// Folha de pagamento dos clientes internos: o pagador credita creditos contas
+// sorteadas a partir da semente e é debitado do total. O traço guarda só os três
+// números; como o sorteio depende da distribuição e do número de contas, o
+// cabeçalho do traço leva os dois e a reprodução os reaplica (ver carregar_traco)
+static Lancamentos *montar_folha(int pagador, int creditos, int64_t semente) {
+    Gerador gerador;
+    semear(&gerador, (uint64_t)semente);
+    Lancamentos *lancamentos = alocar_lancamentos(creditos + 1);
+    int64_t total = 0;
+    for (int i = 0; i < creditos; i++) {
+        lancamentos->itens[i].conta = sortear_conta(&gerador);
+        lancamentos->itens[i].valor = 1 + aleatorio_ate(&gerador, SALDO_INICIAL / creditos);
+        total += lancamentos->itens[i].valor;
+    }
+    lancamentos->itens[creditos].conta = pagador;
+    lancamentos->itens[creditos].valor = -total;
+    return lancamentos;
+}
+
+// Intervalo até a próxima chegada: exponencial com a média dada (Poisson) ou fixo
+static inline uint64_t proximo_intervalo(Gerador *gerador, double media_ns) {
+    if (!cfg.chegadas_poisson) {
+        return (uint64_t)media_ns;
+    }
+    double u = (proximo_aleatorio(gerador) >> 11) * 0x1.0p-53; // Uniforme em [0, 1)
+    return (uint64_t)(-log1p(-u) * media_ns);
+}
+
+// Sorteia a próxima requisição do cliente: operação pelos pesos de --mix, contas
+// pela distribuição e valor de 0,00 a 99,90. Retorna false para transferências da
+// conta para ela mesma, que são apenas descartadas. Uma folha de pagamento leva o
+// número de créditos no destino e a semente deles no valor (ver montar_folha)
+static bool gerar_requisicao(Gerador *gerador, RegistroTraco *req) {
+    int sorteio = aleatorio_ate(gerador, cfg.mix[0] + cfg.mix[1] + cfg.mix[2] + cfg.mix[3]);
+    req->operacao = sorteio < cfg.mix[0]                             ? 1
+                    : sorteio < cfg.mix[0] + cfg.mix[1]              ? 2
+                    : sorteio < cfg.mix[0] + cfg.mix[1] + cfg.mix[2] ? 3
+                                                                      : OP_LANCAMENTOS;
+    req->origem = sortear_conta(gerador);
+    req->destino = sortear_conta(gerador);
+    req->valor = (int64_t)aleatorio_ate(gerador, 1000) * 10; // Em centavos
+    if (req->operacao == 2 && req->origem == req->destino) {
+        return false;
+    }
+    if (req->operacao == OP_LANCAMENTOS) {
+        req->destino = cfg.creditos_por_folha;
+        req->valor = (int64_t)(proximo_aleatorio(gerador) >> 1);
+        return true;
+    }
+    if (req->operacao != 2) {
+        req->destino = -1;
+    }
+    if (req->operacao == 3) {
+        req->origem = -1;
+        req->valor = 0;
+    }
+    return true;
+}
+
+// Acrescenta os registros ao traço com um único write; com O_APPEND os blocos dos
+// clientes se intercalam sem se misturar
+static void gravar_registros_traco(const RegistroTraco *registros, int quantidade) {
+    const char *dados = (const char *)registros;
+    size_t tamanho = (size_t)quantidade * sizeof(RegistroTraco);
+    while (tamanho > 0) {
+        ssize_t n = write(fd_traco, dados, tamanho);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Falha ao gravar traço");
+            exit(EXIT_FAILURE);
+        }
+        dados += n;
+        tamanho -= (size_t)n;
+    }
+    __sync_fetch_and_add(&requisicoes_traco, quantidade);
+}
+
+void abrir_gravacao_traco(const char *caminho) {
+    fd_traco = open(caminho, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd_traco < 0) {
+        perror("Falha ao criar arquivo de traço");
+        exit(EXIT_FAILURE);
+    }
+    CabecalhoTraco cabecalho = {
+        .magica = TRACO_MAGICA,
+        .tamanho_registro = sizeof(RegistroTraco),
+        .num_contas = cfg.num_contas,
+        .num_clientes = cfg.num_clientes,
+        .semente = cfg.semente,
+        .distribuicao = cfg.distribuicao,
+        .contas_quentes = cfg.contas_quentes,
+        .percentual_quente = cfg.percentual_quente,
+        .zipf_expoente = cfg.zipf_expoente,
+    };
+    if (write(fd_traco, &cabecalho, sizeof(cabecalho)) != (ssize_t)sizeof(cabecalho)) {
+        perror("Falha ao gravar cabeçalho do traço");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int comparar_registros_traco(const void *a, const void *b) {
+    const RegistroTraco *x = a, *y = b;
+    if (x->instante_ns != y->instante_ns) {
+        return x->instante_ns < y->instante_ns ? -1 : 1;
+    }
+    return (x > y) - (x < y); // Empate: ordem do arquivo
+}
+
+// Lê o traço inteiro e reparte os registros entre os clientes, cada parte em
+// ordem de instante. A distribuição e o número de contas da gravação substituem
+// os desta execução, para que as folhas de pagamento sorteiem as mesmas contas
+void carregar_traco(const char *caminho) {
+    FILE *arquivo = fopen(caminho, "rb");
+    if (arquivo == NULL) {
+        perror("Falha ao abrir arquivo de traço");
+        exit(EXIT_FAILURE);
+    }
+    CabecalhoTraco cabecalho;
+    if (fread(&cabecalho, sizeof(cabecalho), 1, arquivo) != 1 || cabecalho.magica != TRACO_MAGICA ||
+        cabecalho.tamanho_registro != sizeof(RegistroTraco)) {
+        fprintf(stderr, "Arquivo de traço inválido: %s\n", caminho);
+        exit(EXIT_FAILURE);
+    }
+    if (cabecalho.num_contas > cfg.num_contas) {
+        fprintf(stderr, "O traço %s usa %d contas; execute com --contas %d ou mais\n", caminho,
+                cabecalho.num_contas, cabecalho.num_contas);
+        exit(EXIT_FAILURE);
+    }
+    contas_sorteio = cabecalho.num_contas;
+    cfg.distribuicao = cabecalho.distribuicao;
+    cfg.contas_quentes = cabecalho.contas_quentes;
+    cfg.percentual_quente = cabecalho.percentual_quente;
+    cfg.zipf_expoente = cabecalho.zipf_expoente;
+    fseek(arquivo, 0, SEEK_END);
+    size_t total = (size_t)(ftell(arquivo) - (long)sizeof(cabecalho)) / sizeof(RegistroTraco);
+    fseek(arquivo, sizeof(cabecalho), SEEK_SET);
+    RegistroTraco *lidos = malloc((total + 1) * sizeof(RegistroTraco));
+    registros_traco = malloc((total + 1) * sizeof(RegistroTraco));
+    tracos_clientes = calloc(cfg.num_clientes > 0 ? cfg.num_clientes : 1, sizeof(TracoCliente));
+    if (lidos == NULL || registros_traco == NULL || tracos_clientes == NULL) {
+        perror("Falha ao alocar traço");
+        exit(EXIT_FAILURE);
+    }
+    if (fread(lidos, sizeof(RegistroTraco), total, arquivo) != total) {
+        fprintf(stderr, "Arquivo de traço truncado: %s\n", caminho);
+        exit(EXIT_FAILURE);
+    }
+    fclose(arquivo);
+
+    // Conta quantos registros cabem a cada cliente e copia cada um para a sua parte
+    for (size_t i = 0; i < total && cfg.num_clientes > 0; i++) {
+        tracos_clientes[lidos[i].cliente % cfg.num_clientes].quantidade++;
+    }
+    size_t deslocamento = 0;
+    for (int c = 0; c < cfg.num_clientes; c++) {
+        tracos_clientes[c].registros = registros_traco + deslocamento;
+        deslocamento += tracos_clientes[c].quantidade;
+        tracos_clientes[c].quantidade = 0;
+    }
+    for (size_t i = 0; i < total && cfg.num_clientes > 0; i++) {
+        TracoCliente *traco = &tracos_clientes[lidos[i].cliente % cfg.num_clientes];
+        traco->registros[traco->quantidade++] = lidos[i];
+    }
+    for (int c = 0; c < cfg.num_clientes; c++) {
+        qsort(tracos_clientes[c].registros, tracos_clientes[c].quantidade, sizeof(RegistroTraco),
+              comparar_registros_traco);
+    }
+    free(lidos);
+    fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout, "Traço: %zu requisições de %d clientes carregadas de %s\n",
+            total, cabecalho.num_clientes, caminho);
+}
+
+// Com --rajadas, a taxa da carga aberta é multiplicada por cfg.rajada_fator durante
+// os primeiros cfg.rajada_ms de cada período de cfg.rajada_periodo_ms
+static inline double intervalo_atual(uint64_t instante_ns, double intervalo_medio_ns) {
+    if (cfg.rajada_fator <= 1) {
+        return intervalo_medio_ns;
+    }
+    uint64_t fase = (instante_ns - inicio_clientes_ns) / 1000000ULL % (uint64_t)cfg.rajada_periodo_ms;
+    return fase < (uint64_t)cfg.rajada_ms ? intervalo_medio_ns / cfg.rajada_fator : intervalo_medio_ns;
+}
+
+// Função para gerar requisições, sorteadas ou lidas do traço
+void *cliente(void *arg) {
+    int id = *(int *)arg;
+    if (cfg.fixar_nucleos) {
+        fixar_na_cpu(cpu_da_posicao(cfg.num_threads + id));
+    }
+    EstadoCliente *estado = &estados_clientes[id];
+    Gerador gerador;
+    semear(&gerador, cfg.semente + (uint64_t)id);
+    const TracoCliente *reproducao = tracos_clientes != NULL ? &tracos_clientes[id] : NULL;
+    size_t proximo_registro = 0;
+    RegistroTraco *gravacao = NULL;
+    int gravados = 0;
+    if (fd_traco >= 0) {
+        gravacao = alocar_alinhado(REGISTROS_POR_ESCRITA_TRACO * sizeof(RegistroTraco), "traço do cliente");
+    }
+
+    // Na carga aberta cada cliente envia no ritmo cfg.taxa_alvo / cfg.num_clientes;
+    // a latência é medida a partir do instante programado, para que atrasos do
+    // próprio cliente também apareçam
+    double intervalo_medio_ns = cfg.carga == CARGA_ABERTA ? 1e9 * cfg.num_clientes / cfg.taxa_alvo : 0.0;
+    uint64_t proximo_envio = agora_ns();
+    uint64_t sequencia = 0;
+
+    while (!shutdown_flag) {
+        RegistroTraco req;
+        if (reproducao != NULL) {
+            if (proximo_registro == reproducao->quantidade) {
+                break; // Traço esgotado
+            }
+            req = reproducao->registros[proximo_registro++];
+        } else if (!gerar_requisicao(&gerador, &req)) {
+            continue;
+        }
+
+        uint64_t criada_ns;
+        if (cfg.carga == CARGA_ABERTA) {
+            proximo_envio = reproducao != NULL ? inicio_clientes_ns + req.instante_ns
+                                               : proximo_envio + proximo_intervalo(&gerador, intervalo_atual(proximo_envio, intervalo_medio_ns));
+            dormir_ate(proximo_envio);
+            criada_ns = proximo_envio;
+        } else {
+            if (cfg.carga == CARGA_FECHADA) {
+                esperar_janela(estado);
+            }
+            criada_ns = agora_ns();
+        }
+
+        // Chaves únicas por cliente; com --retentativas parte das requisições é
+        // reenviada com a mesma chave, como faria um cliente após um tempo esgotado
+        uint64_t chave = ((uint64_t)(id + 1) << 40) | ++sequencia;
+        // Uma requisição recusada pelo controle de admissão não ocupa a janela
+        atomic_fetch_add(&estado->em_voo, 1);
+        int resultado = adicionar_requisicao(id, req.operacao, req.origem, req.destino, req.valor, criada_ns, chave);
+        if (resultado != RESULTADO_OK) {
+            atomic_fetch_sub(&estado->em_voo, 1);
+            if (resultado == RESULTADO_ENCERRANDO) {
+                break; // Sinal para encerrar a thread
+            }
+        }
+        if (cfg.percentual_retentativas > 0 && aleatorio_ate(&gerador, 100) < cfg.percentual_retentativas) {
+            if (cfg.carga == CARGA_FECHADA) {
+                esperar_janela(estado);
+            }
+            atomic_fetch_add(&estado->em_voo, 1);
+            resultado = adicionar_requisicao(id, req.operacao, req.origem, req.destino, req.valor, agora_ns(), chave);
+            if (resultado != RESULTADO_OK) {
+                atomic_fetch_sub(&estado->em_voo, 1);
+                if (resultado == RESULTADO_ENCERRANDO) {
+                    break;
+                }
+            }
+            __sync_fetch_and_add(&retentativas_enviadas, 1);
+        }
+        if (reproducao != NULL) {
+            __sync_fetch_and_add(&requisicoes_traco, 1);
+        }
+        if (gravacao != NULL) {
+            req.instante_ns = criada_ns - inicio_clientes_ns;
+            req.cliente = id;
+            gravacao[gravados++] = req;
+            if (gravados == REGISTROS_POR_ESCRITA_TRACO) {
+                gravar_registros_traco(gravacao, gravados);
+                gravados = 0;
+            }
+        }
+
+        simular_latencia_ate(cfg.latencia_cliente_us, &admissao_fechada); // Espera antes de gerar nova requisição
+    }
+    if (gravacao != NULL) {
+        gravar_registros_traco(gravacao, gravados);
+        free(gravacao);
+    }
+    return NULL;
+}
+
+// Frente de rede: cada thread de E/S tem seu próprio epoll e atende as conexões
+// que aceitou. Os pedidos são decodificados direto do buffer da conexão para a
+// fila de requisições, e os trabalhadores devolvem as respostas pela caixa da
+// thread dona da conexão, acordando-a por um eventfd
+typedef struct {
+    int conexao;        // Índice da conexão na thread de E/S
+    uint32_t geracao;
+    unsigned long passagem_wal; // Passada do WAL que precisa estar durável para a resposta sair (0 = nenhuma)
+    RespostaRede resposta;
+} RespostaPendente;
+
+typedef struct {
+    int fd;             // -1 = posição livre
+    uint32_t geracao;   // Muda a cada reuso da posição
+    int em_voo;         // Pedidos enfileirados cuja resposta ainda não entrou em saida
+    uint32_t eventos;   // Interesse registrado no epoll
+    bool tocada;        // Recebeu respostas na rodada atual
+    bool na_espera;     // Está em ThreadIo.sem_espaco
+    uint64_t adiado_ns; // Chegada do pedido à frente da entrada que espera espaço na fila (0 = nenhum)
+    size_t entrada_usada;
+    size_t saida_inicio;
+    size_t saida_fim;
+    char *entrada;      // Alocados no primeiro uso da posição e mantidos para as próximas conexões
+    char *saida;
+} Conexao;
+
+typedef struct {
+    pthread_t thread;
+    int indice;
+    int epoll_fd;
+    int evento_fd;              // Sinalizado pelos trabalhadores quando deixam respostas
+    Conexao *conexoes;
+    int *livres;                // Pilha de posições livres em conexoes
+    int num_livres;
+    int *tocadas;               // Conexões que receberam respostas na rodada
+    int *sem_espaco;            // Conexões com um pedido adiado por falta de espaço na fila
+    int num_sem_espaco;
+    unsigned long rodadas_retomada;
+    atomic_bool aguardando_espaco; // Pediu aviso dos trabalhadores quando a fila esvaziar
+    RespostaPendente *recolhidas; // Cópia das respostas retiradas da caixa
+    RespostaPendente *retidas;  // Respostas à espera do commit do WAL
+    int num_retidas;
+    atomic_bool aguardando_wal; // Pediu aviso da thread do WAL no próximo commit
+    int em_voo;                 // Pedidos desta thread ainda sem resposta (soma das conexões, inclusive fechadas)
+    unsigned long conexoes_aceitas;
+    unsigned long pedidos;
+    unsigned long adiamentos;   // Tentativas de enfileirar adiadas por falta de espaço na fila
+    unsigned long leituras;
+    unsigned long escritas;
+    unsigned long respostas;
+    _Alignas(TAMANHO_LINHA_CACHE) pthread_mutex_t trava; // Protege a caixa de respostas
+    RespostaPendente *caixa;    // Anel com até LIMITE_EM_VOO_IO respostas
+    int caixa_inicio;
+    int caixa_tamanho;
+    bool avisada;               // evento_fd já sinalizado e ainda não lido
+} ThreadIo;
+
+#define TOKEN_ESCUTA_TCP ((uint64_t)MAX_CONEXOES_IO)
+#define TOKEN_ESCUTA_UNIX ((uint64_t)MAX_CONEXOES_IO + 1)
+#define TOKEN_EVENTO ((uint64_t)MAX_CONEXOES_IO + 2)
+
+ThreadIo *threads_io = NULL;
+int escuta_tcp = -1;
+int escuta_unix = -1;
+atomic_bool rede_encerrar = false;
+
+// Chamada pelos trabalhadores ao concluir um lote: agrupa as respostas por thread
+// de E/S e só escreve no eventfd se a thread ainda não tiver sido avisada.
+// A caixa nunca transborda porque cada thread de E/S limita seus pedidos pendentes.
+// Com o WAL ligado, cada resposta leva a passada do WAL que com certeza recolhe os
+// registros do lote (a seguinte à que pode estar em curso), e a thread de E/S só a
+// entrega depois do fdatasync dessa passada: um RESULTADO_OK recebido é durável
+static void responder_lote(const Requisicao *lote, int quantidade) {
+    if (threads_io == NULL) {
+        return;
+    }
+    unsigned long passagem_wal = fd_wal >= 0 ? atomic_load(&passagens_wal) + 2 : 0;
+    for (int t = 0; t < cfg.threads_io; t++) {
+        ThreadIo *io = &threads_io[t];
+        bool travou = false;
+        for (int i = 0; i < quantidade; i++) {
+            const Requisicao *req = &lote[i];
+            if (req->conexao < 0 || req->conexao / MAX_CONEXOES_IO != t) {
+                continue;
+            }
+            if (!travou) {
+                pthread_mutex_lock(&io->trava);
+                travou = true;
+            }
+            RespostaPendente *pendente = &io->caixa[(io->caixa_inicio + io->caixa_tamanho) % LIMITE_EM_VOO_IO];
+            io->caixa_tamanho++;
+            pendente->conexao = req->conexao % MAX_CONEXOES_IO;
+            pendente->geracao = req->geracao_conexao;
+            pendente->passagem_wal = passagem_wal;
+            memset(&pendente->resposta, 0, sizeof(RespostaRede));
+            pendente->resposta.etiqueta = req->etiqueta;
+            pendente->resposta.id_operacao = (uint32_t)req->id;
+            pendente->resposta.resultado = (uint8_t)req->resultado;
+            pendente->resposta.operacao = (uint8_t)req->operacao;
+            pendente->resposta.saldo = req->saldo_final;
+        }
+        if (travou) {
+            bool avisar = !io->avisada;
+            io->avisada = true;
+            pthread_mutex_unlock(&io->trava);
+            if (avisar) {
+                uint64_t um = 1;
+                if (write(io->evento_fd, &um, sizeof(um)) < 0) {
+                    perror("Falha ao sinalizar thread de E/S");
+                }
+            }
+        }
+    }
+}
+
+static void acordar_thread_io(ThreadIo *io) {
+    pthread_mutex_lock(&io->trava);
+    bool avisar = !io->avisada;
+    io->avisada = true;
+    pthread_mutex_unlock(&io->trava);
+    if (avisar) {
+        uint64_t um = 1;
+        if (write(io->evento_fd, &um, sizeof(um)) < 0) {
+            perror("Falha ao sinalizar thread de E/S");
+        }
+    }
+}
+
+// Chamada pela thread do WAL depois de um commit, se alguma thread de E/S retém respostas
+static void acordar_threads_io_aguardando_wal(void) {
+    for (int t = 0; t < cfg.threads_io; t++) {
+        ThreadIo *io = &threads_io[t];
+        if (atomic_load_explicit(&io->aguardando_wal, memory_order_relaxed) &&
+            atomic_exchange(&io->aguardando_wal, false)) {
+            atomic_fetch_sub(&threads_io_aguardando_wal, 1);
+            acordar_thread_io(io);
+        }
+    }
+}
+
+// Chamada por quem retira requisições de uma fila enquanto alguma thread de E/S
+// espera espaço; o aviso chega pelo mesmo eventfd das respostas
+static void acordar_threads_io_sem_espaco(void) {
+    for (int t = 0; threads_io != NULL && t < cfg.threads_io; t++) {
+        ThreadIo *io = &threads_io[t];
+        if (atomic_load_explicit(&io->aguardando_espaco, memory_order_relaxed) &&
+            atomic_exchange(&io->aguardando_espaco, false)) {
+            atomic_fetch_sub(&threads_io_sem_espaco, 1);
+            acordar_thread_io(io);
+        }
+    }
+}
+
+static inline int respostas_na_saida(const Conexao *conexao) {
+    return (int)((conexao->saida_fim - conexao->saida_inicio) / sizeof(RespostaRede));
+}
+
+// A conexão só aceita outro pedido se a resposta dele couber na saída
+static inline bool pode_aceitar(const ThreadIo *io, const Conexao *conexao) {
+    return conexao->em_voo + respostas_na_saida(conexao) < LIMITE_EM_VOO_CONEXAO && io->em_voo < LIMITE_EM_VOO_IO;
+}
+
+static void anexar_resposta(Conexao *conexao, const RespostaRede *resposta) {
+    if (conexao->saida_fim + sizeof(RespostaRede) > TAMANHO_SAIDA_REDE) {
+        size_t pendentes = conexao->saida_fim - conexao->saida_inicio;
+        memmove(conexao->saida, conexao->saida + conexao->saida_inicio, pendentes);
+        conexao->saida_inicio = 0;
+        conexao->saida_fim = pendentes;
+    }
+    memcpy(conexao->saida + conexao->saida_fim, resposta, sizeof(RespostaRede));
+    conexao->saida_fim += sizeof(RespostaRede);
+}
+
+static void fechar_conexao(ThreadIo *io, int indice) {
+    Conexao *conexao = &io->conexoes[indice];
+    close(conexao->fd); // Também remove o fd do epoll
+    conexao->fd = -1;
+    conexao->geracao++;
+    conexao->em_voo = 0; // As respostas que ainda chegarem são descartadas pela geração
+    conexao->adiado_ns = 0;
+    if (conexao->na_espera) {
+        conexao->na_espera = false;
+        for (int i = 0; i < io->num_sem_espaco; i++) {
+            if (io->sem_espaco[i] == indice) {
+                io->sem_espaco[i] = io->sem_espaco[--io->num_sem_espaco];
+                break;
+            }
+        }
+    }
+    io->livres[io->num_livres++] = indice;
+}
+
+// Envia o que couber da saída sem bloquear; retorna false se a conexão caiu
+static bool escrever_conexao(ThreadIo *io, Conexao *conexao) {
+    while (conexao->saida_inicio < conexao->saida_fim) {
+        ssize_t n = send(conexao->fd, conexao->saida + conexao->saida_inicio,
+                         conexao->saida_fim - conexao->saida_inicio, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        io->escritas++;
+        conexao->saida_inicio += n;
+    }
+    conexao->saida_inicio = conexao->saida_fim = 0;
+    return true;
+}
+
+// Lê do epoll só o que a conexão consegue tratar agora: entrada enquanto ela
+// aceitar pedidos e não tiver um pedido à espera de espaço na fila, saída enquanto
+// houver respostas por enviar
+static void atualizar_interesse(ThreadIo *io, int indice) {
+    Conexao *conexao = &io->conexoes[indice];
+    uint32_t eventos = (pode_aceitar(io, conexao) && conexao->adiado_ns == 0 ? EPOLLIN : 0) |
+                       (conexao->saida_fim > conexao->saida_inicio ? EPOLLOUT : 0);
+    if (eventos != conexao->eventos) {
+        struct epoll_event evento = {.events = eventos, .data.u64 = (uint64_t)indice};
+        epoll_ctl(io->epoll_fd, EPOLL_CTL_MOD, conexao->fd, &evento);
+        conexao->eventos = eventos;
+    }
+}
+
+// Copia os quadros LancamentoRede que seguem um pedido OP_LANCAMENTOS
+static Lancamentos *ler_lancamentos(int quantidade, const char *dados) {
+    Lancamentos *lancamentos = alocar_lancamentos(quantidade);
+    for (int i = 0; i < quantidade; i++) {
+        LancamentoRede item;
+        memcpy(&item, dados + i * sizeof(item), sizeof(item));
+        lancamentos->itens[i].conta = item.conta;
+        lancamentos->itens[i].valor = item.valor;
+    }
+    return lancamentos;
+}
+
+// Pede à thread do WAL que acorde esta thread no próximo commit; retorna false se
+// o pedido anterior ainda não foi atendido
+static bool pedir_aviso_do_wal(ThreadIo *io) {
+    if (atomic_load(&io->aguardando_wal)) {
+        return false;
+    }
+    atomic_store(&io->aguardando_wal, true);
+    atomic_fetch_add(&threads_io_aguardando_wal, 1);
+    return true;
+}
+
+// Guarda uma resposta da própria thread de E/S até o commit do WAL que cobre as
+// operações concluídas antes dela; conta como pedido pendente da conexão
+static void reter_resposta(ThreadIo *io, int indice, const RespostaRede *resposta) {
+    Conexao *conexao = &io->conexoes[indice];
+    RespostaPendente *retida = &io->retidas[io->num_retidas++];
+    retida->conexao = indice;
+    retida->geracao = conexao->geracao;
+    retida->passagem_wal = atomic_load(&passagens_wal) + 2;
+    retida->resposta = *resposta;
+    conexao->em_voo++;
+    io->em_voo++;
+    if (pedir_aviso_do_wal(io) && atomic_load(&passagem_duravel_wal) >= retida->passagem_wal) {
+        acordar_thread_io(io); // O commit veio antes do pedido de aviso
+    }
+}
+
+// Converte um pedido em requisição e o enfileira; pedidos inválidos são
+// respondidos pela própria thread de E/S. dados aponta os lançamentos que seguem
+// um pedido OP_LANCAMENTOS. A thread de E/S nunca dorme na fila: se a política de
+// admissão mandaria esperar, retorna false sem consumir o pedido, que é tentado de
+// novo (com o instante da primeira chegada) quando um trabalhador liberar espaço
+static bool aceitar_pedido(ThreadIo *io, int indice, const PedidoRede *pedido, const char *dados) {
+    Conexao *conexao = &io->conexoes[indice];
+    uint64_t chegada = conexao->adiado_ns != 0 ? conexao->adiado_ns : agora_ns();
+    conexao->adiado_ns = 0;
+    bool conta_valida = pedido->origem >= 0 && pedido->origem < cfg.num_contas;
+    bool valor_valido = pedido->valor >= 0 && pedido->valor <= LIMITE_LANCAMENTO;
+    bool valido = (pedido->operacao == OP_DEPOSITO && conta_valida && valor_valido) ||
+                  (pedido->operacao == OP_TRANSFERENCIA && conta_valida && valor_valido &&
+                   pedido->destino >= 0 && pedido->destino < cfg.num_contas && pedido->destino != pedido->origem) ||
+                  pedido->operacao == OP_BALANCO || pedido->operacao == OP_LANCAMENTOS;
+    valido = valido && pedido->prioridade <= PRIORIDADE_BAIXA;
+    RespostaRede resposta = {.etiqueta = pedido->etiqueta, .operacao = pedido->operacao};
+    if (!valido) {
+        resposta.resultado = RESULTADO_INVALIDO;
+        anexar_resposta(conexao, &resposta);
+        return true;
+    }
+
+    bool sem_conta = pedido->operacao == OP_BALANCO || pedido->operacao == OP_LANCAMENTOS;
+    Requisicao req = nova_requisicao(-1, pedido->operacao, sem_conta ? -1 : pedido->origem,
+                                     pedido->operacao == OP_TRANSFERENCIA ? pedido->destino : -1,
+                                     sem_conta ? 0 : pedido->valor, chegada);
+    req.conexao = io->indice * MAX_CONEXOES_IO + indice;
+    req.geracao_conexao = conexao->geracao;
+    req.etiqueta = pedido->etiqueta;
+    req.chave = pedido->chave;
+    req.prioridade = pedido->prioridade;
+    if (pedido->operacao == OP_LANCAMENTOS) {
+        req.lancamentos = ler_lancamentos(pedido->origem, dados);
+        if (!preparar_lancamentos(&req)) {
+            free(req.lancamentos);
+            resposta.resultado = RESULTADO_INVALIDO;
+            anexar_resposta(conexao, &resposta);
+            return true;
+        }
+    }
+    if (consultar_dedup(&req)) {
+        free(req.lancamentos);
+        resposta.id_operacao = (uint32_t)req.id;
+        resposta.resultado = (uint8_t)req.resultado;
+        resposta.repetida = req.resultado != RESULTADO_OCUPADO;
+        resposta.saldo = req.saldo_final;
+        if (fd_wal >= 0 && resposta.repetida) {
+            // A primeira execução pode ter respondido ao cache antes do commit dela
+            reter_resposta(io, indice, &resposta);
+        } else {
+            anexar_resposta(conexao, &resposta);
+        }
+        return true;
+    }
+    conexao->em_voo++;
+    io->em_voo++;
+    io->pedidos++;
+    int resultado = enfileirar_requisicao(&req, false);
+    if (resultado != RESULTADO_OK) {
+        free(req.lancamentos);
+        conexao->em_voo--;
+        io->em_voo--;
+        if (resultado == RESULTADO_ADIADO) {
+            io->pedidos--;
+            io->adiamentos++;
+            conexao->adiado_ns = chegada;
+            return false;
+        }
+        resposta.resultado = (uint8_t)resultado;
+        anexar_resposta(conexao, &resposta);
+    }
+    return true;
+}
+
+// Põe a conexão entre as que esperam espaço na fila e pede aos trabalhadores que
+// acordem esta thread ao retirar requisições. Retorna true se o pedido acabou de
+// ser feito: nesse caso o enfileiramento deve ser tentado mais uma vez, pois o
+// espaço pode ter sido liberado antes de os trabalhadores enxergarem o pedido
+static bool esperar_espaco(ThreadIo *io, int indice) {
+    Conexao *conexao = &io->conexoes[indice];
+    if (!conexao->na_espera) {
+        conexao->na_espera = true;
+        io->sem_espaco[io->num_sem_espaco++] = indice;
+    }
+    if (atomic_load_explicit(&io->aguardando_espaco, memory_order_relaxed)) {
+        return false;
+    }
+    atomic_store(&io->aguardando_espaco, true);
+    atomic_fetch_add(&threads_io_sem_espaco, 1);
+    atomic_thread_fence(memory_order_seq_cst); // Antes de tentar de novo (ver avisar_espaco_threads_io)
+    return true;
+}
+
+// Decodifica os pedidos completos da entrada enquanto a conexão puder aceitá-los.
+// Retorna false se um pedido OP_LANCAMENTOS anuncia uma quantidade impossível: o
+// fluxo não pode mais ser delimitado e a conexão deve ser fechada
+static bool decodificar_pedidos(ThreadIo *io, int indice) {
+    Conexao *conexao = &io->conexoes[indice];
+    size_t posicao = 0;
+    while (conexao->entrada_usada - posicao >= sizeof(PedidoRede) && pode_aceitar(io, conexao) &&
+           !atomic_load_explicit(&rede_encerrar, memory_order_relaxed)) {
+        PedidoRede pedido;
+        memcpy(&pedido, conexao->entrada + posicao, sizeof(pedido));
+        size_t tamanho = sizeof(pedido);
+        if (pedido.operacao == OP_LANCAMENTOS) {
+            if (pedido.origem < 1 || pedido.origem > MAX_LANCAMENTOS) {
+                return false;
+            }
+            tamanho += (size_t)pedido.origem * sizeof(LancamentoRede);
+            if (conexao->entrada_usada - posicao < tamanho) {
+                break; // Os lançamentos ainda não chegaram inteiros
+            }
+        }
+        if (!aceitar_pedido(io, indice, &pedido, conexao->entrada + posicao + sizeof(pedido))) {
+            if (esperar_espaco(io, indice)) {
+                continue;
+            }
+            break; // O pedido fica na entrada até um trabalhador liberar espaço
+        }
+        posicao += tamanho;
+    }
+    if (posicao > 0) {
+        conexao->entrada_usada -= posicao;
+        memmove(conexao->entrada, conexao->entrada + posicao, conexao->entrada_usada);
+    }
+    return true;
+}
+
+// Uma leitura por evento (o epoll é por nível, então o restante volta no próximo
+// epoll_wait sem deixar as demais conexões esperando); retorna false se a conexão caiu
+static bool ler_conexao(ThreadIo *io, int indice) {
+    Conexao *conexao = &io->conexoes[indice];
+    if (conexao->entrada_usada < TAMANHO_ENTRADA_REDE) {
+        ssize_t n = read(conexao->fd, conexao->entrada + conexao->entrada_usada,
+                         TAMANHO_ENTRADA_REDE - conexao->entrada_usada);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return false;
+        }
+        if (n > 0) {
+            io->leituras++;
+            conexao->entrada_usada += n;
+        }
+    }
+    return decodificar_pedidos(io, indice) && escrever_conexao(io, conexao);
+}
+
+static void aceitar_conexoes(ThreadIo *io, int escuta) {
+    for (;;) {
+        int fd = accept4(escuta, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+                perror("Falha ao aceitar conexão");
+            }
+            return;
+        }
+        if (io->num_livres == 0) {
+            close(fd); // Sem posição livre nesta thread: recusa
+            continue;
+        }
+        if (escuta == escuta_tcp) {
+            int um = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um));
+        }
+        int indice = io->livres[--io->num_livres];
+        Conexao *conexao = &io->conexoes[indice];
+        if (conexao->entrada == NULL) {
+            conexao->entrada = malloc(TAMANHO_ENTRADA_REDE);
+            conexao->saida = malloc(TAMANHO_SAIDA_REDE);
+            if (conexao->entrada == NULL || conexao->saida == NULL) {
+                perror("Falha ao alocar buffers da conexão");
+                exit(EXIT_FAILURE);
+            }
+        }
+        conexao->fd = fd;
+        conexao->em_voo = 0;
+        conexao->eventos = EPOLLIN;
+        conexao->entrada_usada = 0;
+        conexao->saida_inicio = conexao->saida_fim = 0;
+        struct epoll_event evento = {.events = EPOLLIN, .data.u64 = (uint64_t)indice};
+        if (epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, fd, &evento) < 0) {
+            perror("Falha ao registrar conexão no epoll");
+            fechar_conexao(io, indice);
+            continue;
+        }
+        io->conexoes_aceitas++;
+    }
+}
+
+// Tenta de novo os pedidos adiados por falta de espaço na fila, começando cada
+// rodada por uma conexão diferente para que nenhuma fique sempre com o espaço
+// liberado. As que voltam a ser adiadas entram de novo na lista
+static void retomar_adiados(ThreadIo *io) {
+    int quantidade = io->num_sem_espaco;
+    if (quantidade == 0) {
+        return;
+    }
+    memcpy(io->tocadas, io->sem_espaco, quantidade * sizeof(int)); // Livre fora de recolher_respostas
+    io->num_sem_espaco = 0;
+    int inicio = (int)(io->rodadas_retomada++ % (unsigned long)quantidade);
+    for (int i = 0; i < quantidade; i++) {
+        int indice = io->tocadas[(inicio + i) % quantidade];
+        Conexao *conexao = &io->conexoes[indice];
+        conexao->na_espera = false;
+        if (!decodificar_pedidos(io, indice) || !escrever_conexao(io, conexao)) {
+            fechar_conexao(io, indice);
+            continue;
+        }
+        atualizar_interesse(io, indice);
+    }
+}
+
+// Copia a resposta para a saída da conexão, descartando-a se a conexão já fechou
+static void entregar_resposta(ThreadIo *io, const RespostaPendente *pendente, int *num_tocadas) {
+    Conexao *conexao = &io->conexoes[pendente->conexao];
+    io->em_voo--;
+    if (conexao->fd < 0 || conexao->geracao != pendente->geracao) {
+        return;
+    }
+    conexao->em_voo--;
+    anexar_resposta(conexao, &pendente->resposta);
+    io->respostas++;
+    if (!conexao->tocada) {
+        conexao->tocada = true;
+        io->tocadas[(*num_tocadas)++] = pendente->conexao;
+    }
+}
+
+// Entrega as respostas retidas que o WAL já tornou duráveis. Se ainda sobrar
+// alguma, pede à thread do WAL um aviso no próximo commit; a nova conferência
+// depois do pedido cobre um commit concluído nesse meio-tempo
+static void entregar_duraveis(ThreadIo *io, int *num_tocadas) {
+    for (;;) {
+        unsigned long duravel = atomic_load(&passagem_duravel_wal);
+        int restantes = 0;
+        for (int i = 0; i < io->num_retidas; i++) {
+            if (io->retidas[i].passagem_wal <= duravel) {
+                entregar_resposta(io, &io->retidas[i], num_tocadas);
+            } else {
+                io->retidas[restantes++] = io->retidas[i];
+            }
+        }
+        io->num_retidas = restantes;
+        if (restantes == 0 || !pedir_aviso_do_wal(io) || atomic_load(&passagem_duravel_wal) == duravel) {
+            return;
+        }
+    }
+}
+
+// Retira as respostas da caixa de uma vez, copia-as para a saída das conexões
+// (descartando as de conexões já fechadas; com o WAL, só as já duráveis) e envia.
+// O mesmo aviso serve para os pedidos adiados, que são tentados de novo em seguida
+static void recolher_respostas(ThreadIo *io) {
+    uint64_t sinais;
+    if (read(io->evento_fd, &sinais, sizeof(sinais)) < 0 && errno != EAGAIN) {
+        perror("Falha ao ler eventfd da thread de E/S");
+    }
+    pthread_mutex_lock(&io->trava);
+    int quantidade = io->caixa_tamanho;
+    for (int i = 0; i < quantidade; i++) {
+        io->recolhidas[i] = io->caixa[(io->caixa_inicio + i) % LIMITE_EM_VOO_IO];
+    }
+    io->caixa_inicio = (io->caixa_inicio + quantidade) % LIMITE_EM_VOO_IO;
+    io->caixa_tamanho = 0;
+    io->avisada = false;
+    pthread_mutex_unlock(&io->trava);
+
+    int num_tocadas = 0;
+    unsigned long duravel = atomic_load(&passagem_duravel_wal);
+    for (int i = 0; i < quantidade; i++) {
+        if (io->recolhidas[i].passagem_wal > duravel) {
+            io->retidas[io->num_retidas++] = io->recolhidas[i];
+        } else {
+            entregar_resposta(io, &io->recolhidas[i], &num_tocadas);
+        }
+    }
+    if (io->num_retidas > 0) {
+        entregar_duraveis(io, &num_tocadas);
+    }
+    for (int i = 0; i < num_tocadas; i++) {
+        int indice = io->tocadas[i];
+        Conexao *conexao = &io->conexoes[indice];
+        conexao->tocada = false;
+        // Pedidos que esperavam espaço na saída
+        if (!decodificar_pedidos(io, indice) || !escrever_conexao(io, conexao)) {
+            fechar_conexao(io, indice);
+            continue;
+        }
+        atualizar_interesse(io, indice);
+    }
+    retomar_adiados(io);
+}
+
+// No encerramento os trabalhadores já terminaram: recolhe as últimas respostas da
+// caixa e tenta entregá-las por até PRAZO_ENTREGA_FINAL_MS, sem esperar clientes
+// lentos; as retidas saem à medida que a thread do WAL conclui os commits finais
+static void entregar_restantes(ThreadIo *io) {
+    recolher_respostas(io);
+    uint64_t limite = agora_ns() + PRAZO_ENTREGA_FINAL_MS * 1000000ULL;
+    for (;;) {
+        bool pendente = false;
+        for (int i = 0; i < MAX_CONEXOES_IO; i++) {
+            Conexao *conexao = &io->conexoes[i];
+            if (conexao->fd >= 0 && conexao->saida_fim > conexao->saida_inicio) {
+                if (escrever_conexao(io, conexao)) {
+                    pendente |= conexao->saida_fim > conexao->saida_inicio;
+                } else {
+                    fechar_conexao(io, i);
+                }
+            }
+        }
+        if ((!pendente && io->num_retidas == 0) || agora_ns() >= limite) {
+            break;
+        }
+        usleep(1000);
+        if (io->num_retidas > 0) {
+            recolher_respostas(io); // A thread do WAL ainda faz o último commit
+        }
+    }
+}
+
+static void *laco_io(void *arg) {
+    ThreadIo *io = arg;
+    struct epoll_event eventos[64];
+    // Com esperar e prioridade, um pedido adiado pode esgotar o prazo da política sem
+    // que nenhum trabalhador libere espaço: a espera no epoll é limitada a esse prazo
+    bool prazo_finito = cfg.admissao == ADMISSAO_ESPERAR || cfg.admissao == ADMISSAO_PRIORIDADE;
+    int prazo_adiados_ms = (int)(cfg.admissao_espera_us / 1000 + 1);
+    while (!atomic_load(&rede_encerrar)) {
+        int n = epoll_wait(io->epoll_fd, eventos, 64, prazo_finito && io->num_sem_espaco > 0 ? prazo_adiados_ms : -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Falha no epoll_wait");
+            break;
+        }
+        if (n == 0) {
+            retomar_adiados(io);
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t token = eventos[i].data.u64;
+            if (token == TOKEN_EVENTO) {
+                recolher_respostas(io);
+            } else if (token == TOKEN_ESCUTA_TCP) {
+                aceitar_conexoes(io, escuta_tcp);
+            } else if (token == TOKEN_ESCUTA_UNIX) {
+                aceitar_conexoes(io, escuta_unix);
+            } else {
+                int indice = (int)token;
+                Conexao *conexao = &io->conexoes[indice];
+                if (conexao->fd < 0) {
+                    continue; // Fechada por um evento anterior desta rodada
+                }
+                uint32_t ocorridos = eventos[i].events;
+                bool viva = !(ocorridos & (EPOLLERR | EPOLLHUP)) || (ocorridos & EPOLLIN);
+                if (viva && (ocorridos & EPOLLIN)) {
+                    viva = ler_conexao(io, indice);
+                } else if (viva && (ocorridos & EPOLLOUT)) {
+                    viva = escrever_conexao(io, conexao);
+                }
+                if (viva) {
+                    atualizar_interesse(io, indice);
+                } else {
+                    fechar_conexao(io, indice);
+                }
+            }
+        }
+    }
+    entregar_restantes(io);
+    return NULL;
+}
+
+static int abrir_escuta_tcp(int porta) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Falha ao criar socket TCP");
+        exit(EXIT_FAILURE);
+    }
+    int um = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &um, sizeof(um));
+    struct sockaddr_in endereco = {.sin_family = AF_INET, .sin_port = htons(porta),
+                                   .sin_addr.s_addr = htonl(INADDR_ANY)};
+    if (bind(fd, (struct sockaddr *)&endereco, sizeof(endereco)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("Falha ao escutar na porta TCP");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static int abrir_escuta_unix(const char *caminho) {
+    struct sockaddr_un endereco = {.sun_family = AF_UNIX};
+    if (strlen(caminho) >= sizeof(endereco.sun_path)) {
+        fprintf(stderr, "Caminho do socket Unix muito longo: %s\n", caminho);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(endereco.sun_path, caminho);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Falha ao criar socket Unix");
+        exit(EXIT_FAILURE);
+    }
+    unlink(caminho); // Resto de uma execução anterior
+    if (bind(fd, (struct sockaddr *)&endereco, sizeof(endereco)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("Falha ao escutar no socket Unix");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// Registra um socket de escuta no epoll da thread. Com EPOLLEXCLUSIVE só uma das
+// threads de E/S acorda a cada nova conexão
+static void registrar_escuta(ThreadIo *io, int fd, uint64_t token) {
+    struct epoll_event evento = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.u64 = token};
+    if (epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, fd, &evento) < 0) {
+        perror("Falha ao registrar socket de escuta no epoll");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Abre os sockets de escuta e cria as threads de E/S
+void iniciar_rede(void) {
+    if (cfg.porta_tcp > 0) {
+        escuta_tcp = abrir_escuta_tcp(cfg.porta_tcp);
+    }
+    if (cfg.socket_unix != NULL) {
+        escuta_unix = abrir_escuta_unix(cfg.socket_unix);
+    }
+    threads_io = alocar_alinhado(cfg.threads_io * sizeof(ThreadIo), "threads de E/S");
+    for (int t = 0; t < cfg.threads_io; t++) {
+        ThreadIo *io = &threads_io[t];
+        memset(io, 0, sizeof(ThreadIo));
+        io->indice = t;
+        io->conexoes = calloc(MAX_CONEXOES_IO, sizeof(Conexao));
+        io->livres = malloc(MAX_CONEXOES_IO * sizeof(int));
+        io->tocadas = malloc(MAX_CONEXOES_IO * sizeof(int));
+        io->sem_espaco = malloc(MAX_CONEXOES_IO * sizeof(int));
+        io->caixa = malloc(LIMITE_EM_VOO_IO * sizeof(RespostaPendente));
+        io->recolhidas = malloc(LIMITE_EM_VOO_IO * sizeof(RespostaPendente));
+        io->retidas = malloc(LIMITE_EM_VOO_IO * sizeof(RespostaPendente));
+        if (io->conexoes == NULL || io->livres == NULL || io->tocadas == NULL || io->sem_espaco == NULL ||
+            io->caixa == NULL || io->recolhidas == NULL || io->retidas == NULL) {
+            perror("Falha ao alocar estado da thread de E/S");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < MAX_CONEXOES_IO; i++) {
+            io->conexoes[i].fd = -1;
+            io->livres[i] = MAX_CONEXOES_IO - 1 - i;
+        }
+        io->num_livres = MAX_CONEXOES_IO;
+        pthread_mutex_init(&io->trava, NULL);
+
+        io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        io->evento_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (io->epoll_fd < 0 || io->evento_fd < 0) {
+            perror("Falha ao criar epoll da thread de E/S");
+            exit(EXIT_FAILURE);
+        }
+        registrar_escuta(io, io->evento_fd, TOKEN_EVENTO);
+        if (escuta_tcp >= 0) {
+            registrar_escuta(io, escuta_tcp, TOKEN_ESCUTA_TCP);
+        }
+        if (escuta_unix >= 0) {
+            registrar_escuta(io, escuta_unix, TOKEN_ESCUTA_UNIX);
+        }
+        if (pthread_create(&io->thread, NULL, laco_io, io) != 0) {
+            perror("Falha ao criar thread de E/S");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Para as threads de E/S e fecha os sockets de escuta. Os pedidos ainda adiados
+// por falta de espaço ficam sem resposta, como os que não chegaram a ser lidos
+void encerrar_rede(void) {
+    atomic_store(&rede_encerrar, true);
+    for (int t = 0; t < cfg.threads_io; t++) {
+        uint64_t um = 1;
+        if (write(threads_io[t].evento_fd, &um, sizeof(um)) < 0) {
+            perror("Falha ao acordar thread de E/S");
+        }
+    }
+    for (int t = 0; t < cfg.threads_io; t++) {
+        pthread_join(threads_io[t].thread, NULL);
+    }
+    if (escuta_tcp >= 0) {
+        close(escuta_tcp);
+    }
+    if (escuta_unix >= 0) {
+        close(escuta_unix);
+        unlink(cfg.socket_unix);
+    }
+}
+
+// Libera o estado das threads de E/S; só depois que os trabalhadores terminaram,
+// pois eles ainda podem deixar respostas nas caixas
+void liberar_rede(void) {
+    for (int t = 0; t < cfg.threads_io; t++) {
+        ThreadIo *io = &threads_io[t];
+        for (int i = 0; i < MAX_CONEXOES_IO; i++) {
+            if (io->conexoes[i].fd >= 0) {
+                close(io->conexoes[i].fd);
+            }
+            free(io->conexoes[i].entrada);
+            free(io->conexoes[i].saida);
+        }
+        close(io->epoll_fd);
+        close(io->evento_fd);
+        pthread_mutex_destroy(&io->trava);
+        free(io->conexoes);
+        free(io->livres);
+        free(io->tocadas);
+        free(io->sem_espaco);
+        free(io->caixa);
+        free(io->recolhidas);
+        free(io->retidas);
+    }
+    free(threads_io);
+    threads_io = NULL;
+}
+
+// Publicação das métricas: um endpoint HTTP mínimo em 127.0.0.1 (--metricas-porta)
+// e um despejo periódico em stderr (--metricas-intervalo-ms), ambos no formato
+// texto "nome{rótulo} valor", atendidos por uma thread fora do caminho quente
+int escuta_metricas = -1;
+atomic_bool metricas_encerrar = false;
+
+static int profundidade_total(void) {
+    return profundidade_curtas() + (cfg.faixas ? profundidade_fila(&fila_longas) : 0);
+}
+
+void escrever_metricas(FILE *destino) {
+    static const char *nomes_operacoes[NUM_TIPOS_OPERACAO] = {NULL, "deposito", "transferencia", "balanco", "juros",
+                                                              "lancamentos"};
+    static const double quantis[] = {50.0, 90.0, 99.0, 99.9};
+    MetricasThread *soma = alocar_alinhado(sizeof(MetricasThread), "soma das métricas");
+    int threads;
+    agregar_metricas(soma, &threads);
+
+    fprintf(destino, "# %d threads instrumentadas; tempos em ns; tempo_na_fila, servico_deposito e "
+            "servico_transferencia amostrados 1 a cada %d\n", threads, AMOSTRAGEM_METRICAS);
+    fprintf(destino, "fila_profundidade %d\n", profundidade_total());
+    fprintf(destino, "requisicoes_enfileiradas %llu\n", (unsigned long long)soma->enfileiradas);
+    for (int op = 1; op < NUM_TIPOS_OPERACAO; op++) {
+        fprintf(destino, "operacoes_concluidas{tipo=\"%s\"} %llu\n", nomes_operacoes[op],
+                (unsigned long long)soma->operacoes[op]);
+    }
+    for (int k = 0; k < NUM_METRICAS; k++) {
+        if (nomes_metricas[k] == NULL) {
+            continue;
+        }
+        const Histograma *hist = &soma->histogramas[k];
+        fprintf(destino, "%s_contagem %llu\n", nomes_metricas[k], (unsigned long long)hist->total);
+        for (size_t q = 0; q < sizeof(quantis) / sizeof(quantis[0]); q++) {
+            fprintf(destino, "%s{quantil=\"%g\"} %llu\n", nomes_metricas[k], quantis[q] / 100.0,
+                    (unsigned long long)(hist->total ? percentil_histograma(hist, quantis[q]) : 0));
+        }
+        fprintf(destino, "%s_max %llu\n", nomes_metricas[k], (unsigned long long)hist->maximo);
+    }
+    free(soma);
+}
+
+// Responde a uma conexão do endpoint com as métricas atuais, qualquer que seja o pedido
+static void atender_metricas(void) {
+    int fd = accept4(escuta_metricas, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct timeval limite = {.tv_sec = 0, .tv_usec = 200000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limite, sizeof(limite));
+    char pedido[1024];
+    if (read(fd, pedido, sizeof(pedido)) >= 0) { // O conteúdo do pedido não importa
+        char *corpo = NULL;
+        size_t tamanho = 0;
+        FILE *memoria = open_memstream(&corpo, &tamanho);
+        if (memoria != NULL) {
+            escrever_metricas(memoria);
+            fclose(memoria);
+            char cabecalho[128];
+            int n = snprintf(cabecalho, sizeof(cabecalho),
+                             "HTTP/1.0 200 OK\r\nContent-Type: text/plain; charset=utf-8\r\n"
+                             "Content-Length: %zu\r\n\r\n", tamanho);
+            if (send(fd, cabecalho, n, MSG_NOSIGNAL) == n) {
+                send(fd, corpo, tamanho, MSG_NOSIGNAL);
+            }
+            free(corpo);
+        }
+    }
+    close(fd);
+}
+
+void *publicador_metricas(void *arg) {
+    (void)arg;
+    uint64_t intervalo_ns = (uint64_t)cfg.metricas_intervalo_ms * 1000000;
+    uint64_t proximo_despejo = agora_ns() + intervalo_ns;
+    while (!atomic_load(&metricas_encerrar)) {
+        int espera_ms = 200; // Também o prazo para perceber o encerramento
+        if (intervalo_ns > 0) {
+            uint64_t agora = agora_ns();
+            uint64_t falta_ms = proximo_despejo > agora ? (proximo_despejo - agora) / 1000000 : 0;
+            espera_ms = falta_ms < (uint64_t)espera_ms ? (int)falta_ms : espera_ms;
+        }
+        if (escuta_metricas >= 0) {
+            struct pollfd evento = {.fd = escuta_metricas, .events = POLLIN};
+            if (poll(&evento, 1, espera_ms) > 0) {
+                atender_metricas();
+            }
+        } else {
+            simular_latencia(espera_ms * 1000L);
+        }
+        if (intervalo_ns > 0 && agora_ns() >= proximo_despejo) {
+            escrever_metricas(stderr);
+            fflush(stderr);
+            proximo_despejo += intervalo_ns;
+        }
+    }
+    return NULL;
+}
+
+// Abre o endpoint (se pedido) e cria a thread que publica as métricas
+void iniciar_metricas(pthread_t *thread) {
+    if (cfg.metricas_porta > 0) {
+        escuta_metricas = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int um = 1;
+        setsockopt(escuta_metricas, SOL_SOCKET, SO_REUSEADDR, &um, sizeof(um));
+        struct sockaddr_in endereco = {.sin_family = AF_INET, .sin_port = htons(cfg.metricas_porta),
+                                       .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+        if (escuta_metricas < 0 || bind(escuta_metricas, (struct sockaddr *)&endereco, sizeof(endereco)) < 0 ||
+            listen(escuta_metricas, 16) < 0) {
+            perror("Falha ao abrir o endpoint de métricas");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (pthread_create(thread, NULL, publicador_metricas, NULL) != 0) {
+        perror("Falha ao criar thread de métricas");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void encerrar_metricas(pthread_t thread) {
+    atomic_store(&metricas_encerrar, true);
+    pthread_join(thread, NULL);
+    if (escuta_metricas >= 0) {
+        close(escuta_metricas);
+    }
+    liberar_metricas();
+}
+
+// Números do último encerramento, para o relatório
+static struct {
+    int pendentes;            // Requisições na fila ao fechar a admissão
+    uint64_t duracao_ns;      // Do fechamento da admissão à saída do último trabalhador
+    unsigned long concluidas; // Operações concluídas nesse intervalo
+    bool prazo_esgotado;
+} drenagem;
+
+// Acorda os produtores presos em filas cheias, para que vejam a admissão fechada
+static void acordar_todos_produtores(int num_trabalhadores) {
+    if (cfg.roubo_trabalho) {
+        for (int i = 0; i < num_trabalhadores; i++) {
+            acordar_produtores(&filas_trabalhadores[i]);
+        }
+    } else {
+        acordar_produtores(&fila_requisicoes);
+    }
+    if (cfg.faixas) {
+        acordar_produtores(&fila_longas);
+    }
+}
+
+// Encerramento gracioso: fecha a admissão (novos pedidos recebem
+// RESULTADO_ENCERRANDO), deixa os trabalhadores esvaziarem as filas por até
+// cfg.drenagem_ms e descarta o que sobrar. As threads de E/S param por último,
+// depois de entregar as respostas do que foi concluído
+void encerrar_threads(pthread_t *clientes, pthread_t *trabalhadores, int num_clientes, int num_trabalhadores) {
+    if (pool.vagas != NULL) {
+        encerrar_pool();
+    }
+    struct timespec prazo;
+    clock_gettime(CLOCK_REALTIME, &prazo); // pthread_timedjoin_np usa o relógio de tempo real
+    prazo.tv_sec += cfg.drenagem_ms / 1000;
+    prazo.tv_nsec += (cfg.drenagem_ms % 1000) * 1000000L;
+    if (prazo.tv_nsec >= 1000000000L) {
+        prazo.tv_sec++;
+        prazo.tv_nsec -= 1000000000L;
+    }
+    uint64_t inicio = agora_ns();
+    unsigned long concluidas_antes = __sync_fetch_and_add(&operacoes_concluidas, 0);
+
+    atomic_store(&admissao_fechada, true);
+    avisar_passo_encerramento();
+    acordar_todos_produtores(num_trabalhadores);
+    drenagem.pendentes = profundidade_curtas() + (cfg.faixas ? profundidade_fila(&fila_longas) : 0);
+
+    // Aguarda as threads clientes
+    for (int i = 0; i < num_clientes; i++) {
+        pthread_join(clientes[i], NULL);
+    }
+    // Um produtor da rede pode ter passado pela verificação da admissão antes do
+    // fechamento; o encerramento das filas espera que ele termine de enfileirar
+    while (atomic_load(&produtores_admitindo) > 0) {
+        sched_yield();
+    }
+
+    // Sinaliza o shutdown: os trabalhadores saem quando as filas esvaziarem
+    if (cfg.roubo_trabalho) {
+        for (int i = 0; i < num_trabalhadores; i++) {
+            sinalizar_encerramento(&filas_trabalhadores[i]);
+        }
+    } else {
+        sinalizar_encerramento(&fila_requisicoes);
+    }
+    if (cfg.faixas) {
+        sinalizar_encerramento(&fila_longas);
+    }
+    if (cfg.roubo_trabalho || cfg.faixas) {
+        for (int c = 0; c < 2; c++) {
+            atomic_fetch_add(&avisos_trabalho[c].sinal, 1);
+            futex_acordar(&avisos_trabalho[c].sinal, INT_MAX);
+        }
+    }
+
+    // Aguarda as threads trabalhadoras até o prazo; depois dele, as que restam
+    // descartam o que ainda está na fila
+    for (int i = 0; i < num_trabalhadores; i++) {
+        if (!drenagem.prazo_esgotado) {
+            int erro = pthread_timedjoin_np(trabalhadores[i], NULL, &prazo);
+            if (erro == 0) {
+                continue;
+            }
+            if (erro != ETIMEDOUT) {
+                errno = erro;
+                perror("Falha ao aguardar trabalhador");
+                exit(EXIT_FAILURE);
+            }
+            drenagem.prazo_esgotado = true;
+            atomic_store(&descartar_pendentes, true);
+            avisar_passo_encerramento();
+        }
+        pthread_join(trabalhadores[i], NULL);
+    }
+    drenagem.duracao_ns = agora_ns() - inicio;
+    drenagem.concluidas = __sync_fetch_and_add(&operacoes_concluidas, 0) - concluidas_antes;
+
+    if (threads_io != NULL) {
+        encerrar_rede();
+    }
+}
+
+// Lê um inteiro de uma opção, abortando se for inválido ou menor que o mínimo
+static long ler_inteiro(const char *nome, const char *valor, long minimo) {
+    char *fim;
+    errno = 0;
+    long numero = strtol(valor, &fim, 10);
+    if (errno != 0 || fim == valor || *fim != '\0' || numero < minimo) {
+        fprintf(stderr, "Valor inválido para --%s: '%s' (mínimo %ld)\n", nome, valor, minimo);
+        exit(EXIT_FAILURE);
+    }
+    return numero;
+}
+
+static double ler_real(const char *nome, const char *valor, double minimo) {
+    char *fim;
+    errno = 0;
+    double numero = strtod(valor, &fim);
+    if (errno != 0 || fim == valor || *fim != '\0' || !(numero >= minimo)) {
+        fprintf(stderr, "Valor inválido para --%s: '%s' (mínimo %g)\n", nome, valor, minimo);
+        exit(EXIT_FAILURE);
+    }
+    return numero;
+}
+
+// Lê um booleano de uma opção; sem valor (flag de linha de comando) significa verdadeiro
+static bool ler_booleano(const char *nome, const char *valor) {
+    if (valor == NULL || strcmp(valor, "1") == 0 || strcmp(valor, "sim") == 0 || strcmp(valor, "true") == 0) {
+        return true;
+    }
+    if (strcmp(valor, "0") == 0 || strcmp(valor, "nao") == 0 || strcmp(valor, "false") == 0) {
+        return false;
+    }
+    fprintf(stderr, "Valor inválido para --%s: '%s'\n", nome, valor);
+    exit(EXIT_FAILURE);
+}
+
+static void carregar_arquivo_configuracao(const char *caminho);
+
+static void mostrar_uso(const char *programa) {
+    printf("Uso: %s [opções]\n"
+           "  --threads N               threads trabalhadoras (padrão %d)\n"
+           "  --contas N                número de contas (padrão %d)\n"
+           "  --fila N                  capacidade da fila de requisições (padrão %d)\n"
+           "  --clientes N              threads clientes (padrão %d)\n"
+           "  --balanco-a-cada N        insere um balanço a cada N operações, 0 desativa (padrão %d)\n"
+           "  --juros-a-cada N          aplica juros a todas as contas a cada N operações, 0 desativa (padrão %d)\n"
+           "  --juros-pontos-base N     juros de cada aplicação em pontos-base, 1 = 0,01%% (padrão %d)\n"
+           "  --simd NUCLEOS            auto, avx2, sse ou escalar para as operações em massa (padrão auto)\n"
+           "  --agregados               balanços respondidos por agregados mantidos a cada época, sem\n"
+           "                            varrer as contas\n"
+           "  --baldes N                faixas de contas consecutivas com soma própria (padrão %d)\n"
+           "  --limiar-saldo C          saldo, em centavos, abaixo do qual a conta é contada (padrão %ld)\n"
+           "  --conferir-agregados N    confere os agregados com uma varredura a cada N balanços\n"
+           "                            (padrão 0: só na auditoria final)\n"
+           "  --duracao S               tempo de execução em segundos (padrão %d)\n"
+           "  --lote N                  requisições retiradas da fila por vez (padrão %d)\n"
+           "  --travas N                travas (listras) que protegem as contas (padrão %d)\n"
+           "  --roubo                   uma fila por trabalhador (de --fila posições), com roubo\n"
+           "  --ondas N                 executa janelas de N requisições em ondas sem conflito\n"
+           "  --faixas                  balanços e juros numa fila própria, separada das operações curtas\n"
+           "  --peso-curtas N           com --faixas, lotes curtos por operação longa atendida (padrão %d)\n"
+           "  --trabalhadores-longos N  com --faixas, trabalhadores só para balanços e juros (padrão 0)\n"
+           "  --otimista                depósitos e transferências sem travas, validados por versão\n"
+           "  --tentativas-otimistas N  conflitos de um débito antes de travar a listra (padrão %d)\n"
+           "  --contas-por-listra N     contas consecutivas na mesma listra; 8 evita falso compartilhamento\n"
+           "                            dos saldos, 512 alinha as listras a páginas (padrão %d)\n"
+           "  --dedup-entradas N        guarda os resultados das N chaves de idempotência mais recentes\n"
+           "                            e responde às repetições sem executá-las (padrão 0, desativado)\n"
+           "  --dedup-ttl-ms M          validade de um resultado guardado (padrão %ld)\n"
+           "  --retentativas P          percentual das requisições que os clientes reenviam (padrão 0)\n"
+           "  --admissao POLITICA       com a fila cheia: bloquear, esperar, recusar ou prioridade\n"
+           "                            (recusa a prioridade baixa antes de a fila encher) (padrão bloquear)\n"
+           "  --admissao-espera-us U    espera máxima por espaço com esperar e prioridade alta (padrão %ld)\n"
+           "  --limiar-baixa P          ocupação da fila (%%) que recusa a prioridade baixa (padrão %d)\n"
+           "  --drenagem-ms M           prazo do encerramento para concluir o que foi aceito (padrão %ld)\n"
+           "  --threads-min N           pool elástico: de N até --threads trabalhadoras, conforme a fila\n"
+           "  --pool-alvo-us U          espera estimada na fila acima da qual o pool cresce (padrão %ld)\n"
+           "  --pool-intervalo-us U     intervalo entre as decisões do pool elástico (padrão %ld)\n"
+           "  --fixar-nucleos           fixa trabalhadores e clientes, nessa ordem, nas CPUs permitidas\n"
+           "  --numa                    fixa as threads e põe as contas de cada dono no nó da CPU dele;\n"
+           "                            --contas-por-listra sobe para um múltiplo de uma página (512)\n"
+           "  --latencia-operacao-us U  espera do trabalhador por operação (padrão %ld)\n"
+           "  --latencia-cliente-us U   espera do cliente entre requisições (padrão %ld)\n"
+           "  --custo-operacao-ns N     trabalho simulado na seção crítica (padrão %ld)\n"
+           "  --sem-log                 não registra as operações\n"
+           "  --log-arquivo ARQUIVO     acrescenta o log das operações ao arquivo em vez de stdout\n"
+           "  --io-uring                envia o log pelo io_uring (cai para write se indisponível)\n"
+           "  --vazao                   sem log nem latências; informa ops/s ao final\n"
+           "  --bench                   sem log nem latências; emite relatório de desempenho\n"
+           "  --carga MODELO            livre, fechada ou aberta (padrão livre)\n"
+           "  --janela N                pendentes por cliente na carga fechada (padrão %d)\n"
+           "  --taxa N                  requisições/s somando os clientes na carga aberta (padrão %ld)\n"
+           "  --chegadas TIPO           poisson ou fixas: intervalos da carga aberta (padrão poisson)\n"
+           "  --rajadas L:P:F           carga aberta com a taxa multiplicada por F nos primeiros L ms\n"
+           "                            de cada período de P ms\n"
+           "  --distribuicao D          uniforme, zipf ou quente: contas sorteadas (padrão uniforme)\n"
+           "  --zipf-expoente S         expoente da distribuição Zipf (padrão %.2f)\n"
+           "  --contas-quentes N        contas do conjunto quente (padrão %d)\n"
+           "  --percentual-quente P     percentual dos sorteios no conjunto quente (padrão %d)\n"
+           "  --mix D:T:B[:F]           pesos de depósitos, transferências, balanços e folhas de\n"
+           "                            pagamento (padrão 1:1:0:0)\n"
+           "  --lancamentos N           créditos de cada folha de pagamento (padrão %d)\n"
+           "  --gravar-traco ARQUIVO    grava as requisições dos clientes num traço binário\n"
+           "  --reproduzir-traco ARQUIVO  envia as requisições do traço em vez de sorteá-las\n"
+           "  --semente N               semente dos clientes (padrão: derivada do relógio)\n"
+           "  --estresse                muitas threads, fila curta e contas disputadas, sem log nem\n"
+           "                            latências; confere ao final que nenhuma requisição se perdeu ou\n"
+           "                            se repetiu e que o dinheiro confere, e falha se não (as opções\n"
+           "                            posteriores prevalecem)\n"
+           "  --gravar-execucao ARQUIVO grava as operações aplicadas numa ordem em série equivalente\n"
+           "  --reproduzir-execucao ARQUIVO  reaplica a execução gravada numa única thread, confere\n"
+           "                            resultados e saldos finais e encerra\n"
+           "  --formato F               csv ou json para o relatório (padrão csv)\n"
+           "  --saida ARQUIVO           acrescenta o relatório ao arquivo em vez de stdout\n"
+           "  --wal ARQUIVO             registra as operações aplicadas e as reaplica ao iniciar\n"
+           "                            (com --checkpoint, recortado depois de cada checkpoint)\n"
+           "  --wal-intervalo-us U      espera máxima de um grupo antes do fdatasync (padrão %ld)\n"
+           "  --wal-limite-bytes N      tamanho de grupo que força o fdatasync (padrão %ld)\n"
+           "  --checkpoint ARQUIVO      mantém os saldos em um arquivo mapeado e os carrega ao iniciar\n"
+           "  --checkpoint-intervalo-ms M  intervalo entre checkpoints (padrão %ld)\n"
+           "  --escutar-tcp PORTA       recebe pedidos pela rede nesta porta (protocolo.h)\n"
+           "  --escutar-unix CAMINHO    recebe pedidos por um socket Unix\n"
+           "  --threads-io N            threads de E/S com laço epoll (padrão %d)\n"
+           "  --metricas-porta PORTA    expõe as métricas em texto via HTTP em 127.0.0.1:PORTA\n"
+           "  --metricas-intervalo-ms M despeja as métricas em stderr a cada M ms\n"
+           "  --config ARQUIVO          lê opções no formato chave = valor\n"
+           "  --ajuda                   mostra esta mensagem\n",
+           programa, cfg.num_threads, cfg.num_contas, cfg.max_requisicoes, cfg.num_clientes,
+           cfg.operacoes_para_balanco, cfg.operacoes_para_juros, cfg.juros_pontos_base,
+           cfg.baldes_agregados, cfg.limiar_saldo,
+           cfg.duracao_execucao, cfg.tamanho_lote, cfg.num_travas, cfg.peso_curtas, cfg.tentativas_otimistas, cfg.contas_por_listra,
+           cfg.dedup_ttl_ms, cfg.admissao_espera_us, cfg.limiar_baixa, cfg.drenagem_ms, cfg.pool_alvo_us, cfg.pool_intervalo_us, cfg.latencia_operacao_us, cfg.latencia_cliente_us, cfg.custo_operacao_ns, cfg.janela, cfg.taxa_alvo,
+           cfg.zipf_expoente, cfg.contas_quentes, cfg.percentual_quente, cfg.creditos_por_folha, cfg.wal_intervalo_us, cfg.wal_limite_bytes, cfg.checkpoint_intervalo_ms, cfg.threads_io);
+}
+
+// Aplica uma opção pelo nome longo; usada tanto pela linha de comando quanto pelo arquivo
+static void aplicar_opcao(const char *nome, const char *valor) {
+    if (strcmp(nome, "threads") == 0) {
+        cfg.num_threads = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "contas") == 0) {
+        cfg.num_contas = ler_inteiro(nome, valor, 2);
+    } else if (strcmp(nome, "fila") == 0) {
+        cfg.max_requisicoes = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "clientes") == 0) {
+        cfg.num_clientes = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "balanco-a-cada") == 0) {
+        cfg.operacoes_para_balanco = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "juros-a-cada") == 0) {
+        cfg.operacoes_para_juros = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "juros-pontos-base") == 0) {
+        cfg.juros_pontos_base = ler_inteiro(nome, valor, 0);
+        if (cfg.juros_pontos_base >= 10000) {
+            fprintf(stderr, "Valor inválido para --juros-pontos-base: %d (máximo 9999)\n", cfg.juros_pontos_base);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "simd") == 0) {
+        cfg.simd = strdup(valor);
+    } else if (strcmp(nome, "agregados") == 0) {
+        cfg.agregados = ler_booleano(nome, valor);
+    } else if (strcmp(nome, "baldes") == 0) {
+        cfg.baldes_agregados = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "limiar-saldo") == 0) {
+        cfg.limiar_saldo = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "conferir-agregados") == 0) {
+        cfg.conferir_agregados = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "duracao") == 0) {
+        cfg.duracao_execucao = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "lote") == 0) {
+        cfg.tamanho_lote = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "travas") == 0) {
+        cfg.num_travas = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "roubo") == 0) {
+        cfg.roubo_trabalho = ler_booleano(nome, valor);
+    } else if (strcmp(nome, "ondas") == 0) {
+        cfg.janela_ondas = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "faixas") == 0) {
+        cfg.faixas = ler_booleano(nome, valor);
+    } else if (strcmp(nome, "peso-curtas") == 0) {
+        cfg.peso_curtas = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "trabalhadores-longos") == 0) {
+        cfg.trabalhadores_longos = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "otimista") == 0) {
+        cfg.otimista = ler_booleano(nome, valor);
+    } else if (strcmp(nome, "tentativas-otimistas") == 0) {
+        cfg.tentativas_otimistas = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "contas-por-listra") == 0) {
+        cfg.contas_por_listra = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "dedup-entradas") == 0) {
+        cfg.dedup_entradas = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "dedup-ttl-ms") == 0) {
+        cfg.dedup_ttl_ms = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "retentativas") == 0) {
+        cfg.percentual_retentativas = ler_inteiro(nome, valor, 0);
+        if (cfg.percentual_retentativas > 100) {
+            fprintf(stderr, "Valor inválido para --retentativas: %d (máximo 100)\n", cfg.percentual_retentativas);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "admissao") == 0) {
+        if (strcmp(valor, "bloquear") == 0) {
+            cfg.admissao = ADMISSAO_BLOQUEAR;
+        } else if (strcmp(valor, "esperar") == 0) {
+            cfg.admissao = ADMISSAO_ESPERAR;
+        } else if (strcmp(valor, "recusar") == 0) {
+            cfg.admissao = ADMISSAO_RECUSAR;
+        } else if (strcmp(valor, "prioridade") == 0) {
+            cfg.admissao = ADMISSAO_PRIORIDADE;
+        } else {
+            fprintf(stderr, "Valor inválido para --admissao: '%s' (bloquear, esperar, recusar ou prioridade)\n", valor);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "admissao-espera-us") == 0) {
+        cfg.admissao_espera_us = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "limiar-baixa") == 0) {
+        cfg.limiar_baixa = ler_inteiro(nome, valor, 0);
+        if (cfg.limiar_baixa > 100) {
+            fprintf(stderr, "Valor inválido para --limiar-baixa: %d (máximo 100)\n", cfg.limiar_baixa);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "drenagem-ms") == 0) {
+        cfg.drenagem_ms = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "threads-min") == 0) {
+        cfg.threads_min = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "pool-alvo-us") == 0) {
+        cfg.pool_alvo_us = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "pool-intervalo-us") == 0) {
+        cfg.pool_intervalo_us = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "fixar-nucleos") == 0) {
+        cfg.fixar_nucleos = ler_booleano(nome, valor);
+    } else if (strcmp(nome, "numa") == 0) {
+        cfg.numa = ler_booleano(nome, valor);
+    } else if (strcmp(nome, "latencia-operacao-us") == 0) {
+        cfg.latencia_operacao_us = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "latencia-cliente-us") == 0) {
+        cfg.latencia_cliente_us = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "custo-operacao-ns") == 0) {
+        cfg.custo_operacao_ns = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "sem-log") == 0) {
+        cfg.log_operacoes = !ler_booleano(nome, valor);
+    } else if (strcmp(nome, "log-arquivo") == 0) {
+        cfg.arquivo_log = strdup(valor);
+    } else if (strcmp(nome, "io-uring") == 0) {
+        cfg.io_uring_log = ler_booleano(nome, valor);
+    } else if (strcmp(nome, "vazao") == 0) {
+        cfg.modo_vazao = ler_booleano(nome, valor);
+        if (cfg.modo_vazao) {
+            cfg.log_operacoes = false;
+            cfg.latencia_operacao_us = 0;
+            cfg.latencia_cliente_us = 0;
+            cfg.custo_operacao_ns = 1000;
+        }
+    } else if (strcmp(nome, "bench") == 0) {
+        cfg.benchmark = ler_booleano(nome, valor);
+        if (cfg.benchmark) {
+            cfg.log_operacoes = false;
+            cfg.latencia_operacao_us = 0;
+            cfg.latencia_cliente_us = 0;
+        }
+    } else if (strcmp(nome, "carga") == 0) {
+        if (strcmp(valor, "livre") == 0) {
+            cfg.carga = CARGA_LIVRE;
+        } else if (strcmp(valor, "fechada") == 0) {
+            cfg.carga = CARGA_FECHADA;
+        } else if (strcmp(valor, "aberta") == 0) {
+            cfg.carga = CARGA_ABERTA;
+        } else {
+            fprintf(stderr, "Valor inválido para --carga: '%s' (livre, fechada ou aberta)\n", valor);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "janela") == 0) {
+        cfg.janela = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "taxa") == 0) {
+        cfg.taxa_alvo = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "chegadas") == 0) {
+        if (strcmp(valor, "poisson") == 0 || strcmp(valor, "fixas") == 0) {
+            cfg.chegadas_poisson = strcmp(valor, "poisson") == 0;
+        } else {
+            fprintf(stderr, "Valor inválido para --chegadas: '%s' (poisson ou fixas)\n", valor);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "rajadas") == 0) {
+        int n = 0;
+        if (sscanf(valor, "%d:%d:%d%n", &cfg.rajada_ms, &cfg.rajada_periodo_ms, &cfg.rajada_fator, &n) != 3 ||
+            valor[n] != '\0' || cfg.rajada_ms < 1 || cfg.rajada_periodo_ms < cfg.rajada_ms || cfg.rajada_fator < 1) {
+            fprintf(stderr, "Valor inválido para --rajadas: '%s' (L:P:F, 1 <= L <= P, F >= 1)\n", valor);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "distribuicao") == 0) {
+        if (strcmp(valor, "uniforme") == 0) {
+            cfg.distribuicao = DISTRIBUICAO_UNIFORME;
+        } else if (strcmp(valor, "zipf") == 0) {
+            cfg.distribuicao = DISTRIBUICAO_ZIPF;
+        } else if (strcmp(valor, "quente") == 0) {
+            cfg.distribuicao = DISTRIBUICAO_QUENTE;
+        } else {
+            fprintf(stderr, "Valor inválido para --distribuicao: '%s' (uniforme, zipf ou quente)\n", valor);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "zipf-expoente") == 0) {
+        cfg.zipf_expoente = ler_real(nome, valor, 0.0);
+    } else if (strcmp(nome, "contas-quentes") == 0) {
+        cfg.contas_quentes = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "percentual-quente") == 0) {
+        cfg.percentual_quente = ler_inteiro(nome, valor, 0);
+        if (cfg.percentual_quente > 100) {
+            fprintf(stderr, "Valor inválido para --percentual-quente: %d (máximo 100)\n", cfg.percentual_quente);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "mix") == 0) {
+        int n = 0;
+        cfg.mix[3] = 0;
+        int lidos = sscanf(valor, "%d:%d:%d%n:%d%n", &cfg.mix[0], &cfg.mix[1], &cfg.mix[2], &n, &cfg.mix[3], &n);
+        if (lidos < 3 || valor[n] != '\0' || cfg.mix[0] < 0 || cfg.mix[1] < 0 || cfg.mix[2] < 0 || cfg.mix[3] < 0 ||
+            cfg.mix[0] + cfg.mix[1] + cfg.mix[2] + cfg.mix[3] == 0) {
+            fprintf(stderr, "Valor inválido para --mix: '%s' (D:T:B[:F], pesos não negativos)\n", valor);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "lancamentos") == 0) {
+        cfg.creditos_por_folha = ler_inteiro(nome, valor, 1);
+        if (cfg.creditos_por_folha >= MAX_LANCAMENTOS) {
+            fprintf(stderr, "Valor inválido para --lancamentos: %d (máximo %d)\n", cfg.creditos_por_folha,
+                    MAX_LANCAMENTOS - 1);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "gravar-traco") == 0) {
+        cfg.gravar_traco = strdup(valor);
+    } else if (strcmp(nome, "reproduzir-traco") == 0) {
+        cfg.reproduzir_traco = strdup(valor);
+    } else if (strcmp(nome, "semente") == 0) {
+        cfg.semente = (uint64_t)ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "estresse") == 0) {
+        cfg.estresse = ler_booleano(nome, valor);
+        if (cfg.estresse) {
+            cfg.num_threads = 8;
+            cfg.num_clientes = 16;
+            cfg.max_requisicoes = 8; // A fila vive alternando entre cheia e vazia
+            cfg.num_contas = 64;
+            cfg.num_travas = 16;
+            cfg.tamanho_lote = 4;
+            cfg.operacoes_para_balanco = 50;
+            cfg.operacoes_para_juros = 1000;
+            cfg.mix[0] = 4, cfg.mix[1] = 8, cfg.mix[2] = 1, cfg.mix[3] = 1;
+            cfg.creditos_por_folha = 8;
+            cfg.duracao_execucao = 5;
+            cfg.log_operacoes = false;
+            cfg.latencia_operacao_us = 0;
+            cfg.latencia_cliente_us = 0;
+        }
+    } else if (strcmp(nome, "gravar-execucao") == 0) {
+        cfg.gravar_execucao = strdup(valor);
+    } else if (strcmp(nome, "reproduzir-execucao") == 0) {
+        cfg.reproduzir_execucao = strdup(valor);
+    } else if (strcmp(nome, "formato") == 0) {
+        if (strcmp(valor, "csv") == 0) {
+            cfg.formato = FORMATO_CSV;
+        } else if (strcmp(valor, "json") == 0) {
+            cfg.formato = FORMATO_JSON;
+        } else {
+            fprintf(stderr, "Valor inválido para --formato: '%s' (csv ou json)\n", valor);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "saida") == 0) {
+        cfg.saida = strdup(valor);
+    } else if (strcmp(nome, "wal") == 0) {
+        cfg.arquivo_wal = strdup(valor);
+    } else if (strcmp(nome, "wal-intervalo-us") == 0) {
+        cfg.wal_intervalo_us = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "wal-limite-bytes") == 0) {
+        cfg.wal_limite_bytes = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "checkpoint") == 0) {
+        cfg.arquivo_checkpoint = strdup(valor);
+    } else if (strcmp(nome, "checkpoint-intervalo-ms") == 0) {
+        cfg.checkpoint_intervalo_ms = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "escutar-tcp") == 0) {
+        cfg.porta_tcp = ler_inteiro(nome, valor, 1);
+        if (cfg.porta_tcp > 65535) {
+            fprintf(stderr, "Valor inválido para --escutar-tcp: %d (máximo 65535)\n", cfg.porta_tcp);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "escutar-unix") == 0) {
+        cfg.socket_unix = strdup(valor);
+    } else if (strcmp(nome, "threads-io") == 0) {
+        cfg.threads_io = ler_inteiro(nome, valor, 1);
+    } else if (strcmp(nome, "metricas-porta") == 0) {
+        cfg.metricas_porta = ler_inteiro(nome, valor, 0);
+        if (cfg.metricas_porta > 65535) {
+            fprintf(stderr, "Valor inválido para --metricas-porta: %d (máximo 65535)\n", cfg.metricas_porta);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(nome, "metricas-intervalo-ms") == 0) {
+        cfg.metricas_intervalo_ms = ler_inteiro(nome, valor, 0);
+    } else if (strcmp(nome, "config") == 0) {
+        carregar_arquivo_configuracao(valor);
+    } else {
+        fprintf(stderr, "Opção desconhecida: %s\n", nome);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Opções da linha de comando; também dizem quais chaves do arquivo de configuração exigem valor
+static const struct option opcoes_longas[] = {
+    {"threads", required_argument, NULL, 0},
+    {"contas", required_argument, NULL, 0},
+    {"fila", required_argument, NULL, 0},
+    {"clientes", required_argument, NULL, 0},
+    {"balanco-a-cada", required_argument, NULL, 0},
+    {"juros-a-cada", required_argument, NULL, 0},
+    {"juros-pontos-base", required_argument, NULL, 0},
+    {"simd", required_argument, NULL, 0},
+    {"agregados", no_argument, NULL, 0},
+    {"baldes", required_argument, NULL, 0},
+    {"limiar-saldo", required_argument, NULL, 0},
+    {"conferir-agregados", required_argument, NULL, 0},
+    {"duracao", required_argument, NULL, 0},
+    {"lote", required_argument, NULL, 0},
+    {"travas", required_argument, NULL, 0},
+    {"roubo", no_argument, NULL, 0},
+    {"ondas", required_argument, NULL, 0},
+    {"faixas", no_argument, NULL, 0},
+    {"peso-curtas", required_argument, NULL, 0},
+    {"trabalhadores-longos", required_argument, NULL, 0},
+    {"otimista", no_argument, NULL, 0},
+    {"tentativas-otimistas", required_argument, NULL, 0},
+    {"contas-por-listra", required_argument, NULL, 0},
+    {"dedup-entradas", required_argument, NULL, 0},
+    {"dedup-ttl-ms", required_argument, NULL, 0},
+    {"retentativas", required_argument, NULL, 0},
+    {"admissao", required_argument, NULL, 0},
+    {"admissao-espera-us", required_argument, NULL, 0},
+    {"limiar-baixa", required_argument, NULL, 0},
+    {"drenagem-ms", required_argument, NULL, 0},
+    {"threads-min", required_argument, NULL, 0},
+    {"pool-alvo-us", required_argument, NULL, 0},
+    {"pool-intervalo-us", required_argument, NULL, 0},
+    {"fixar-nucleos", no_argument, NULL, 0},
+    {"numa", no_argument, NULL, 0},
+    {"latencia-operacao-us", required_argument, NULL, 0},
+    {"latencia-cliente-us", required_argument, NULL, 0},
+    {"custo-operacao-ns", required_argument, NULL, 0},
+    {"sem-log", no_argument, NULL, 0},
+    {"log-arquivo", required_argument, NULL, 0},
+    {"io-uring", no_argument, NULL, 0},
+    {"vazao", no_argument, NULL, 0},
+    {"bench", no_argument, NULL, 0},
+    {"carga", required_argument, NULL, 0},
+    {"janela", required_argument, NULL, 0},
+    {"taxa", required_argument, NULL, 0},
+    {"chegadas", required_argument, NULL, 0},
+    {"rajadas", required_argument, NULL, 0},
+    {"distribuicao", required_argument, NULL, 0},
+    {"zipf-expoente", required_argument, NULL, 0},
+    {"contas-quentes", required_argument, NULL, 0},
+    {"percentual-quente", required_argument, NULL, 0},
+    {"mix", required_argument, NULL, 0},
+    {"lancamentos", required_argument, NULL, 0},
+    {"gravar-traco", required_argument, NULL, 0},
+    {"reproduzir-traco", required_argument, NULL, 0},
+    {"semente", required_argument, NULL, 0},
+    {"estresse", no_argument, NULL, 0},
+    {"gravar-execucao", required_argument, NULL, 0},
+    {"reproduzir-execucao", required_argument, NULL, 0},
+    {"formato", required_argument, NULL, 0},
+    {"saida", required_argument, NULL, 0},
+    {"wal", required_argument, NULL, 0},
+    {"wal-intervalo-us", required_argument, NULL, 0},
+    {"wal-limite-bytes", required_argument, NULL, 0},
+    {"checkpoint", required_argument, NULL, 0},
+    {"checkpoint-intervalo-ms", required_argument, NULL, 0},
+    {"escutar-tcp", required_argument, NULL, 0},
+    {"escutar-unix", required_argument, NULL, 0},
+    {"threads-io", required_argument, NULL, 0},
+    {"metricas-porta", required_argument, NULL, 0},
+    {"metricas-intervalo-ms", required_argument, NULL, 0},
+    {"config", required_argument, NULL, 0},
+    {"ajuda", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0},
+};
+
+// Lê um arquivo com uma opção por linha ("chave = valor"); linhas vazias e
+// iniciadas por # são ignoradas
+static void carregar_arquivo_configuracao(const char *caminho) {
+    FILE *arquivo = fopen(caminho, "r");
+    if (arquivo == NULL) {
+        perror("Falha ao abrir arquivo de configuração");
+        exit(EXIT_FAILURE);
+    }
+    char linha[256];
+    while (fgets(linha, sizeof(linha), arquivo) != NULL) {
+        char *chave = linha + strspn(linha, " \t");
+        chave[strcspn(chave, "#\r\n")] = '\0';
+        if (*chave == '\0') {
+            continue;
+        }
+        char *valor = strchr(chave, '=');
+        if (valor != NULL) {
+            *valor++ = '\0';
+            valor += strspn(valor, " \t");
+            valor[strcspn(valor, " \t")] = '\0';
+        }
+        chave[strcspn(chave, " \t")] = '\0';
+        for (const struct option *opcao = opcoes_longas; opcao->name != NULL; opcao++) {
+            if (strcmp(opcao->name, chave) != 0) {
+                continue;
+            }
+            if (opcao->has_arg == required_argument && (valor == NULL || *valor == '\0')) {
+                fprintf(stderr, "%s: a opção '%s' precisa de um valor (%s = ...)\n", caminho, chave, chave);
+                exit(EXIT_FAILURE);
+            }
+            if (opcao->has_arg == no_argument && valor != NULL) {
+                fprintf(stderr, "%s: a opção '%s' não recebe valor\n", caminho, chave);
+                exit(EXIT_FAILURE);
+            }
+        }
+        aplicar_opcao(chave, valor);
+    }
+    fclose(arquivo);
+}
+
+static void ler_configuracao(int argc, char **argv) {
+    cfg.semente = (uint64_t)time(NULL);
+    int indice;
+    int opcao;
+    while ((opcao = getopt_long(argc, argv, "h", opcoes_longas, &indice)) != -1) {
+        if (opcao == 'h') {
+            mostrar_uso(argv[0]);
+            exit(EXIT_SUCCESS);
+        } else if (opcao != 0) {
+            mostrar_uso(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        aplicar_opcao(opcoes_longas[indice].name, optarg);
+    }
+    if (cfg.roubo_trabalho && cfg.janela_ondas > 0) {
+        fprintf(stderr, "--roubo e --ondas não podem ser usados juntos\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.faixas && cfg.janela_ondas > 0) {
+        fprintf(stderr, "--faixas e --ondas não podem ser usados juntos\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.otimista && cfg.janela_ondas > 0) {
+        fprintf(stderr, "--otimista e --ondas não podem ser usados juntos\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.distribuicao == DISTRIBUICAO_QUENTE && cfg.contas_quentes >= cfg.num_contas) {
+        fprintf(stderr, "--contas-quentes deve ser menor que --contas (%d)\n", cfg.num_contas);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.agregados && cfg.baldes_agregados > cfg.num_contas) {
+        fprintf(stderr, "--baldes deve ser no máximo --contas (%d)\n", cfg.num_contas);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.gravar_traco != NULL && cfg.reproduzir_traco != NULL) {
+        fprintf(stderr, "--gravar-traco e --reproduzir-traco não podem ser usados juntos\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.gravar_execucao != NULL && cfg.otimista) {
+        fprintf(stderr, "--gravar-execucao não pode ser usado com --otimista: os créditos otimistas não têm "
+                "um ponto de ordem\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.gravar_execucao != NULL && (cfg.arquivo_wal != NULL || cfg.arquivo_checkpoint != NULL)) {
+        fprintf(stderr, "--gravar-execucao parte dos saldos iniciais e não pode ser combinado com --wal nem "
+                "--checkpoint\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.numa) {
+        cfg.fixar_nucleos = true; // O primeiro toque só vale se o dono rodar na mesma CPU depois
+        // Cada página de saldos precisa ter um único dono, senão fica no nó de quem a
+        // tocou primeiro: os blocos são arredondados para páginas inteiras
+        int contas_por_pagina = (int)((size_t)sysconf(_SC_PAGESIZE) / sizeof(int64_t));
+        if (cfg.contas_por_listra % contas_por_pagina != 0) {
+            int arredondado = (cfg.contas_por_listra / contas_por_pagina + 1) * contas_por_pagina;
+            fprintf(stderr, "--numa: --contas-por-listra %d dividiria páginas dos saldos entre donos; usando %d\n",
+                    cfg.contas_por_listra, arredondado);
+            cfg.contas_por_listra = arredondado;
+        }
+    }
+    if (cfg.trabalhadores_longos > 0 && !cfg.faixas) {
+        fprintf(stderr, "--trabalhadores-longos requer --faixas\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.trabalhadores_longos >= cfg.num_threads) {
+        fprintf(stderr, "--trabalhadores-longos deve ser menor que --threads (%d)\n", cfg.num_threads);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.threads_min > 0) {
+        // Com --roubo as requisições são roteadas para a fila de cada dono, e as de uma
+        // trabalhadora estacionada ficariam esperando um roubo
+        if (cfg.roubo_trabalho || cfg.janela_ondas > 0) {
+            fprintf(stderr, "--threads-min não pode ser combinado com --roubo nem com --ondas\n");
+            exit(EXIT_FAILURE);
+        }
+        if (cfg.threads_min > cfg.num_threads - cfg.trabalhadores_longos) {
+            fprintf(stderr, "--threads-min deve ser no máximo --threads menos --trabalhadores-longos (%d)\n",
+                    cfg.num_threads - cfg.trabalhadores_longos);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (cfg.rajada_fator > 1 && cfg.carga != CARGA_ABERTA) {
+        fprintf(stderr, "--rajadas requer --carga aberta\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Nome da variante nos relatórios: a implementação da fila e as opções que mudam o
+// caminho das operações, para comparar execuções no mesmo arquivo
+static const char *nome_variante(void) {
+    static char nome[64];
+    snprintf(nome, sizeof(nome), "%s%s%s%s", NOME_FILA, cfg.roubo_trabalho ? "+roubo" : "",
+             cfg.faixas ? "+faixas" : "", cfg.otimista ? "+otimista" : "");
+    return nome;
+}
+
+// Emite o relatório do benchmark (uma linha CSV ou um objeto JSON), acrescentando-o
+// a cfg.saida quando indicado, para acompanhar regressões entre versões
+void emitir_relatorio(unsigned long operacoes, double segundos, const Histograma *latencias) {
+    static const char *nomes_carga[] = {"livre", "fechada", "aberta"};
+    FILE *destino = stdout;
+    bool arquivo_vazio = true;
+    if (cfg.saida != NULL) {
+        destino = fopen(cfg.saida, "a");
+        if (destino == NULL) {
+            perror("Falha ao abrir arquivo de relatório");
+            return;
+        }
+        arquivo_vazio = ftell(destino) == 0;
+    }
+
+    double ops_por_s = operacoes / segundos;
+    double p50_us = percentil_histograma(latencias, 50.0) / 1000.0;
+    double p99_us = percentil_histograma(latencias, 99.0) / 1000.0;
+    double p999_us = percentil_histograma(latencias, 99.9) / 1000.0;
+    double max_us = latencias->maximo / 1000.0;
+    double espera_ms = atomic_load(&espera_fila_cheia_ns) / 1e6;
+    const char *fila = nome_variante();
+
+    if (cfg.formato == FORMATO_JSON) {
+        fprintf(destino, "{\"fila\": \"%s\", \"threads\": %d, \"contas\": %d, \"clientes\": %d, "
+                "\"capacidade_fila\": %d, \"lote\": %d, \"travas\": %d, \"carga\": \"%s\", "
+                "\"janela\": %d, \"taxa_alvo\": %ld, \"semente\": %llu, \"duracao_s\": %.3f, "
+                "\"operacoes\": %lu, \"ops_por_s\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+                "\"p999_us\": %.1f, \"max_us\": %.1f, \"espera_fila_cheia_ms\": %.3f}\n",
+                fila, cfg.num_threads, cfg.num_contas, cfg.num_clientes, cfg.max_requisicoes,
+                cfg.tamanho_lote, cfg.num_travas, nomes_carga[cfg.carga], cfg.janela, cfg.taxa_alvo,
+                (unsigned long long)cfg.semente, segundos, operacoes, ops_por_s, p50_us, p99_us,
+                p999_us, max_us, espera_ms);
+    } else {
+        if (arquivo_vazio) {
+            fprintf(destino, "fila,threads,contas,clientes,capacidade_fila,lote,travas,carga,janela,taxa_alvo,"
+                    "semente,duracao_s,operacoes,ops_por_s,p50_us,p99_us,p999_us,max_us,espera_fila_cheia_ms\n");
+        }
+        fprintf(destino, "%s,%d,%d,%d,%d,%d,%d,%s,%d,%ld,%llu,%.3f,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f\n",
+                fila, cfg.num_threads, cfg.num_contas, cfg.num_clientes, cfg.max_requisicoes,
+                cfg.tamanho_lote, cfg.num_travas, nomes_carga[cfg.carga], cfg.janela, cfg.taxa_alvo,
+                (unsigned long long)cfg.semente, segundos, operacoes, ops_por_s, p50_us, p99_us,
+                p999_us, max_us, espera_ms);
+    }
+    if (destino != stdout) {
+        fclose(destino);
+    }
+}
+
+// Confere ao final, sobre um snapshot, que nenhum centavo foi criado ou perdido, e
+// mede quanto a soma e os extremos levam com os núcleos escolhidos. Retorna true
+// se o total e os agregados conferem
+bool auditar(FILE *destino) {
+    pthread_mutex_lock(&mutex_snapshot);
+    unsigned int epoca = fechar_epoca();
+    for (int i = 0; i < cfg.num_contas; i++) {
+        saldos_snapshot[i] = ler_saldo_snapshot(i, epoca);
+    }
+    int64_t esperado = (int64_t)SALDO_INICIAL * cfg.num_contas + total_depositado;
+    bool agregados_conferem = agregados.ativos && conferir_agregados(saldos_snapshot, epoca);
+    pthread_mutex_unlock(&mutex_snapshot);
+
+    uint64_t inicio = agora_ns();
+    int64_t total = nucleos.somar(saldos_snapshot, cfg.num_contas);
+    int64_t minimo, maximo;
+    nucleos.extremos(saldos_snapshot, cfg.num_contas, &minimo, &maximo);
+    double micros = (agora_ns() - inicio) / 1000.0;
+    fprintf(destino, "Auditoria: total %.2f (esperado %.2f, %s), menor saldo %.2f, maior %.2f; "
+            "%d contas percorridas em %.1f us (núcleos %s)\n",
+            total / 100.0, esperado / 100.0, total == esperado ? "confere" : "DIVERGENTE",
+            minimo / 100.0, maximo / 100.0, cfg.num_contas, micros, nucleos.nome);
+    if (agregados.ativos) {
+        fprintf(destino, "Agregados: %s com a varredura final; %lu balanços respondidos sem varrer as contas, "
+                "%lu contas dobradas em %lu épocas (%.1f por época), %lu conferências completas, %lu divergentes\n",
+                agregados_conferem ? "conferem" : "DIVERGENTES", agregados.balancos, agregados.contas_dobradas,
+                agregados.epocas_dobradas,
+                agregados.epocas_dobradas ? (double)agregados.contas_dobradas / agregados.epocas_dobradas : 0.0,
+                agregados.conferencias, agregados.divergencias);
+    }
+    return total == esperado && (!agregados.ativos || agregados_conferem);
+}
+
+int main(int argc, char **argv) {
+    ler_configuracao(argc, argv);
+    selecionar_nucleos();
+    if (cfg.reproduzir_execucao != NULL) {
+        return reproduzir_execucao(cfg.reproduzir_execucao) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    pthread_t escritor;
+    pthread_t *threads = malloc(cfg.num_threads * sizeof(pthread_t));
+    pthread_t *clientes_ids = malloc(cfg.num_clientes * sizeof(pthread_t));
+    int *cliente_ids = malloc(cfg.num_clientes * sizeof(int));
+    int *trabalhador_ids = malloc(cfg.num_threads * sizeof(int));
+    if (threads == NULL || clientes_ids == NULL || cliente_ids == NULL || trabalhador_ids == NULL) {
+        perror("Falha ao alocar threads");
+        exit(EXIT_FAILURE);
+    }
+    estados_clientes = alocar_alinhado(cfg.num_clientes * sizeof(EstadoCliente), "estado dos clientes");
+    for (int i = 0; i < cfg.num_clientes; i++) {
+        atomic_init(&estados_clientes[i].em_voo, 0);
+    }
+    histogramas = alocar_alinhado(cfg.num_threads * sizeof(Histograma), "histogramas");
+    memset(histogramas, 0, cfg.num_threads * sizeof(Histograma));
+    histogramas_longas = alocar_alinhado(cfg.num_threads * sizeof(Histograma), "histogramas das longas");
+    memset(histogramas_longas, 0, cfg.num_threads * sizeof(Histograma));
+    slots_epoca = alocar_alinhado(cfg.num_threads * sizeof(SlotEpoca), "slots de época");
+    for (int i = 0; i < cfg.num_threads; i++) {
+        atomic_init(&slots_epoca[i].epoca, 0);
+        atomic_init(&slots_epoca[i].depositado[0], 0);
+        atomic_init(&slots_epoca[i].depositado[1], 0);
+        memset(slots_epoca[i].tocadas, 0, sizeof(slots_epoca[i].tocadas));
+    }
+
+    // Inicializa mutexes e variáveis de condição
+    travas_contas = alocar_alinhado(cfg.num_travas * sizeof(TravaListra), "travas das contas");
+    for (int t = 0; t < cfg.num_travas; t++) {
+        pthread_mutex_init(&travas_contas[t].mutex, NULL);
+    }
+    pthread_mutex_init(&mutex_contador, NULL);
+    pthread_mutex_init(&mutex_snapshot, NULL);
+    if (cfg.roubo_trabalho) {
+        filas_trabalhadores = alocar_alinhado(cfg.num_threads * sizeof(FilaRequisicoes), "filas dos trabalhadores");
+        for (int i = 0; i < cfg.num_threads; i++) {
+            inicializar_fila(&filas_trabalhadores[i], cfg.max_requisicoes);
+        }
+    } else {
+        inicializar_fila(&fila_requisicoes, cfg.max_requisicoes);
+    }
+    if (cfg.faixas) {
+        inicializar_fila(&fila_longas, cfg.max_requisicoes);
+    }
+    if (cfg.janela_ondas > 0) {
+        inicializar_ondas();
+    }
+
+    // Inicializa contas
+    if (cfg.fixar_nucleos) {
+        carregar_cpus_permitidas();
+    }
+    inicializar_contas();
+    saldos_snapshot = alocar_alinhado(cfg.num_contas * sizeof(int64_t), "snapshot dos saldos");
+
+    // Recupera o estado durável (checkpoint mais o WAL posterior a ele) e continua a
+    // numeração de épocas depois da última persistida
+    pthread_t thread_wal, thread_checkpoint;
+    unsigned int epoca_recuperada = 0;
+    if (cfg.arquivo_checkpoint != NULL) {
+        epoca_recuperada = carregar_checkpoint(cfg.arquivo_checkpoint);
+    }
+    if (cfg.arquivo_wal != NULL) {
+        reproduzir_wal(cfg.arquivo_wal, epoca_recuperada);
+        epoca_recuperada = maior_epoca_wal;
+        if (pthread_create(&thread_wal, NULL, escritor_wal, NULL) != 0) {
+            perror("Falha ao criar thread do WAL");
+            exit(EXIT_FAILURE);
+        }
+    }
+    atomic_store(&epoca_global, epoca_recuperada + 1);
+    atomic_store(&epoca_drenada, epoca_recuperada);
+    inicializar_agregados();
+    if (cfg.arquivo_checkpoint != NULL &&
+        pthread_create(&thread_checkpoint, NULL, checkpointer, NULL) != 0) {
+        perror("Falha ao criar thread de checkpoint");
+        exit(EXIT_FAILURE);
+    }
+
+    // Cria a thread que escreve os logs em stdout (ou no arquivo de log)
+    iniciar_saida_log();
+    if (pthread_create(&escritor, NULL, escritor_log, NULL) != 0) {
+        perror("Falha ao criar thread de log");
+        exit(EXIT_FAILURE);
+    }
+
+    // As métricas são ligadas antes de qualquer thread que as registre
+    pthread_t thread_metricas;
+    metricas_ativas = cfg.metricas_porta > 0 || cfg.metricas_intervalo_ms > 0;
+    if (metricas_ativas) {
+        iniciar_metricas(&thread_metricas);
+    }
+
+    // Prepara o gerador de carga dos clientes; o traço reproduzido vem antes da
+    // tabela Zipf porque traz a distribuição da gravação
+    contas_sorteio = cfg.num_contas;
+    if (cfg.reproduzir_traco != NULL) {
+        carregar_traco(cfg.reproduzir_traco);
+    }
+    if (cfg.distribuicao == DISTRIBUICAO_ZIPF) {
+        montar_tabela_zipf();
+    }
+    if (cfg.gravar_traco != NULL) {
+        abrir_gravacao_traco(cfg.gravar_traco);
+    }
+
+    inicializar_dedup();
+
+    // Abre a frente de rede antes dos trabalhadores, que consultam threads_io ao responder
+    if (cfg.porta_tcp > 0 || cfg.socket_unix != NULL) {
+        iniciar_rede();
+    }
+
+    // Cria threads trabalhadoras; no pool elástico as excedentes já começam estacionadas
+    if (cfg.threads_min > 0) {
+        iniciar_pool();
+    }
+    for (int i = 0; i < cfg.num_threads; i++) {
+        trabalhador_ids[i] = i;
+        if (pthread_create(&threads[i], NULL, trabalhador, &trabalhador_ids[i]) != 0) {
+            perror("Falha ao criar thread trabalhadora");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Cria threads clientes
+    inicio_clientes_ns = agora_ns();
+    for (int i = 0; i < cfg.num_clientes; i++) {
+        cliente_ids[i] = i;
+        if (pthread_create(&clientes_ids[i], NULL, cliente, &cliente_ids[i]) != 0) {
+            perror("Falha ao criar thread cliente");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Executa por um período determinado ou até uma condição de encerramento
+    uint64_t inicio_ns = agora_ns();
+    sleep(cfg.duracao_execucao);
+    unsigned long concluidas = __sync_fetch_and_add(&operacoes_concluidas, 0);
+    double segundos = (agora_ns() - inicio_ns) / 1e9;
+
+    // Encerra as threads
+    encerrar_threads(clientes_ids, threads, cfg.num_clientes, cfg.num_threads);
+    if (metricas_ativas) {
+        encerrar_metricas(thread_metricas);
+    }
+    atomic_store(&log_encerrar, true);
+    pthread_join(escritor, NULL);
+    liberar_buffers_log(&buffers_log);
+    if (cfg.log_operacoes) {
+        unsigned long operacoes = __sync_fetch_and_add(&operacoes_concluidas, 0);
+        printf("Saída do log (%s): %.1f KiB em %lu lotes, %lu chamadas de sistema (%.4f por operação)\n",
+               saida_log.uring ? "io_uring" : "write", saida_log.bytes / 1024.0, saida_log.lotes_enviados,
+               saida_log.syscalls, operacoes ? (double)saida_log.syscalls / operacoes : 0.0);
+    }
+    fechar_saida_log();
+    bool confere = auditar(cfg.benchmark && cfg.saida == NULL ? stderr : stdout);
+    if (cfg.estresse) {
+        confere = verificar_destinos(id_contador, cfg.benchmark && cfg.saida == NULL ? stderr : stdout) && confere;
+    }
+    if (cfg.gravar_execucao != NULL) {
+        gravar_execucao(cfg.gravar_execucao, cfg.benchmark && cfg.saida == NULL ? stderr : stdout);
+    }
+    if (cfg.arquivo_wal != NULL) {
+        atomic_store(&wal_encerrar, true);
+        pthread_join(thread_wal, NULL);
+        liberar_buffers_log(&buffers_wal);
+        double segundos_wal = (agora_ns() - inicio_ns) / 1e9;
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "WAL: %lu registros, %.1f KiB, %lu fdatasync (%.0f/s, %.1f registros por grupo), "
+                "latência de commit p50 %.1f us, p99 %.1f us, %lu recortes depois de checkpoints\n",
+                registros_wal, bytes_wal / 1024.0, fsyncs_wal, fsyncs_wal / segundos_wal,
+                fsyncs_wal ? (double)registros_wal / fsyncs_wal : 0.0,
+                percentil_histograma(&latencia_commit_wal, 50.0) / 1000.0,
+                percentil_histograma(&latencia_commit_wal, 99.0) / 1000.0, recortes_wal);
+    }
+    if (cfg.arquivo_checkpoint != NULL) {
+        // Um checkpoint final com tudo drenado deixa o próximo início sem WAL para reaplicar
+        atomic_store(&checkpoint_encerrar, true);
+        pthread_join(thread_checkpoint, NULL);
+        gravar_checkpoint();
+        fechar_checkpoint();
+        if (cfg.arquivo_wal != NULL) {
+            recortar_wal(atomic_load(&epoca_checkpoint_wal)); // A thread do WAL já terminou
+        }
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Checkpoint: %lu gravados, média de %.2f ms de cópia e %.2f ms de msync\n",
+                checkpoints_gravados, checkpoint_copia_ns / 1e6 / checkpoints_gravados,
+                checkpoint_msync_ns / 1e6 / checkpoints_gravados);
+    }
+    if (cfg.arquivo_wal != NULL) {
+        close(fd_wal);
+    }
+
+    if (threads_io != NULL) {
+        unsigned long aceitas = 0, pedidos = 0, adiamentos = 0, leituras = 0, escritas = 0, respostas = 0;
+        for (int t = 0; t < cfg.threads_io; t++) {
+            aceitas += threads_io[t].conexoes_aceitas;
+            pedidos += threads_io[t].pedidos;
+            adiamentos += threads_io[t].adiamentos;
+            leituras += threads_io[t].leituras;
+            escritas += threads_io[t].escritas;
+            respostas += threads_io[t].respostas;
+        }
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Rede: %lu conexões, %lu pedidos em %lu leituras (%.1f por leitura), "
+                "%lu respostas em %lu escritas (%.1f por escrita), %lu adiamentos com a fila cheia\n",
+                aceitas, pedidos, leituras, leituras ? (double)pedidos / leituras : 0.0,
+                respostas, escritas, escritas ? (double)respostas / escritas : 0.0, adiamentos);
+        liberar_rede();
+    }
+    if (fragmentos_dedup != NULL) {
+        unsigned long consultas = 0, repetidas = 0, em_andamento = 0, reaproveitadas = 0, expiradas = 0, despejadas = 0,
+                      lotados = 0;
+        for (int f = 0; f < num_fragmentos_dedup; f++) {
+            consultas += fragmentos_dedup[f].consultas;
+            repetidas += fragmentos_dedup[f].repetidas;
+            em_andamento += fragmentos_dedup[f].em_andamento;
+            reaproveitadas += fragmentos_dedup[f].reaproveitadas;
+            expiradas += fragmentos_dedup[f].expiradas;
+            despejadas += fragmentos_dedup[f].despejadas;
+            lotados += fragmentos_dedup[f].lotados;
+        }
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Idempotência: %lu consultas em %d fragmentos, %lu repetições respondidas do cache, "
+                "%lu ainda em andamento, %lu chaves reaproveitadas; %lu expiradas, %lu despejadas, "
+                "%lu recusadas com o fragmento só de entradas em andamento\n",
+                consultas, num_fragmentos_dedup, repetidas, em_andamento, reaproveitadas, expiradas, despejadas, lotados);
+    }
+    if (pool.vagas != NULL) {
+        unsigned long despertares = atomic_load(&pool.despertares);
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Pool elástico: %d a %d trabalhadoras curtas, média de %.1f ativas (máximo %d); "
+                "%lu crescimentos, %lu reduções; despertar médio %.1f us, máximo %.1f us\n",
+                cfg.threads_min, trabalhadoras_curtas(), pool.rodadas ? (double)pool.soma_ativas / pool.rodadas : 0.0,
+                pool.maximo_ativas, pool.crescimentos, pool.reducoes,
+                despertares ? atomic_load(&pool.despertar_soma_ns) / 1000.0 / despertares : 0.0,
+                atomic_load(&pool.despertar_maximo_ns) / 1000.0);
+        free(pool.vagas);
+    }
+    if (cfg.percentual_retentativas > 0) {
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Retentativas: %lu requisições reenviadas pelos clientes com a mesma chave%s\n",
+                retentativas_enviadas, fragmentos_dedup == NULL ? " (sem cache: todas executadas de novo)" : "");
+    }
+    if (operacoes_lancamentos_ok + operacoes_lancamentos_recusadas > 0) {
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Lançamentos: %lu operações aplicadas com %lu lançamentos (%.0f lançamentos/s), "
+                "%lu recusadas por saldo insuficiente\n",
+                operacoes_lancamentos_ok, lancamentos_aplicados, lancamentos_aplicados / segundos,
+                operacoes_lancamentos_recusadas);
+    }
+    if (cfg.admissao != ADMISSAO_BLOQUEAR) {
+        static const char *nomes_admissao[] = {"bloquear", "esperar", "recusar", "prioridade"};
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Admissão (%s): recusadas com a fila cheia %lu de prioridade alta, %lu normal, %lu baixa\n",
+                nomes_admissao[cfg.admissao], recusadas_ocupado[PRIORIDADE_ALTA], recusadas_ocupado[PRIORIDADE_NORMAL],
+                recusadas_ocupado[PRIORIDADE_BAIXA]);
+    }
+    // O prazo limita a espera pelos trabalhadores, mas um lote já em execução (ou um
+    // cliente lento para sair) ainda pode estendê-la: o relatório mostra o excesso
+    char excesso[64] = "";
+    uint64_t prazo_drenagem_ns = (uint64_t)cfg.drenagem_ms * 1000000ULL;
+    if (drenagem.duracao_ns > prazo_drenagem_ns + 1000000ULL) { // Abaixo de 1 ms é o custo dos joins
+        snprintf(excesso, sizeof(excesso), ", ultrapassado em %.1f ms", (drenagem.duracao_ns - prazo_drenagem_ns) / 1e6);
+    }
+    fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+            "Encerramento: %d pendentes ao fechar a admissão, drenagem em %.1f ms (prazo %ld ms%s%s), "
+            "%lu concluídas na drenagem, %lu descartadas, %lu recusadas no encerramento\n",
+            drenagem.pendentes, drenagem.duracao_ns / 1e6, cfg.drenagem_ms, drenagem.prazo_esgotado ? ", esgotado" : "",
+            excesso, drenagem.concluidas, requisicoes_descartadas, recusadas_encerramento);
+    if (fd_traco >= 0) {
+        close(fd_traco);
+    }
+    if (cfg.gravar_traco != NULL || cfg.reproduzir_traco != NULL) {
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout, "Traço: %lu requisições %s %s\n",
+                requisicoes_traco, cfg.gravar_traco != NULL ? "gravadas em" : "reproduzidas de",
+                cfg.gravar_traco != NULL ? cfg.gravar_traco : cfg.reproduzir_traco);
+    }
+
+    if (cfg.modo_vazao) {
+        unsigned long lotes = __sync_fetch_and_add(&lotes_processados, 0);
+        printf("Vazão: %.0f ops/s com %d threads trabalhadoras, fila %s (%lu operações em %d s)\n",
+               (double)concluidas / cfg.duracao_execucao, cfg.num_threads,
+               nome_variante(), concluidas, cfg.duracao_execucao);
+        printf("Lotes: %lu seções críticas, média de %.1f operações por lote (máximo %d)\n",
+               lotes, lotes ? (double)concluidas / lotes : 0.0, cfg.tamanho_lote);
+        if (cfg.roubo_trabalho) {
+            printf("Roubo: %lu lotes roubados de outras filas\n", __sync_fetch_and_add(&lotes_roubados, 0));
+        }
+        if (cfg.otimista) {
+            printf("Otimista: %lu conflitos de versão, %lu débitos recorreram à trava da listra\n",
+                   __sync_fetch_and_add(&conflitos_otimistas, 0), __sync_fetch_and_add(&recuos_para_travas, 0));
+        }
+        if (cfg.janela_ondas > 0) {
+            printf("Ondas: %lu janelas, %.1f ondas por janela; %lu fases paralelas com média de %.1f operações\n",
+                   janelas_executadas, janelas_executadas ? (double)ondas_executadas / janelas_executadas : 0.0,
+                   fases_paralelas, fases_paralelas ? (double)operacoes_paralelas / fases_paralelas : 0.0);
+        }
+    }
+    if (cfg.benchmark) {
+        // As operações drenadas após o fim da medição entram no histograma, mas não na vazão
+        Histograma *latencias = criar_histograma();
+        for (int i = 0; i < cfg.num_threads; i++) {
+            somar_histograma(latencias, &histogramas[i]);
+        }
+        emitir_relatorio(concluidas, segundos, latencias);
+        free(latencias);
+    }
+    if (cfg.modo_vazao || cfg.benchmark) {
+        // Cauda de cada classe; as curtas são o total menos as longas
+        Histograma *curtas = criar_histograma();
+        Histograma *longas = criar_histograma();
+        for (int i = 0; i < cfg.num_threads; i++) {
+            somar_histograma(curtas, &histogramas[i]);
+            somar_histograma(longas, &histogramas_longas[i]);
+        }
+        descontar_histograma(curtas, longas);
+        fprintf(cfg.benchmark && cfg.saida == NULL ? stderr : stdout,
+                "Latência por classe%s: curtas p50 %.1f us, p99 %.1f us, p99.9 %.1f us; "
+                "%llu longas p50 %.1f us, p99 %.1f us\n",
+                !cfg.faixas ? " (fila única)" : cfg.trabalhadores_longos > 0 ? " (faixas, longas dedicadas)" : " (faixas)",
+                percentil_histograma(curtas, 50.0) / 1000.0, percentil_histograma(curtas, 99.0) / 1000.0,
+                percentil_histograma(curtas, 99.9) / 1000.0, (unsigned long long)longas->total,
+                percentil_histograma(longas, 50.0) / 1000.0, percentil_histograma(longas, 99.0) / 1000.0);
+        free(curtas);
+        free(longas);
+    }
+
+    // Libera recursos
+    for (int t = 0; t < cfg.num_travas; t++) {
+        pthread_mutex_destroy(&travas_contas[t].mutex);
+    }
+    pthread_mutex_destroy(&mutex_contador);
+    pthread_mutex_destroy(&mutex_snapshot);
+    liberar_dedup();
+    if (cfg.roubo_trabalho) {
+        for (int i = 0; i < cfg.num_threads; i++) {
+            destruir_fila(&filas_trabalhadores[i]);
+        }
+        free(filas_trabalhadores);
+    } else {
+        destruir_fila(&fila_requisicoes);
+    }
+    if (cfg.faixas) {
+        destruir_fila(&fila_longas);
+    }
+    if (cfg.janela_ondas > 0) {
+        destruir_ondas();
+    }
+    free(travas_contas);
+    free(ids_contas);
+    free(saldos_contas);
+    free(saldos_anteriores);
+    free(epocas_contas);
+    free(versoes_contas);
+    free(cpus_permitidas);
+    free(saldos_snapshot);
+    free(slots_epoca);
+    free(threads);
+    free(clientes_ids);
+    free(cliente_ids);
+    free(trabalhador_ids);
+    free(estados_clientes);
+    free(histogramas);
+    free(histogramas_longas);
+    free(tabela_zipf.limiar);
+    free(tabela_zipf.alias);
+    free(tracos_clientes);
+    free(registros_traco);
+
+    if (cfg.estresse && !confere) {
+        fprintf(stderr, "Estresse: invariantes violadas\n");
+        return EXIT_FAILURE;
+    }
+    if (!cfg.benchmark || cfg.saida != NULL) { // Mantém stdout só com o relatório
+        printf("Sistema encerrado com sucesso.\n");
+    }
+    return 0;
+}